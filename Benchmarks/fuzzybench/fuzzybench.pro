@@ -0,0 +1,16 @@
+# Times FuzzyMatcher over 100k names with each instruction set
+# Build: qmake && make, then run ./fuzzybench
+
+QT       -= gui
+
+TARGET = fuzzybench
+CONFIG += console c++11
+CONFIG -= app_bundle
+TEMPLATE = app
+
+INCLUDEPATH += ../..
+
+SOURCES += main.cpp \
+    ../../CodeEditor/fuzzymatcher.cpp
+
+HEADERS += ../../CodeEditor/fuzzymatcher.h
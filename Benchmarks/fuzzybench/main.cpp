@@ -0,0 +1,76 @@
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTextStream>
+#include "CodeEditor/fuzzymatcher.h"
+
+#define BENCH_CANDIDATES 100000
+#define BENCH_RUNS 20
+#define BENCH_LIMIT 50
+
+// Identifiers glued from common parts, like getValue12 or read_file_path3
+static QStringList MakeCandidates(int count) {
+    static const char *parts[] = {
+        "list", "dir", "get", "set", "value", "name", "index", "file", "path",
+        "read", "write", "data", "count", "item", "node", "tree", "user", "load",
+        "save", "open", "close", "parse", "token", "buffer", "line", "text",
+        "size", "range", "key", "map"
+    };
+    const int partCount = sizeof(parts) / sizeof(parts[0]);
+    quint32 seed = 1;
+    QStringList candidates;
+    candidates.reserve(count);
+    for (int i = 0; i < count; i++) {
+        QString word;
+        seed = seed * 1103515245u + 12345u;
+        int length = 1 + (seed >> 16) % 3;
+        for (int k = 0; k < length; k++) {
+            seed = seed * 1103515245u + 12345u;
+            QString part = QLatin1String(parts[(seed >> 16) % partCount]);
+            if (k > 0 && (seed >> 8) % 2) {
+                word += '_';
+            } else if (k > 0) {
+                part[0] = part.at(0).toUpper();
+            }
+            word += part;
+        }
+        word += QString::number(seed % 100);
+        candidates.append(word);
+    }
+    candidates.append("listdir");
+    return candidates;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+    QStringList candidates = MakeCandidates(BENCH_CANDIDATES);
+    QStringList patterns;
+    patterns << "lsdr" << "gv" << "parsetok" << "fp" << "nodeIdx" << "x";
+
+    QElapsedTimer timer;
+    timer.start();
+    FuzzyMatcher matcher;
+    matcher.SetCandidates(candidates);
+    out << "packed " << candidates.size() << " candidates in "
+        << timer.elapsed() << " ms" << endl;
+
+    for (int isa = FUZZY_SCALAR; isa <= FuzzyMatcher::BestIsa(); isa++) {
+        matcher.SetIsa(isa);
+        foreach (const QString &pattern, patterns) {
+            QVector<int> ranked;
+            timer.restart();
+            for (int run = 0; run < BENCH_RUNS; run++) {
+                ranked = matcher.Rank(pattern, BENCH_LIMIT);
+            }
+            double ms = timer.nsecsElapsed() / 1e6 / BENCH_RUNS;
+            out << qSetFieldWidth(8) << left << FuzzyMatcher::IsaName(isa)
+                << qSetFieldWidth(10) << pattern << qSetFieldWidth(0)
+                << QString::number(ms, 'f', 3) << " ms";
+            if (!ranked.isEmpty()) {
+                out << "  best: " << candidates.at(ranked.first());
+            }
+            out << endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,311 @@
+#include "CodeEditor/calltips.h"
+#include <QCursor>
+#include <QKeyEvent>
+#include <QTextBlock>
+#include <QToolTip>
+
+namespace {
+
+bool IsNameCharacter(QChar c) {
+    return c.isLetterOrNumber() || c == '_' || c == '.';
+}
+
+} // namespace
+
+CallTips::CallTips(CodeEditor *editor, Jedi *server, SymbolIndex *symbols)
+    : QObject(editor), m_editor(editor), m_server(server), m_symbols(symbols),
+      m_signatureRequest(-1), m_hoverRequest(-1), m_hoverPosition(-1) {
+    m_label = new QLabel(editor->viewport());
+    m_label->setTextFormat(Qt::RichText);
+    m_label->setStyleSheet("background-color: #9090FF; color: black; padding: 2px");
+    m_label->hide();
+    connect(editor->document(), &QTextDocument::contentsChange, this,
+            &CallTips::DocumentChanged);
+    connect(editor, &QPlainTextEdit::cursorPositionChanged, this,
+            &CallTips::CursorMoved);
+    connect(server, &Jedi::Replied, this, &CallTips::Replied);
+    connect(server, &Jedi::Failed, this, &CallTips::Failed);
+    editor->installEventFilter(this);
+    editor->viewport()->installEventFilter(this);
+}
+
+// Dotted name ending right before position, empty when there is none
+QString CallTips::NameBefore(int position) const {
+    QTextBlock block = m_editor->document()->findBlock(position);
+    QString text = block.text();
+    int end = position - block.position();
+    while (end > 0 && text.at(end - 1).isSpace()) {
+        end--;
+    }
+    int start = end;
+    while (start > 0 && IsNameCharacter(text.at(start - 1))) {
+        start--;
+    }
+    QString name = text.mid(start, end - start);
+    if (name.isEmpty() || name.at(0).isDigit() || name.startsWith('.')) {
+        return QString();
+    }
+    return name;
+}
+
+// Dotted name up to the end of the word at position
+QString CallTips::NameAt(int position, int &start) const {
+    QTextBlock block = m_editor->document()->findBlock(position);
+    QString text = block.text();
+    int end = position - block.position();
+    if (end > 0 && (end >= text.length() || !IsNameCharacter(text.at(end)))) {
+        // Right half of the last character
+        end--;
+    }
+    if (end >= text.length() || !IsNameCharacter(text.at(end))) {
+        return QString();
+    }
+    while (end < text.length() && (text.at(end).isLetterOrNumber() ||
+                                   text.at(end) == '_')) {
+        end++;
+    }
+    QString name = NameBefore(block.position() + end);
+    start = block.position() + end - name.length();
+    return name;
+}
+
+// WHY:
+// Answers are looked up by the typed text, which is only safe when it
+// names the same thing everywhere: a module level name of a library that
+// the document does not redefine. s.split is not kept, s can be anything.
+bool CallTips::IsCacheable(const QString &name,
+                           const QVariantList &resolved) const {
+    foreach (const QVariant &item, resolved) {
+        if (!item.toMap().value("global").toBool()) {
+            return false;
+        }
+    }
+    QString root = name.section('.', 0, 0);
+    return !resolved.isEmpty() &&
+           (!m_symbols || m_symbols->Definition(root, 0) < 0);
+}
+
+void CallTips::DocumentChanged(int position, int charsRemoved, int charsAdded) {
+    // Typing, one character at a time
+    if (charsRemoved != 0 || charsAdded != 1) {
+        return;
+    }
+    QChar typed = m_editor->document()->characterAt(position);
+    if (typed == ',' && m_label->isVisible()) {
+        ShowSignatures();
+        return;
+    }
+    if (typed != '(') {
+        return;
+    }
+    QString name = NameBefore(position);
+    if (name.isEmpty()) {
+        return;
+    }
+    m_openParen = QTextCursor(m_editor->document());
+    m_openParen.setPosition(position + 1);
+    m_signatureName = name;
+    m_server->Cancel(m_signatureRequest);
+    m_signatureRequest = -1;
+    if (m_signatureCache.contains(name)) {
+        m_signatures = m_signatureCache.value(name);
+        ShowSignatures();
+        return;
+    }
+    HideSignatures();
+    QTextBlock block = m_openParen.block();
+    m_signatureRequest = m_server->Signatures(m_editor->toPlainText(),
+                         block.blockNumber(),
+                         m_openParen.position() - block.position());
+}
+
+void CallTips::CursorMoved() {
+    if (m_label->isVisible() && ArgumentIndex() < 0) {
+        HideSignatures();
+    }
+}
+
+// WHY:
+// Replies are matched to the newest request only, a slow reply for a call
+// the cursor already left would show the wrong signature
+void CallTips::Replied(int id, const QVariant &result) {
+    if (id == m_signatureRequest) {
+        m_signatureRequest = -1;
+        QVariantList signatures = result.toList();
+        if (signatures.isEmpty()) {
+            return;
+        }
+        if (IsCacheable(m_signatureName, signatures)) {
+            if (m_signatureCache.size() >= CALLTIPS_CACHE_SIZE) {
+                m_signatureCache.clear();
+            }
+            m_signatureCache.insert(m_signatureName, signatures);
+        }
+        m_signatures = signatures;
+        if (ArgumentIndex() >= 0) {
+            ShowSignatures();
+        }
+    } else if (id == m_hoverRequest) {
+        m_hoverRequest = -1;
+        QVariantMap hover = result.toMap();
+        QString doc = hover.value("doc").toString();
+        int start = -1;
+        QPoint mouse = m_editor->viewport()->mapFromGlobal(QCursor::pos());
+        NameAt(m_editor->cursorForPosition(mouse).position(), start);
+        if (start != m_hoverPosition) {
+            // The mouse went on
+            return;
+        }
+        if (doc.isEmpty()) {
+            return;
+        }
+        if (IsCacheable(m_hoverName, QVariantList() << hover)) {
+            if (m_docCache.size() >= CALLTIPS_CACHE_SIZE) {
+                m_docCache.clear();
+            }
+            m_docCache.insert(m_hoverName, doc);
+        }
+        // A tip already up is a problem under the mouse, it comes first
+        if (!QToolTip::isVisible()) {
+            ShowDoc(doc);
+        }
+    }
+}
+
+void CallTips::Failed(int id) {
+    if (id == m_signatureRequest) {
+        m_signatureRequest = -1;
+    } else if (id == m_hoverRequest) {
+        m_hoverRequest = -1;
+    }
+}
+
+// Commas at the call's own level between its ( and the cursor
+int CallTips::ArgumentIndex() const {
+    if (m_openParen.isNull()) {
+        return -1;
+    }
+    QTextCursor cursor = m_editor->textCursor();
+    if (cursor.block() != m_openParen.block() ||
+            cursor.position() < m_openParen.position()) {
+        return -1;
+    }
+    QString text = cursor.block().text().mid(
+                       m_openParen.positionInBlock(),
+                       cursor.position() - m_openParen.position());
+    int index = 0;
+    int depth = 0;
+    QChar quote;
+    for (int i = 0; i < text.length(); i++) {
+        QChar c = text.at(i);
+        if (!quote.isNull()) {
+            if (c == '\\') {
+                i++;
+            } else if (c == quote) {
+                quote = QChar();
+            }
+        } else if (c == '"' || c == '\'') {
+            quote = c;
+        } else if (c == '(' || c == '[' || c == '{') {
+            depth++;
+        } else if (c == ')' || c == ']' || c == '}') {
+            if (--depth < 0) {
+                return -1;
+            }
+        } else if (c == ',' && depth == 0) {
+            index++;
+        }
+    }
+    return index;
+}
+
+void CallTips::ShowSignatures() {
+    int index = ArgumentIndex();
+    if (index < 0 || m_signatures.isEmpty()) {
+        HideSignatures();
+        return;
+    }
+    QStringList lines;
+    foreach (const QVariant &item, m_signatures) {
+        QVariantMap signature = item.toMap();
+        QStringList params = signature.value("params").toStringList();
+        int current = index;
+        if (current >= params.size() && !params.isEmpty() &&
+                params.last().startsWith('*')) {
+            current = params.size() - 1;
+        }
+        for (int i = 0; i < params.size(); i++) {
+            params[i] = params.at(i).toHtmlEscaped();
+            if (i == current) {
+                params[i] = "<b>" + params.at(i) + "</b>";
+            }
+        }
+        lines.append(signature.value("name").toString().toHtmlEscaped() + "(" +
+                     params.join(", ") + ")");
+    }
+    m_label->setText(lines.join("<br>"));
+    m_label->adjustSize();
+    QRect line = m_editor->cursorRect(m_openParen);
+    int top = line.top() - m_label->height() - 2;
+    if (top < 0) {
+        top = line.bottom() + 2;
+    }
+    m_label->move(qMax(line.left() - m_label->width() / 2, 0), top);
+    m_label->show();
+    m_label->raise();
+}
+
+void CallTips::HideSignatures() {
+    m_label->hide();
+}
+
+void CallTips::ShowDoc(const QString &doc) {
+    QString shown = doc;
+    if (shown.count('\n') > 20) {
+        shown = shown.section('\n', 0, 19) + "\n...";
+    }
+    QToolTip::showText(m_hoverPoint, shown, m_editor->viewport());
+}
+
+// Escape and leaving the editor close the signature, hovering a name asks
+// for its doc
+bool CallTips::eventFilter(QObject *watched, QEvent *event) {
+    if (watched == m_editor) {
+        if ((event->type() == QEvent::KeyPress &&
+                static_cast<QKeyEvent *>(event)->key() == Qt::Key_Escape) ||
+                event->type() == QEvent::FocusOut) {
+            HideSignatures();
+        }
+        return QObject::eventFilter(watched, event);
+    }
+    if (event->type() != QEvent::ToolTip) {
+        return QObject::eventFilter(watched, event);
+    }
+    QHelpEvent *help = static_cast<QHelpEvent *>(event);
+    QTextCursor cursor = m_editor->cursorForPosition(help->pos());
+    int start = -1;
+    QString name = NameAt(cursor.position(), start);
+    if (name.isEmpty()) {
+        m_server->Cancel(m_hoverRequest);
+        m_hoverRequest = -1;
+        m_hoverPosition = -1;
+        QToolTip::hideText();
+        return true;
+    }
+    m_hoverPoint = help->globalPos();
+    if (name == m_hoverName && start == m_hoverPosition && m_hoverRequest >= 0) {
+        // Already asked
+        return true;
+    }
+    m_hoverName = name;
+    m_hoverPosition = start;
+    m_server->Cancel(m_hoverRequest);
+    m_hoverRequest = -1;
+    if (m_docCache.contains(name)) {
+        ShowDoc(m_docCache.value(name));
+        return true;
+    }
+    m_hoverRequest = m_server->Hover(m_editor->toPlainText(), cursor.blockNumber(),
+                                     cursor.positionInBlock());
+    return true;
+}
@@ -0,0 +1,58 @@
+#ifndef CALLTIPS_H
+#define CALLTIPS_H
+
+#include <QHash>
+#include <QLabel>
+#include <QPoint>
+#include <QVariant>
+#include "CodeEditor/codeeditor.h"
+#include "CodeEditor/symbolindex.h"
+
+// Signatures and docs kept for this many names
+#define CALLTIPS_CACHE_SIZE 500
+
+// Call signature shown while typing arguments, docs shown on hover
+// Both are asked from the jedi server, nothing waits for it: a reply is
+// shown when it comes, unless the cursor left the call or the mouse left
+// the name by then. Answers for module level library names (os.path.join)
+// are kept per dotted name, anything else (methods of a variable, names
+// of the document) is asked again every time.
+class CallTips : public QObject {
+    Q_OBJECT
+  public:
+    CallTips(CodeEditor *editor, Jedi *server, SymbolIndex *symbols);
+
+  protected:
+    bool eventFilter(QObject *watched, QEvent *event);
+
+  private slots:
+    void DocumentChanged(int position, int charsRemoved, int charsAdded);
+    void CursorMoved();
+    void Replied(int id, const QVariant &result);
+    void Failed(int id);
+
+  private:
+    CodeEditor *m_editor;
+    Jedi *m_server;
+    SymbolIndex *m_symbols;
+    QLabel *m_label; // signature, over the line being typed
+    QTextCursor m_openParen; // after the ( of the shown call
+    QVariantList m_signatures;
+    int m_signatureRequest;
+    QString m_signatureName;
+    int m_hoverRequest;
+    QString m_hoverName;
+    int m_hoverPosition; // start of the hovered name
+    QPoint m_hoverPoint; // global, where the tip goes
+    QHash<QString, QVariantList> m_signatureCache;
+    QHash<QString, QString> m_docCache;
+    QString NameBefore(int position) const;
+    QString NameAt(int position, int &start) const;
+    bool IsCacheable(const QString &name, const QVariantList &resolved) const;
+    int ArgumentIndex() const; // -1 when the call was closed
+    void ShowSignatures();
+    void HideSignatures();
+    void ShowDoc(const QString &doc);
+};
+
+#endif // CALLTIPS_H
@@ -44,9 +44,16 @@
 #include <QDebug>
 #include <QTextStream>
 #include "CodeEditor/codeeditor.h"
-
-CodeEditor::CodeEditor(QWidget *parent) : QPlainTextEdit(parent), m_completer(0), m_jediCompleter(0) {
+#include "CodeEditor/pythontokenizer.h"
+#include "CodeEditor/symbolindex.h"
+#include "CodeEditor/completionindex.h"
+#include "CodeEditor/completioncache.h"
+
+CodeEditor::CodeEditor(QWidget *parent) : QPlainTextEdit(parent), m_completer(0), m_jediCompleter(0), m_jedi(0), m_jediModel(0), m_gotoRequest(-1), m_symbols(0), m_completions(0),
+    m_firstVisible(-1), m_lastVisible(-1), m_gutterWidth(0), m_digitWidth(0),
+    m_digitHeight(0), m_atlasRatio(1), m_usedLanes(0), m_cellsEnabled(false) {
     lineNumberArea = new LineNumberArea(this);
+    BuildDigitAtlas();
 
     connect(this, SIGNAL(blockCountChanged(int)), this,
             SLOT(updateLineNumberAreaWidth(int)));
@@ -54,6 +61,9 @@ CodeEditor::CodeEditor(QWidget *parent) : QPlainTextEdit(parent), m_completer(0)
             SLOT(updateLineNumberArea(QRect, int)));
 
     updateLineNumberAreaWidth(0);
+    m_layers.resize(SELECTION_LAYER_COUNT);
+    m_jediCache = new CompletionCache(document());
+    m_jediRequest.id = -1;
 
     QPalette p = this->palette();
     p.setColor(QPalette::Base, Qt::black);
@@ -75,19 +85,28 @@ void CodeEditor::setCompleter(QCompleter *completer) {
                      SLOT(insertCompletion(QString)));
 }
 
-void CodeEditor::setJediCompleter(QCompleter *jediCompleter, const QString& getJediCode) {
+// The jedi server is shared by all editors, each one keeps to its own ids
+void CodeEditor::setJediCompleter(QCompleter *jediCompleter, Jedi *jedi) {
     if (m_jediCompleter) {
         QObject::disconnect(m_jediCompleter, 0, this, 0);
     } else {
-        m_jedi = new Jedi(this);
-        m_jedi->SetJediGetCode(QString(getJediCode.toStdString().c_str()));
+        m_jediModel = new QStringListModel(this);
+    }
+    if (m_jedi) {
+        QObject::disconnect(m_jedi, 0, this, 0);
     }
 
+    m_jedi = jedi;
+    if (m_jedi) {
+        connect(m_jedi, &Jedi::Replied, this, &CodeEditor::JediReplied);
+        connect(m_jedi, &Jedi::Failed, this, &CodeEditor::JediFailed);
+    }
     m_jediCompleter = jediCompleter;
 
     if (!m_jediCompleter)
         return;
 
+    m_jediCompleter->setModel(m_jediModel);
     m_jediCompleter->setWidget(this);
     QObject::connect(m_jediCompleter, SIGNAL(activated(QString)), this,
                      SLOT(insertCompletion(QString)));
@@ -101,6 +120,122 @@ QCompleter *CodeEditor::jediCompleter() const {
     return this->m_jediCompleter;
 }
 
+void CodeEditor::SetLayerSelections(int layer,
+                                    const QList<QTextEdit::ExtraSelection> &selections) {
+    m_layers[layer] = selections;
+    QList<QTextEdit::ExtraSelection> merged;
+    foreach (const QList<QTextEdit::ExtraSelection> &list, m_layers) {
+        merged += list;
+    }
+    setExtraSelections(merged);
+}
+
+void CodeEditor::SetSymbolIndex(SymbolIndex *index) {
+    m_symbols = index;
+}
+
+// Candidates of the static completer are looked up for each prefix
+void CodeEditor::SetCompletionIndex(CompletionIndex *index) {
+    m_completions = index;
+}
+
+// Moves to where the name under the cursor is defined in this document
+// Names the symbol index does not know (locals, parameters, imports) are
+// asked from the jedi server
+void CodeEditor::GotoDefinition() {
+    QString name = textUnderCursor();
+    if (name.isEmpty()) {
+        return;
+    }
+    int line = m_symbols ? m_symbols->Definition(name, textCursor().blockNumber()) :
+               -1;
+    if (line >= 0) {
+        ShowDefinition(line, -1, name);
+        return;
+    }
+    if (m_jedi) {
+        m_jedi->Cancel(m_gotoRequest);
+        m_gotoRequest = m_jedi->Goto(toPlainText(), textCursor().blockNumber(),
+                                     textCursor().positionInBlock());
+    }
+}
+
+// Ctrl+Enter and Shift+Enter run cells instead of breaking the line
+void CodeEditor::SetCellsEnabled(bool enabled) {
+    m_cellsEnabled = enabled;
+}
+
+// Lines of the cell holding line, from its "# %%" marker (or the top) to
+// the line before the next marker (or the end)
+void CodeEditor::CellAt(int line, int &first, int &last) const {
+    QTextBlock block = document()->findBlockByNumber(line);
+    QTextBlock top = block;
+    while (top.previous().isValid() &&
+            !PythonTokenizer::IsCellMarker(top.text())) {
+        top = top.previous();
+    }
+    QTextBlock bottom = block;
+    while (bottom.next().isValid() &&
+            !PythonTokenizer::IsCellMarker(bottom.next().text())) {
+        bottom = bottom.next();
+    }
+    first = top.blockNumber();
+    last = bottom.blockNumber();
+}
+
+// Asks to run the selected lines, or the cell of the cursor when nothing is
+// selected. With next the cursor moves on to the following cell.
+void CodeEditor::RunCell(bool next) {
+    QTextCursor cursor = textCursor();
+    int first = 0;
+    int last = 0;
+    if (cursor.hasSelection() && !next) {
+        first = document()->findBlock(cursor.selectionStart()).blockNumber();
+        QTextBlock end = document()->findBlock(cursor.selectionEnd());
+        last = end.blockNumber();
+        if (end.position() == cursor.selectionEnd() && last > first) {
+            // Selected up to the start of a line, that line is not in
+            last--;
+        }
+    } else {
+        CellAt(cursor.blockNumber(), first, last);
+    }
+    QTextBlock block = document()->findBlockByNumber(first);
+    QStringList lines;
+    for (int i = first; i <= last && block.isValid(); i++) {
+        lines << block.text();
+        block = block.next();
+    }
+    if (next) {
+        cursor.movePosition(QTextCursor::End);
+        if (block.isValid()) {
+            cursor.setPosition(block.position());
+        }
+        setTextCursor(cursor);
+        ensureCursorVisible();
+    }
+    emit RunRequested(lines.join('\n'), first, last);
+}
+
+// Selects name on line, found on the line when column is -1
+void CodeEditor::ShowDefinition(int line, int column, const QString &name) {
+    QTextBlock block = document()->findBlockByNumber(line);
+    if (!block.isValid()) {
+        return;
+    }
+    QTextCursor cursor(block);
+    if (column < 0) {
+        column = block.text().indexOf(name);
+    }
+    if (column >= 0 && column + name.length() <= block.length()) {
+        cursor.setPosition(block.position() + column);
+        cursor.setPosition(block.position() + column + name.length(),
+                           QTextCursor::KeepAnchor);
+    }
+    setTextCursor(cursor);
+    centerCursor();
+}
+
 void CodeEditor::insertCompletion(const QString &completion) {
     QCompleter* q;
     if (m_jediCompleter->popup()->isVisible()) {
@@ -125,27 +260,214 @@ QString CodeEditor::textUnderCursor() const {
     return tc.selectedText();
 }
 
+// Jedi completions at the cursor, from the cache while the same identifier
+// is typed. On a miss the server is asked when ask is set, the words come
+// later through JediReplied.
+bool CodeEditor::JediWords(bool ask, QStringList &words) {
+    QTextCursor word = textCursor();
+    word.select(QTextCursor::WordUnderCursor);
+    int line = word.blockNumber();
+    int column = word.selectionStart() - word.block().position();
+    QString prefix = word.selectedText();
+    if (m_jediCache->Lookup(line, column, prefix, words)) {
+        return true;
+    }
+    if (!ask || !m_jedi) {
+        return false;
+    }
+    // Only the newest request matters
+    m_jedi->Cancel(m_jediRequest.id);
+    m_jediRequest.id = m_jedi->Complete(toPlainText(), line,
+                                        textCursor().positionInBlock());
+    m_jediRequest.line = line;
+    m_jediRequest.column = column;
+    m_jediRequest.prefix = prefix;
+    m_jediRequest.revision = document()->revision();
+    return false;
+}
+
+void CodeEditor::ShowJediWords(const QStringList &words) {
+    m_jediModel->setStringList(words);
+    m_jediCompleter->setCompletionPrefix(textUnderCursor());
+    m_jediCompleter->popup()->setCurrentIndex(m_jediCompleter->completionModel()->index(0, 0));
+    QRect cr = cursorRect();
+    cr.setWidth(m_jediCompleter->popup()->sizeHintForColumn(0) +
+                m_jediCompleter->popup()->verticalScrollBar()->sizeHint().width());
+    m_completer->popup()->hide();
+    m_jediCompleter->complete(cr);
+}
+
+// WHY:
+// A reply for a document that changed since the request is dropped, the
+// words would be for text that is no longer there
+void CodeEditor::JediReplied(int id, const QVariant &result) {
+    if (id == m_gotoRequest) {
+        m_gotoRequest = -1;
+        foreach (const QVariant &item, result.toList()) {
+            QVariantMap name = item.toMap();
+            // No path is this document, it is never saved for jedi
+            if (name.value("path").toString().isEmpty()) {
+                ShowDefinition(name.value("line").toInt(), name.value("column").toInt(),
+                               name.value("name").toString());
+                return;
+            }
+        }
+        return;
+    }
+    if (id != m_jediRequest.id) {
+        return;
+    }
+    m_jediRequest.id = -1;
+    if (document()->revision() != m_jediRequest.revision || !hasFocus() ||
+            !m_jediCompleter) {
+        return;
+    }
+    QStringList words = m_jediCache->Store(m_jediRequest.line,
+                                           m_jediRequest.column,
+                                           m_jediRequest.prefix,
+                                           result.toStringList());
+    if (!words.isEmpty()) {
+        ShowJediWords(words);
+    }
+}
+
+void CodeEditor::JediFailed(int id) {
+    if (id == m_jediRequest.id) {
+        m_jediRequest.id = -1;
+    } else if (id == m_gotoRequest) {
+        m_gotoRequest = -1;
+    }
+}
+
 void CodeEditor::focusInEvent(QFocusEvent *e) {
     if (m_completer)
         m_completer->setWidget(this);
     QPlainTextEdit::focusInEvent(e);
 }
 
+void CodeEditor::changeEvent(QEvent *e) {
+    QPlainTextEdit::changeEvent(e);
+    if (e->type() == QEvent::FontChange) {
+        BuildDigitAtlas();
+        updateLineNumberAreaWidth(0);
+        lineNumberArea->update();
+    }
+}
+
 int CodeEditor::lineNumberAreaWidth() {
+    return m_gutterWidth;
+}
+
+// Width only changes with the number of digits, the font or the lanes
+void CodeEditor::updateLineNumberAreaWidth(int /* newBlockCount */) {
     int digits = 1;
     int max = qMax(1, blockCount());
     while (max >= 10) {
         max /= 10;
         ++digits;
     }
+    int width = 3 + LaneAreaWidth() + m_digitWidth * digits;
+    if (width == m_gutterWidth) {
+        return;
+    }
+    m_gutterWidth = width;
+    setViewportMargins(m_gutterWidth, 0, 0, 0);
+    QRect cr = contentsRect();
+    lineNumberArea->setGeometry(
+        QRect(cr.left(), cr.top(), m_gutterWidth, cr.height()));
+}
 
-    int space = 3 + fontMetrics().width(QLatin1Char('9')) * digits;
+// WHY:
+// Drawing text shapes every number again, copying glyphs from a pixmap
+// made once per font is a plain blit
+void CodeEditor::BuildDigitAtlas() {
+    QFontMetrics metrics(font());
+    m_digitWidth = 0;
+    for (char digit = '0'; digit <= '9'; digit++) {
+        m_digitWidth = qMax(m_digitWidth, metrics.width(QLatin1Char(digit)));
+    }
+    m_digitHeight = metrics.height();
+    m_atlasRatio = devicePixelRatioF();
+    QPixmap atlas(QSize(m_digitWidth * 10, m_digitHeight) * m_atlasRatio);
+    atlas.setDevicePixelRatio(m_atlasRatio);
+    atlas.fill(Qt::transparent);
+    QPainter painter(&atlas);
+    painter.setFont(font());
+    painter.setPen(Qt::black);
+    for (int digit = 0; digit < 10; digit++) {
+        painter.drawText(QRect(digit * m_digitWidth, 0, m_digitWidth, m_digitHeight),
+                         Qt::AlignRight, QString::number(digit));
+    }
+    painter.end();
+    m_digitAtlas = atlas;
+    m_laneStrips.clear();
+}
 
-    return space;
+int CodeEditor::LaneAreaWidth() const {
+    int lanes = 0;
+    for (int lane = 0; lane < GUTTER_LANE_COUNT; lane++) {
+        if (m_usedLanes & (1u << lane)) {
+            lanes++;
+        }
+    }
+    return lanes * GUTTER_LANE_WIDTH;
 }
 
-void CodeEditor::updateLineNumberAreaWidth(int /* newBlockCount */) {
-    setViewportMargins(lineNumberAreaWidth(), 0, 0, 0);
+void CodeEditor::SetLaneLines(int lane, const QList<int> &lines) {
+    uint bit = 1u << lane;
+    QHash<int, uint>::iterator it = m_lineLanes.begin();
+    while (it != m_lineLanes.end()) {
+        it.value() &= ~bit;
+        if (it.value() == 0) {
+            it = m_lineLanes.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    foreach (int line, lines) {
+        m_lineLanes[line] |= bit;
+    }
+    uint used = lines.isEmpty() ? (m_usedLanes & ~bit) : (m_usedLanes | bit);
+    if (used != m_usedLanes) {
+        m_usedLanes = used;
+        m_laneStrips.clear();
+        updateLineNumberAreaWidth(0);
+    }
+    lineNumberArea->update();
+}
+
+// Marks of every lane in lanes drawn side by side, one pixmap per
+// combination so a row costs one blit however many lanes it has
+QPixmap CodeEditor::LaneStrip(uint lanes) {
+    QHash<uint, QPixmap>::const_iterator cached = m_laneStrips.constFind(lanes);
+    if (cached != m_laneStrips.constEnd()) {
+        return cached.value();
+    }
+    static const QColor colors[GUTTER_LANE_COUNT] = {
+        QColor(200, 30, 30), // breakpoint
+        QColor(40, 160, 40), // coverage
+        QColor(240, 140, 0), // heat
+        QColor(230, 40, 40), // error
+        QColor(230, 190, 0) // warning
+    };
+    QPixmap strip(QSize(qMax(LaneAreaWidth(), 1), m_digitHeight) * m_atlasRatio);
+    strip.setDevicePixelRatio(m_atlasRatio);
+    strip.fill(Qt::transparent);
+    QPainter painter(&strip);
+    int x = 0;
+    for (int lane = 0; lane < GUTTER_LANE_COUNT; lane++) {
+        if (!(m_usedLanes & (1u << lane))) {
+            continue;
+        }
+        if (lanes & (1u << lane)) {
+            painter.fillRect(x, 1, GUTTER_LANE_WIDTH - 1, m_digitHeight - 2,
+                             colors[lane]);
+        }
+        x += GUTTER_LANE_WIDTH;
+    }
+    painter.end();
+    m_laneStrips.insert(lanes, strip);
+    return strip;
 }
 
 void CodeEditor::updateLineNumberArea(const QRect &rect, int dy) {
@@ -156,6 +478,26 @@ void CodeEditor::updateLineNumberArea(const QRect &rect, int dy) {
 
     if (rect.contains(viewport()->rect()))
         updateLineNumberAreaWidth(0);
+
+    UpdateVisibleBlocks();
+}
+
+void CodeEditor::UpdateVisibleBlocks() {
+    QTextBlock block = firstVisibleBlock();
+    int first = block.blockNumber();
+    int last = first;
+    int top = (int)blockBoundingGeometry(block).translated(contentOffset()).top();
+    int height = viewport()->height();
+    for (int number = first; block.isValid() && top <= height; number++) {
+        last = number;
+        top += (int)blockBoundingRect(block).height();
+        block = block.next();
+    }
+    if (first != m_firstVisible || last != m_lastVisible) {
+        m_firstVisible = first;
+        m_lastVisible = last;
+        emit VisibleBlocksChanged(first, last);
+    }
 }
 
 void CodeEditor::resizeEvent(QResizeEvent *e) {
@@ -163,60 +505,258 @@ void CodeEditor::resizeEvent(QResizeEvent *e) {
 
     QRect cr = contentsRect();
     lineNumberArea->setGeometry(
-        QRect(cr.left(), cr.top(), lineNumberAreaWidth(), cr.height()));
-}
-
-void CodeEditor::SelectLineMarginBlock() {
-    int start, end;
-
-    // get current positions
-    start = this->textCursor().selectionStart();
-    end = this->textCursor().selectionEnd();
-
-    QTextCursor cursor(this->document());
-
-    // move cursor to begin of the line, of the line
-    // start position is located.
-    cursor.clearSelection();
-    cursor.setPosition(start);
-    cursor.movePosition(QTextCursor::StartOfLine);
-    this->setTextCursor(cursor);
-    start = this->textCursor().selectionStart();
-
-    // move cursor to end of the line, of the line
-    // end position is located.
-    cursor.setPosition(end);
-    cursor.movePosition(QTextCursor::EndOfLine);
-    this->setTextCursor(cursor);
-    end = this->textCursor().selectionEnd();
-
-    // select line margin block
-    cursor.setPosition(start, QTextCursor::KeepAnchor);
-    this->setTextCursor(cursor);
-}
-QString CodeEditor::GetLine() {
-    int start = this->textCursor().position();
-    QTextCursor cursor(this->document());
-    cursor.setPosition(start);
-    cursor.movePosition(QTextCursor::StartOfLine);
-    this->setTextCursor(cursor);
-    cursor.movePosition(QTextCursor::EndOfLine, QTextCursor::KeepAnchor);
-    this->setTextCursor(cursor);
-    QString text = this->textCursor().selection().toPlainText();
-    cursor.movePosition(QTextCursor::EndOfLine);
-    this->setTextCursor(cursor);
-    return text;
+        QRect(cr.left(), cr.top(), m_gutterWidth, cr.height()));
+    UpdateVisibleBlocks();
 }
-bool CodeEditor::KeepIndent() {
-    if (this->textCursor().hasSelection() || !this->textCursor().atBlockEnd()) {
-        return false;
+
+// Number of leading spaces and tabs
+static int IndentOf(const QString &text) {
+    int indent = 0;
+    while (indent < text.length() &&
+            (text.at(indent) == ' ' || text.at(indent) == '\t')) {
+        indent++;
+    }
+    return indent;
+}
+
+// First and last line of the selection, the cursor's line without one
+void CodeEditor::SelectedLines(QTextBlock &first, QTextBlock &last) const {
+    QTextCursor selection = textCursor();
+    first = document()->findBlock(selection.selectionStart());
+    last = document()->findBlock(selection.selectionEnd());
+    // Selection ending at the start of a line does not include that line
+    if (last != first && selection.selectionEnd() == last.position()) {
+        last = last.previous();
+    }
+}
+
+// Runs edit on each selected line, all of it is one undo step
+// WHY:
+// Lines are changed in place with small insertions and removals, the
+// document reports a single change at the end so only the touched lines
+// are laid out and highlighted again
+void CodeEditor::EditSelectedLines(
+    const std::function<void(QTextCursor &, const QTextBlock &)> &edit) {
+    QTextCursor selection = textCursor();
+    bool hadSelection = selection.hasSelection();
+    QTextBlock first;
+    QTextBlock last;
+    SelectedLines(first, last);
+
+    QTextCursor cursor(document());
+    cursor.beginEditBlock();
+    for (QTextBlock block = first; block.isValid(); block = block.next()) {
+        edit(cursor, block);
+        if (block == last) {
+            break;
+        }
+    }
+    cursor.endEditBlock();
+
+    if (hadSelection) {
+        // Keep whole lines selected so the edit can be repeated
+        selection.setPosition(first.position());
+        selection.setPosition(last.position() + last.length() - 1,
+                              QTextCursor::KeepAnchor);
+        setTextCursor(selection);
+    }
+}
+
+void CodeEditor::IndentLines() {
+    EditSelectedLines([](QTextCursor & cursor, const QTextBlock & block) {
+        cursor.setPosition(block.position());
+        cursor.insertText("    ");
+    });
+}
+
+void CodeEditor::UnindentLines() {
+    EditSelectedLines([](QTextCursor & cursor, const QTextBlock & block) {
+        QString text = block.text();
+        int remove = 0;
+        if (text.startsWith('\t')) {
+            remove = 1;
+        } else {
+            while (remove < 4 && remove < text.length() && text.at(remove) == ' ') {
+                remove++;
+            }
+        }
+        if (remove > 0) {
+            cursor.setPosition(block.position());
+            cursor.setPosition(block.position() + remove, QTextCursor::KeepAnchor);
+            cursor.removeSelectedText();
+        }
+    });
+}
+
+// Comments out the lines at their common indent, or uncomments them when
+// every non blank line is already a comment
+void CodeEditor::ToggleComment() {
+    int column = -1;
+    bool commented = true;
+    QTextBlock first;
+    QTextBlock last;
+    SelectedLines(first, last);
+    // Only read, so no edit block for it
+    for (QTextBlock block = first; block.isValid(); block = block.next()) {
+        QString text = block.text();
+        int indent = IndentOf(text);
+        if (indent < text.length()) {
+            column = (column < 0) ? indent : qMin(column, indent);
+            commented = commented && text.at(indent) == '#';
+        }
+        if (block == last) {
+            break;
+        }
+    }
+    if (column < 0) {
+        return;
+    }
+    EditSelectedLines([&](QTextCursor & cursor, const QTextBlock & block) {
+        QString text = block.text();
+        int indent = IndentOf(text);
+        if (indent == text.length()) {
+            return;
+        }
+        if (commented) {
+            int remove = text.midRef(indent).startsWith("# ") ? 2 : 1;
+            cursor.setPosition(block.position() + indent);
+            cursor.setPosition(block.position() + indent + remove,
+                               QTextCursor::KeepAnchor);
+            cursor.removeSelectedText();
+        } else {
+            cursor.setPosition(block.position() + column);
+            cursor.insertText("# ");
+        }
+    });
+}
+
+// Moves the lines left so the least indented one starts at column
+void CodeEditor::DedentToColumn(int column) {
+    int indent = -1;
+    QTextBlock first;
+    QTextBlock last;
+    SelectedLines(first, last);
+    for (QTextBlock block = first; block.isValid(); block = block.next()) {
+        QString text = block.text();
+        int current = IndentOf(text);
+        if (current < text.length()) {
+            indent = (indent < 0) ? current : qMin(indent, current);
+        }
+        if (block == last) {
+            break;
+        }
+    }
+    int remove = indent - column;
+    if (remove <= 0) {
+        return;
+    }
+    EditSelectedLines([&](QTextCursor & cursor, const QTextBlock & block) {
+        int count = qMin(remove, IndentOf(block.text()));
+        if (count > 0) {
+            cursor.setPosition(block.position());
+            cursor.setPosition(block.position() + count, QTextCursor::KeepAnchor);
+            cursor.removeSelectedText();
+        }
+    });
+}
+// Lexer state at the start of block, left there by the python highlighter
+static int StartState(const QTextBlock &block) {
+    QTextBlock previous = block.previous();
+    return previous.isValid() ? qMax(previous.userState(), 0) : 0;
+}
+
+// Line ends in the middle of a statement
+static bool InsideStatement(const PythonLexState &state) {
+    return state.string != STRING_NONE || state.brackets > 0 || state.continued;
+}
+
+static QString OneLevelLess(QString indent) {
+    if (indent.endsWith('\t')) {
+        indent.chop(1);
+    } else {
+        int spaces = 0;
+        while (spaces < 4 && indent.endsWith(' ')) {
+            indent.chop(1);
+            spaces++;
+        }
     }
-    QRegExp spaces("(\\s*).*");
+    return indent;
+}
 
-    spaces.indexIn(GetLine());
-    this->insertPlainText(tr("\n"));
-    this->insertPlainText(spaces.cap(1));
+// Indent of the line after block in python code
+// WHY:
+// Strings, brackets and backslash continuations come from the block
+// states the highlighter already keeps, the line itself is only split to
+// find where a comment starts.
+static QString PythonIndent(const QTextBlock &block) {
+    static const PythonTokenizer tokenizer;
+    QString text = block.text();
+    QString indent = text.left(IndentOf(text));
+    PythonLexState start = PythonLexState::Unpack(StartState(block));
+    PythonLexState end = PythonLexState::Unpack(block.userState());
+    if (end.string != STRING_NONE) {
+        // Text of a long string is left as it is
+        return indent;
+    }
+    if (end.brackets > 0 || end.continued) {
+        // Hanging indent for the lines of an unfinished statement
+        if (end.brackets > start.brackets || !InsideStatement(start)) {
+            return indent + "    ";
+        }
+        return indent;
+    }
 
+    // Statement ended, continue from the line it started on
+    QTextBlock first = block;
+    while (first.previous().isValid() &&
+            InsideStatement(PythonLexState::Unpack(StartState(first)))) {
+        first = first.previous();
+    }
+    QString firstText = first.text();
+    indent = firstText.left(IndentOf(firstText));
+
+    PythonTokens tokens;
+    tokenizer.Tokenize(text, StartState(block), tokens);
+    int codeEnd = text.length();
+    if (!tokens.isEmpty() && tokens.last().kind == TOKEN_COMMENT) {
+        codeEnd = tokens.last().start;
+    }
+    QString code = text.left(codeEnd).trimmed();
+    if (code.endsWith(':')) {
+        return indent + "    ";
+    }
+
+    QString word = firstText.mid(indent.length());
+    int wordEnd = 0;
+    // Whole identifier, so return_value does not read as return
+    while (wordEnd < word.length() && (word.at(wordEnd).isLetterOrNumber() ||
+                                       word.at(wordEnd) == '_')) {
+        wordEnd++;
+    }
+    word.truncate(wordEnd);
+    if (word == "return" || word == "pass" || word == "break" ||
+            word == "continue" || word == "raise") {
+        return OneLevelLess(indent);
+    }
+    return indent;
+}
+
+// Starts the new line at the right indent, reads the line from its block so
+// the visible cursor is not moved around
+bool CodeEditor::KeepIndent() {
+    QTextCursor cursor = this->textCursor();
+    if (cursor.hasSelection() || !cursor.atBlockEnd()) {
+        return false;
+    }
+    QTextBlock block = cursor.block();
+    QString indent;
+    if (block.userState() >= 0) {
+        // Only the python highlighter sets block states
+        indent = PythonIndent(block);
+    } else {
+        indent = block.text().left(IndentOf(block.text()));
+    }
+    this->insertPlainText("\n" + indent);
     return true;
 }
 void CodeEditor::keyPressEvent(QKeyEvent *e) {
@@ -252,36 +792,25 @@ void CodeEditor::keyPressEvent(QKeyEvent *e) {
     } else {
         switch (e->key()) {
         case Qt::Key_Backtab:
-            SelectLineMarginBlock();
-            {
-                QString text("");
-                QStringList lines = this->textCursor().selection().toPlainText().split(
-                                        QRegExp("\n|\r\n|\r"));
-                foreach (QString line, lines) {
-                    line.replace(QRegExp("^(    |   |  | )(.*)"), "\\2");
-                    text.append(line);
-                    text.append("\n");
-                }
-                text.truncate(text.length() - 1);
-                this->textCursor().insertText(text);
+            if (e->modifiers() & Qt::ControlModifier) {
+                DedentToColumn(0);
+            } else {
+                UnindentLines();
             }
             no_process = true;
             break;
+        case Qt::Key_F12:
+            GotoDefinition();
+            return;
+        case Qt::Key_Slash:
+            if (e->modifiers() & Qt::ControlModifier) {
+                ToggleComment();
+                return;
+            }
+            break;
         case Qt::Key_Tab:
             if (this->textCursor().hasSelection()) {
-                SelectLineMarginBlock();
-                {
-                    QString text("");
-                    QStringList lines = this->textCursor().selection().toPlainText().split(
-                                            QRegExp("\n|\r\n|\r"));
-                    foreach (QString line, lines) {
-                        text.append("    ");
-                        text.append(line);
-                        text.append("\n");
-                    }
-                    text.truncate(text.length() - 1);
-                    this->textCursor().insertText(text);
-                }
+                IndentLines();
             } else {
                 this->insertPlainText("    ");
             }
@@ -289,6 +818,11 @@ void CodeEditor::keyPressEvent(QKeyEvent *e) {
             break;
         case Qt::Key_Enter:
         case Qt::Key_Return:
+            if (m_cellsEnabled &&
+                    (e->modifiers() & (Qt::ControlModifier | Qt::ShiftModifier))) {
+                RunCell(e->modifiers() & Qt::ShiftModifier);
+                return;
+            }
             if (!KeepIndent()) {
                 QPlainTextEdit::keyPressEvent(e);
                 return;
@@ -317,6 +851,14 @@ void CodeEditor::keyPressEvent(QKeyEvent *e) {
     bool hasModifier = (e->modifiers() != Qt::NoModifier) && !ctrlOrShift;
     QString completionPrefix = textUnderCursor();
 
+    // Typing on in a jedi popup narrows what jedi already gave
+    QStringList jediWords;
+    if (!ctrlSpace && !hasModifier && !e->text().isEmpty() &&
+            m_jediCompleter->popup()->isVisible() && JediWords(false, jediWords)) {
+        ShowJediWords(jediWords);
+        return;
+    }
+
     // Hide if Escape, Return or Enter or text is less than 2 characters
     if (!ctrlSpace &&
             (hasModifier || e->text().isEmpty() || completionPrefix.length() < 2)) {
@@ -331,23 +873,23 @@ void CodeEditor::keyPressEvent(QKeyEvent *e) {
         m_jediCompleter->popup()->setCurrentIndex(m_completer->completionModel()->index(0, 0));
     }
     if (completionPrefix != m_completer->completionPrefix()) {
+        if (m_completions) {
+            QHash<QString, int> nearby;
+            if (m_symbols) {
+                nearby = m_symbols->NearbyWords(textCursor().blockNumber(),
+                                                COMPLETION_NEARBY_LINES);
+            }
+            m_completions->Fill(completionPrefix, nearby);
+        }
         m_completer->setCompletionPrefix(completionPrefix);
         m_completer->popup()->setCurrentIndex(m_completer->completionModel()->index(0, 0));
     }
     if (ctrlSpace) {
-        QRect cr = cursorRect();
-        cr.setWidth(m_completer->popup()->sizeHintForColumn(0) +
-                    m_completer->popup()->verticalScrollBar()->sizeHint().width());
         m_completer->popup()->hide();
         m_jediCompleter->popup()->hide();
-        QApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
-        int row = this->textCursor().blockNumber();
-        int col = this->textCursor().positionInBlock();
-        QStringList words = m_jedi->AutoComplete(this->toPlainText(), row, col);
-        QStringListModel *updatedJedi = new QStringListModel(words, m_jedi);
-        m_jediCompleter->setModel(updatedJedi);
-        QApplication::restoreOverrideCursor();
-        m_jediCompleter->complete(cr);
+        if (JediWords(true, jediWords)) {
+            ShowJediWords(jediWords);
+        }
     } else {
         QRect cr = cursorRect();
         cr.setWidth(m_completer->popup()->sizeHintForColumn(0) +
@@ -357,7 +899,13 @@ void CodeEditor::keyPressEvent(QKeyEvent *e) {
     }
 }
 
+// Only rows inside the damaged rect are drawn, numbers are copied from the
+// digit atlas and lane marks from the cached strips
 void CodeEditor::lineNumberAreaPaintEvent(QPaintEvent *event) {
+    if (!qFuzzyCompare(m_atlasRatio, devicePixelRatioF())) {
+        // Moved to a screen with another scale
+        BuildDigitAtlas();
+    }
     QPainter painter(lineNumberArea);
     painter.fillRect(event->rect(), Qt::darkGray);
 
@@ -365,13 +913,28 @@ void CodeEditor::lineNumberAreaPaintEvent(QPaintEvent *event) {
     int blockNumber = block.blockNumber();
     int top = (int)blockBoundingGeometry(block).translated(contentOffset()).top();
     int bottom = top + (int)blockBoundingRect(block).height();
+    int right = lineNumberArea->width();
+    qreal glyphWidth = m_digitWidth * m_atlasRatio;
+    qreal glyphHeight = m_digitHeight * m_atlasRatio;
 
     while (block.isValid() && top <= event->rect().bottom()) {
         if (block.isVisible() && bottom >= event->rect().top()) {
-            QString number = QString::number(blockNumber + 1);
-            painter.setPen(Qt::black);
-            painter.drawText(0, top, lineNumberArea->width(), fontMetrics().height(),
-                             Qt::AlignRight, number);
+            int number = blockNumber + 1;
+            int x = right;
+            do {
+                x -= m_digitWidth;
+                painter.drawPixmap(QRectF(x, top, m_digitWidth, m_digitHeight),
+                                   m_digitAtlas,
+                                   QRectF((number % 10) * glyphWidth, 0, glyphWidth,
+                                          glyphHeight));
+                number /= 10;
+            } while (number > 0);
+            if (m_usedLanes) {
+                uint lanes = m_lineLanes.value(blockNumber);
+                if (lanes) {
+                    painter.drawPixmap(0, top, LaneStrip(lanes));
+                }
+            }
         }
 
         block = block.next();
@@ -44,16 +44,45 @@
 #include <QPlainTextEdit>
 #include <QObject>
 #include <QCompleter>
+#include <QHash>
+#include <QPixmap>
+#include <functional>
 #include "PythonAccess/jedi.h"
 
 QT_BEGIN_NAMESPACE
 class QPaintEvent;
 class QResizeEvent;
 class QSize;
+class QStringListModel;
 class QWidget;
 QT_END_NAMESPACE
 
 class LineNumberArea;
+class SymbolIndex;
+class CompletionCache;
+class CompletionIndex;
+
+// Extra selections are kept per layer and merged, so features painting over
+// the text don't replace each other's marks
+enum SelectionLayer {
+    SELECTION_SEARCH,
+    SELECTION_DIAGNOSTICS,
+    SELECTION_LAYER_COUNT
+};
+
+// Marks drawn in the gutter next to the line numbers
+// A lane takes room only while it has marks, each row draws all of its
+// lanes with a single cached pixmap.
+enum GutterLane {
+    LANE_BREAKPOINT,
+    LANE_COVERAGE,
+    LANE_HEAT,
+    LANE_ERROR,
+    LANE_WARNING,
+    GUTTER_LANE_COUNT
+};
+
+#define GUTTER_LANE_WIDTH 4
 
 class CodeEditor : public QPlainTextEdit {
     Q_OBJECT
@@ -63,29 +92,86 @@ class CodeEditor : public QPlainTextEdit {
     void lineNumberAreaPaintEvent(QPaintEvent *event);
     int lineNumberAreaWidth();
     void setCompleter(QCompleter *completer);
-    void setJediCompleter(QCompleter *completer, const QString &getJediCode);
+    void setJediCompleter(QCompleter *completer, Jedi *jedi);
     QCompleter* completer() const;
     QCompleter* jediCompleter() const;
+    void SetLayerSelections(int layer,
+                            const QList<QTextEdit::ExtraSelection> &selections);
+    void IndentLines();
+    void UnindentLines();
+    void ToggleComment();
+    void DedentToColumn(int column);
+    void SetLaneLines(int lane, const QList<int> &lines); // 0 based lines
+    void SetSymbolIndex(SymbolIndex *index);
+    void SetCompletionIndex(CompletionIndex *index);
+    void GotoDefinition();
+    void SetCellsEnabled(bool enabled);
+    void CellAt(int line, int &first, int &last) const;
+    void RunCell(bool next);
+
+  signals:
+    // Lines on screen changed, highlighter formats these first
+    void VisibleBlocksChanged(int first, int last);
+    // Ctrl+Enter or Shift+Enter, code is lines first to last
+    void RunRequested(const QString &code, int first, int last);
 
   protected:
     void resizeEvent(QResizeEvent *event);
     void keyPressEvent(QKeyEvent *e);
     void focusInEvent(QFocusEvent *e);
+    void changeEvent(QEvent *e);
 
   private slots:
     void updateLineNumberAreaWidth(int newBlockCount);
     void updateLineNumberArea(const QRect &, int);
     void insertCompletion(const QString &completion);
+    void JediReplied(int id, const QVariant &result);
+    void JediFailed(int id);
 
   private:
+    // Completion asked from the jedi server, id is -1 when none
+    struct JediRequest {
+        int id;
+        int line;
+        int column; // identifier start
+        QString prefix;
+        int revision;
+    };
+
     QWidget *lineNumberArea;
     QCompleter *m_completer;
     QCompleter *m_jediCompleter;
     Jedi *m_jedi;
-    QString GetLine();
+    QStringListModel *m_jediModel; // reused for every jedi answer
+    CompletionCache *m_jediCache;
+    JediRequest m_jediRequest;
+    int m_gotoRequest;
+    SymbolIndex *m_symbols;
+    CompletionIndex *m_completions;
+    int m_firstVisible;
+    int m_lastVisible;
+    QVector<QList<QTextEdit::ExtraSelection>> m_layers;
+    int m_gutterWidth;
+    QPixmap m_digitAtlas; // glyphs 0-9 side by side
+    int m_digitWidth;
+    int m_digitHeight;
+    qreal m_atlasRatio;
+    QHash<int, uint> m_lineLanes; // line -> bit per GutterLane
+    uint m_usedLanes;
+    QHash<uint, QPixmap> m_laneStrips; // lane bits -> marks of a row
+    bool m_cellsEnabled;
+    void BuildDigitAtlas();
+    QPixmap LaneStrip(uint lanes);
+    int LaneAreaWidth() const;
     QString textUnderCursor() const;
+    bool JediWords(bool ask, QStringList &words);
+    void ShowJediWords(const QStringList &words);
+    void ShowDefinition(int line, int column, const QString &name);
     bool KeepIndent();
-    void SelectLineMarginBlock();
+    void SelectedLines(QTextBlock &first, QTextBlock &last) const;
+    void EditSelectedLines(
+        const std::function<void(QTextCursor &, const QTextBlock &)> &edit);
+    void UpdateVisibleBlocks();
 };
 
 class LineNumberArea : public QWidget {
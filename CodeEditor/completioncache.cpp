@@ -0,0 +1,77 @@
+#include "CodeEditor/completioncache.h"
+#include <QTextBlock>
+
+CompletionCache::CompletionCache(QTextDocument *document)
+    : QObject(document), m_document(document), m_valid(false), m_revision(-1),
+      m_edits(document), m_blockCount(0), m_line(-1),
+      m_column(-1) {
+    connect(document, &QTextDocument::contentsChange, this,
+            &CompletionCache::DocumentChanged);
+}
+
+// False when jedi has to be asked, words is left as it is then
+bool CompletionCache::Lookup(int line, int column, const QString &prefix,
+                             QStringList &words) const {
+    if (!m_valid || line != m_line || column != m_column ||
+            !prefix.startsWith(m_prefix, Qt::CaseInsensitive)) {
+        return false;
+    }
+    if (prefix == m_prefix && m_revision == m_document->revision()) {
+        words = m_ranked;
+        return true;
+    }
+    QStringList narrowed = Narrow(prefix);
+    if (narrowed.isEmpty()) {
+        return false;
+    }
+    words = narrowed;
+    return true;
+}
+
+// Keeps what jedi answered for prefix and returns it ranked
+QStringList CompletionCache::Store(int line, int column, const QString &prefix,
+                                   const QStringList &words) {
+    m_valid = true;
+    m_revision = m_document->revision();
+    m_blockCount = m_document->blockCount();
+    m_line = line;
+    m_column = column;
+    m_prefix = prefix;
+    m_matcher.SetCandidates(words);
+    m_ranked = Narrow(prefix);
+    if (m_ranked.isEmpty()) {
+        // Jedi matched on something else than the word, e.g. after a dot
+        m_ranked = words;
+    }
+    return m_ranked;
+}
+
+void CompletionCache::Clear() {
+    m_valid = false;
+    m_prefix.clear();
+    m_ranked.clear();
+    m_matcher.SetCandidates(QStringList());
+}
+
+// Jedi matches loosely, best fuzzy matches go on top
+QStringList CompletionCache::Narrow(const QString &prefix) const {
+    if (prefix.isEmpty() || !(prefix.at(0).isLetter() || prefix.at(0) == '_')) {
+        return m_matcher.Match(QString(), m_matcher.Size());
+    }
+    return m_matcher.Match(prefix, m_matcher.Size());
+}
+
+void CompletionCache::DocumentChanged(int position, int /* charsRemoved */,
+                                      int charsAdded) {
+    // Checked first so the watch sees every revision, also without words
+    if (!m_edits.Edited() || !m_valid) {
+        return;
+    }
+    QTextBlock first = m_document->findBlock(position);
+    QTextBlock last = m_document->findBlock(position + charsAdded);
+    if (m_document->blockCount() != m_blockCount ||
+            first.blockNumber() != m_line || last.blockNumber() != m_line ||
+            position - first.position() < m_column) {
+        Clear();
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef COMPLETIONCACHE_H
+#define COMPLETIONCACHE_H
+
+#include <QObject>
+#include <QStringList>
+#include <QTextDocument>
+#include "CodeEditor/fuzzymatcher.h"
+#include "CodeEditor/revisionwatch.h"
+
+// Jedi completions of the identifier being typed
+// Keyed by the document revision, the line and where the identifier
+// starts. Typing more of the same identifier narrows the cached words
+// instead of asking jedi again, an edit anywhere else drops them.
+class CompletionCache : public QObject {
+    Q_OBJECT
+  public:
+    explicit CompletionCache(QTextDocument *document);
+    bool Lookup(int line, int column, const QString &prefix,
+                QStringList &words) const;
+    QStringList Store(int line, int column, const QString &prefix,
+                      const QStringList &words);
+    void Clear();
+
+  private slots:
+    void DocumentChanged(int position, int charsRemoved, int charsAdded);
+
+  private:
+    QTextDocument *m_document;
+    bool m_valid;
+    int m_revision; // when jedi was asked
+    RevisionWatch m_edits;
+    int m_blockCount;
+    int m_line;
+    int m_column; // identifier start
+    QString m_prefix;
+    QStringList m_ranked; // answer for m_prefix
+    FuzzyMatcher m_matcher; // all words jedi gave
+    QStringList Narrow(const QString &prefix) const;
+};
+
+#endif // COMPLETIONCACHE_H
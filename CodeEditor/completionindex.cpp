@@ -0,0 +1,196 @@
+#include "CodeEditor/completionindex.h"
+#include <algorithm>
+
+namespace {
+
+struct Candidate {
+    const QString *text;
+    int proximity; // higher is closer to the cursor, 0 when not nearby
+    int uses;
+};
+
+bool RanksBefore(const Candidate &a, const Candidate &b) {
+    if (a.proximity != b.proximity) {
+        return a.proximity > b.proximity;
+    }
+    if (a.uses != b.uses) {
+        return a.uses > b.uses;
+    }
+    return *a.text < *b.text;
+}
+
+ushort Fold(QChar c) {
+    return c.toCaseFolded().unicode();
+}
+
+} // namespace
+
+CompletionIndex::CompletionIndex(QObject *parent)
+    : QObject(parent), m_model(new QStringListModel(this)) {
+    m_nodes.append(CompletionNode());
+}
+
+QStringListModel *CompletionIndex::Model() const {
+    return m_model;
+}
+
+void CompletionIndex::AddBuiltins(const QStringList &words) {
+    foreach (const QString &text, words) {
+        if (text.isEmpty()) {
+            continue;
+        }
+        int id = m_ids.value(text, -1);
+        if (id < 0) {
+            id = Insert(text);
+        }
+        bool offered = IsOffered(m_words.at(id));
+        m_words[id].builtin = true;
+        if (!offered) {
+            Attach(id);
+        }
+    }
+}
+
+// uses holds the change in the number of lines using each name
+void CompletionIndex::AddUses(const QHash<QString, int> &uses) {
+    for (QHash<QString, int>::const_iterator it = uses.constBegin();
+            it != uses.constEnd(); ++it) {
+        int id = m_ids.value(it.key(), -1);
+        if (id < 0) {
+            if (it.value() <= 0 || it.key().isEmpty()) {
+                continue;
+            }
+            id = Insert(it.key());
+        }
+        CompletionWord &word = m_words[id];
+        bool offered = IsOffered(word);
+        word.uses = qMax(0, word.uses + it.value());
+        if (!offered && IsOffered(word)) {
+            Attach(id);
+        } else if (offered && !IsOffered(word)) {
+            Detach(id);
+        }
+    }
+}
+
+bool CompletionIndex::IsOffered(const CompletionWord &word) const {
+    return word.builtin || word.uses > 0;
+}
+
+// Words keep their id when they go out of use, so a name that comes back
+// does not grow the tables again
+int CompletionIndex::Insert(const QString &text) {
+    CompletionWord word = {text, 0, false};
+    m_words.append(word);
+    m_ids.insert(text, m_words.size() - 1);
+    m_fuzzy.Append(text, false);
+    return m_words.size() - 1;
+}
+
+void CompletionIndex::Attach(int id) {
+    const QString &text = m_words.at(id).text;
+    int node = 0;
+    for (int i = 0; i < text.length(); i++) {
+        ushort key = Fold(text.at(i));
+        int next = -1;
+        foreach (const QPair<ushort, int> &child, m_nodes.at(node).children) {
+            if (child.first == key) {
+                next = child.second;
+                break;
+            }
+        }
+        if (next < 0) {
+            next = m_nodes.size();
+            m_nodes.append(CompletionNode());
+            m_nodes[node].children.append(qMakePair(key, next));
+        }
+        node = next;
+    }
+    m_nodes[node].words.append(id);
+    m_fuzzy.SetEnabled(id, true);
+}
+
+void CompletionIndex::Detach(int id) {
+    int node = Find(m_words.at(id).text);
+    if (node >= 0) {
+        m_nodes[node].words.removeOne(id);
+    }
+    m_fuzzy.SetEnabled(id, false);
+}
+
+// Node reached by prefix, -1 when no word starts with it
+int CompletionIndex::Find(const QString &prefix) const {
+    int node = 0;
+    for (int i = 0; i < prefix.length() && node >= 0; i++) {
+        ushort key = Fold(prefix.at(i));
+        int next = -1;
+        foreach (const QPair<ushort, int> &child, m_nodes.at(node).children) {
+            if (child.first == key) {
+                next = child.second;
+                break;
+            }
+        }
+        node = next;
+    }
+    return node;
+}
+
+// nearby maps names to their distance in lines from the cursor
+// WHY:
+// Only the prefix subtree is visited and only the best results are put in
+// order, the completer shows this short list as it is
+QStringList CompletionIndex::Complete(const QString &prefix,
+                                      const QHash<QString, int> &nearby) {
+    QStringList result;
+    int start = Find(prefix);
+    QVector<Candidate> candidates;
+    QVector<int> pending;
+    if (start >= 0) {
+        pending.append(start);
+    }
+    while (!pending.isEmpty()) {
+        const CompletionNode &node = m_nodes.at(pending.takeLast());
+        foreach (int id, node.words) {
+            const CompletionWord &word = m_words.at(id);
+            if (word.text == prefix) {
+                // Already typed
+                continue;
+            }
+            int distance = nearby.value(word.text, -1);
+            Candidate candidate = {&word.text,
+                                   distance < 0 ? 0 : qMax(1, COMPLETION_NEARBY_LINES + 1 - distance),
+                                   word.uses
+                                  };
+            candidates.append(candidate);
+        }
+        foreach (const QPair<ushort, int> &child, node.children) {
+            pending.append(child.second);
+        }
+    }
+    int count = qMin(candidates.size(), COMPLETION_MAX_RESULTS);
+    std::partial_sort(candidates.begin(), candidates.begin() + count,
+                      candidates.end(), RanksBefore);
+    for (int i = 0; i < count; i++) {
+        result.append(*candidates.at(i).text);
+    }
+    if (result.size() == COMPLETION_MAX_RESULTS) {
+        return result;
+    }
+
+    // Every prefix match is in already, add words matching out of order
+    // like lsdr for listdir
+    foreach (const QString &text, m_fuzzy.Match(prefix, COMPLETION_MAX_RESULTS)) {
+        if (result.size() == COMPLETION_MAX_RESULTS) {
+            break;
+        }
+        if (!text.startsWith(prefix, Qt::CaseInsensitive)) {
+            result.append(text);
+        }
+    }
+    return result;
+}
+
+void CompletionIndex::Fill(const QString &prefix,
+                           const QHash<QString, int> &nearby) {
+    m_model->setStringList(Complete(prefix, nearby));
+}
@@ -0,0 +1,61 @@
+#ifndef COMPLETIONINDEX_H
+#define COMPLETIONINDEX_H
+
+#include <QHash>
+#include <QObject>
+#include <QStringList>
+#include <QStringListModel>
+#include <QVector>
+#include "CodeEditor/fuzzymatcher.h"
+
+// Most candidates handed to the completer popup
+#define COMPLETION_MAX_RESULTS 50
+// Names used this many lines around the cursor rank as nearby
+#define COMPLETION_NEARBY_LINES 50
+
+// A known word, ids never change so trie nodes can refer to them
+struct CompletionWord {
+    QString text;
+    int uses; // lines using it, summed over all editors
+    bool builtin; // from autocomplete.txt, kept even when unused
+};
+
+// Trie node, keyed by case folded characters
+struct CompletionNode {
+    QVector<QPair<ushort, int>> children; // character -> node
+    QVector<int> words; // ids of the words ending here, any case
+};
+
+// Words the static completer offers
+// Built in words and names used in the editors share one prefix trie, the
+// editors' symbol indexes send how many lines use each name as it changes.
+// A lookup walks only the subtree of the typed prefix and ranks names used
+// close to the cursor first, then the most used ones. When that leaves
+// room, fuzzy matches of all words fill the rest.
+class CompletionIndex : public QObject {
+    Q_OBJECT
+  public:
+    explicit CompletionIndex(QObject *parent = 0);
+    void AddBuiltins(const QStringList &words);
+    QStringList Complete(const QString &prefix,
+                         const QHash<QString, int> &nearby);
+    void Fill(const QString &prefix, const QHash<QString, int> &nearby);
+    QStringListModel *Model() const;
+
+  public slots:
+    void AddUses(const QHash<QString, int> &uses);
+
+  private:
+    QVector<CompletionNode> m_nodes; // 0 is the root
+    QVector<CompletionWord> m_words;
+    QHash<QString, int> m_ids;
+    QStringListModel *m_model;
+    FuzzyMatcher m_fuzzy; // candidate i is word i, on while it is offered
+    int Find(const QString &prefix) const;
+    int Insert(const QString &text);
+    void Attach(int id);
+    void Detach(int id);
+    bool IsOffered(const CompletionWord &word) const;
+};
+
+#endif // COMPLETIONINDEX_H
@@ -0,0 +1,151 @@
+#include "CodeEditor/diagnostics.h"
+#include <QHelpEvent>
+#include <QTextBlock>
+#include <QToolTip>
+
+Diagnostics::Diagnostics(CodeEditor *editor, Jedi *server)
+    : QObject(editor), m_editor(editor), m_server(server), m_request(-1),
+      m_requestRevision(-1), m_edits(editor->document()) {
+    m_delayTimer.setSingleShot(true);
+    m_delayTimer.setInterval(DIAGNOSTICS_DELAY_MS);
+    connect(&m_delayTimer, &QTimer::timeout, this, &Diagnostics::StartCheck);
+    connect(editor->document(), &QTextDocument::contentsChange, this,
+            &Diagnostics::DocumentChanged);
+    connect(server, &Jedi::Replied, this, &Diagnostics::Replied);
+    connect(server, &Jedi::Failed, this, &Diagnostics::Failed);
+    editor->viewport()->installEventFilter(this);
+    m_delayTimer.start();
+}
+
+DiagnosticList Diagnostics::Current() const {
+    return m_diagnostics;
+}
+
+void Diagnostics::DocumentChanged(int /* position */, int /* charsRemoved */,
+                                  int /* charsAdded */) {
+    if (!m_edits.Edited()) {
+        return;
+    }
+    m_server->Cancel(m_request);
+    m_request = -1;
+    m_delayTimer.start();
+}
+
+void Diagnostics::StartCheck() {
+    if (!m_server->IsReady()) {
+        // Still starting, or being started again
+        m_delayTimer.start();
+        return;
+    }
+    m_server->Cancel(m_request);
+    m_requestRevision = m_editor->document()->revision();
+    m_request = m_server->Check(m_editor->toPlainText());
+}
+
+void Diagnostics::Replied(int id, const QVariant &result) {
+    if (id != m_request) {
+        return;
+    }
+    m_request = -1;
+    if (m_editor->document()->revision() != m_requestRevision) {
+        // A newer check is on its way
+        return;
+    }
+    m_diagnostics.clear();
+    foreach (const QVariant &item, result.toList()) {
+        QVariantMap map = item.toMap();
+        Diagnostic diagnostic;
+        diagnostic.line = map.value("line").toInt();
+        diagnostic.column = map.value("column").toInt();
+        diagnostic.end = map.value("end", -1).toInt();
+        diagnostic.severity = map.value("severity").toString() == "error" ?
+                              DIAGNOSTIC_ERROR : DIAGNOSTIC_WARNING;
+        diagnostic.message = map.value("message").toString();
+        m_diagnostics.append(diagnostic);
+    }
+    Show();
+}
+
+void Diagnostics::Failed(int id) {
+    if (id == m_request) {
+        m_request = -1;
+        if (!m_delayTimer.isActive()) {
+            // Server went away, try again once it is back
+            m_delayTimer.start();
+        }
+    }
+}
+
+void Diagnostics::Show() {
+    QTextCharFormat errorFormat;
+    errorFormat.setUnderlineStyle(QTextCharFormat::WaveUnderline);
+    errorFormat.setUnderlineColor(QColor(230, 40, 40));
+    QTextCharFormat warningFormat;
+    warningFormat.setUnderlineStyle(QTextCharFormat::WaveUnderline);
+    warningFormat.setUnderlineColor(QColor(230, 190, 0));
+
+    QList<int> errorLines;
+    QList<int> warningLines;
+    QList<QTextEdit::ExtraSelection> selections;
+    QTextDocument *document = m_editor->document();
+    foreach (const Diagnostic &diagnostic, m_diagnostics) {
+        QTextBlock block = document->findBlockByNumber(diagnostic.line);
+        if (!block.isValid()) {
+            continue;
+        }
+        bool error = diagnostic.severity == DIAGNOSTIC_ERROR;
+        (error ? errorLines : warningLines).append(diagnostic.line);
+
+        // Cursors move with later edits, the underline stays on its text
+        int length = block.length() - 1;
+        int column = qBound(0, diagnostic.column, qMax(length - 1, 0));
+        QTextCursor cursor(block);
+        cursor.setPosition(block.position() + column);
+        if (diagnostic.end > column) {
+            cursor.setPosition(block.position() + qMin(diagnostic.end, length),
+                               QTextCursor::KeepAnchor);
+        } else {
+            cursor.movePosition(QTextCursor::EndOfWord, QTextCursor::KeepAnchor);
+        }
+        if (!cursor.hasSelection()) {
+            // Nothing to underline at the end of a line, take the last character
+            cursor.movePosition(column < length ? QTextCursor::NextCharacter :
+                                QTextCursor::PreviousCharacter,
+                                QTextCursor::KeepAnchor);
+        }
+        QTextEdit::ExtraSelection selection;
+        selection.cursor = cursor;
+        selection.format = error ? errorFormat : warningFormat;
+        selections.append(selection);
+    }
+    m_editor->SetLaneLines(LANE_ERROR, errorLines);
+    m_editor->SetLaneLines(LANE_WARNING, warningLines);
+    m_editor->SetLayerSelections(SELECTION_DIAGNOSTICS, selections);
+}
+
+// Messages of the line under the mouse, the ones at the mouse column first
+bool Diagnostics::eventFilter(QObject *watched, QEvent *event) {
+    if (event->type() != QEvent::ToolTip || m_diagnostics.isEmpty()) {
+        return QObject::eventFilter(watched, event);
+    }
+    QHelpEvent *help = static_cast<QHelpEvent *>(event);
+    QTextCursor cursor = m_editor->cursorForPosition(help->pos());
+    int line = cursor.blockNumber();
+    int column = cursor.positionInBlock();
+    QStringList here;
+    QStringList onLine;
+    foreach (const Diagnostic &diagnostic, m_diagnostics) {
+        if (diagnostic.line != line) {
+            continue;
+        }
+        bool atColumn = column >= diagnostic.column &&
+                        (diagnostic.end < 0 || column <= diagnostic.end);
+        (atColumn ? here : onLine).append(diagnostic.message);
+    }
+    if (here.isEmpty() && onLine.isEmpty()) {
+        return QObject::eventFilter(watched, event);
+    }
+    QToolTip::showText(help->globalPos(), (here + onLine).join("\n"),
+                       m_editor->viewport());
+    return true;
+}
@@ -0,0 +1,58 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <QTimer>
+#include <QVector>
+#include "CodeEditor/codeeditor.h"
+#include "CodeEditor/revisionwatch.h"
+
+// The document is checked after edits stop for this long
+#define DIAGNOSTICS_DELAY_MS 500
+
+enum DiagnosticSeverity {
+    DIAGNOSTIC_ERROR,
+    DIAGNOSTIC_WARNING
+};
+
+struct Diagnostic {
+    int line; // 0 based
+    int column;
+    int end; // column after the problem, -1 to mark the word at column
+    int severity; // DiagnosticSeverity
+    QString message;
+};
+typedef QVector<Diagnostic> DiagnosticList;
+
+// Syntax errors and pyflakes warnings of a CodeEditor
+// The jedi server compiles the document in the background, keeping the
+// result of each top level block so only edited blocks are compiled again.
+// Problems are marked in the gutter and underlined, hovering an underline
+// shows the message. A check still running when the document changes is
+// cancelled.
+class Diagnostics : public QObject {
+    Q_OBJECT
+  public:
+    Diagnostics(CodeEditor *editor, Jedi *server);
+    DiagnosticList Current() const;
+
+  protected:
+    bool eventFilter(QObject *watched, QEvent *event);
+
+  private slots:
+    void DocumentChanged(int position, int charsRemoved, int charsAdded);
+    void StartCheck();
+    void Replied(int id, const QVariant &result);
+    void Failed(int id);
+
+  private:
+    CodeEditor *m_editor;
+    Jedi *m_server;
+    QTimer m_delayTimer;
+    int m_request; // -1 when no check runs
+    int m_requestRevision;
+    RevisionWatch m_edits;
+    DiagnosticList m_diagnostics;
+    void Show();
+};
+
+#endif // DIAGNOSTICS_H
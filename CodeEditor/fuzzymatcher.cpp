@@ -0,0 +1,376 @@
+#include "CodeEditor/fuzzymatcher.h"
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define FUZZY_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// WHY:
+// Only the filter functions are built for SSE2 / AVX2, the rest of the
+// program keeps the default target so it still runs on older CPUs
+#if defined(FUZZY_X86) && defined(__GNUC__)
+#define FUZZY_TARGET(isa) __attribute__((target(isa)))
+#else
+#define FUZZY_TARGET(isa)
+#endif
+
+namespace {
+
+typedef int (*FilterFunction)(const quint32 *bags, int count, quint32 need,
+                              int *out);
+
+ushort Fold(QChar c) {
+    return c.toCaseFolded().unicode();
+}
+
+// Bit of a folded character in a candidate mask, digits and other
+// characters share bits, so a mask can only rule candidates out
+quint32 BagBit(ushort c) {
+    if (c >= 'a' && c <= 'z') {
+        return 1u << (c - 'a');
+    }
+    if (c >= '0' && c <= '9') {
+        return 1u << 26;
+    }
+    if (c == '_') {
+        return 1u << 27;
+    }
+    return 1u << (28 + (c & 3));
+}
+
+int FilterScalar(const quint32 *bags, int count, quint32 need, int *out) {
+    int found = 0;
+    for (int i = 0; i < count; i++) {
+        if ((bags[i] & need) == need) {
+            out[found++] = i;
+        }
+    }
+    return found;
+}
+
+#ifdef FUZZY_X86
+FUZZY_TARGET("sse2")
+int FilterSse2(const quint32 *bags, int count, quint32 need, int *out) {
+    __m128i want = _mm_set1_epi32((int)need);
+    int found = 0;
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i bag = _mm_loadu_si128((const __m128i *)(bags + i));
+        __m128i hit = _mm_cmpeq_epi32(_mm_and_si128(bag, want), want);
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(hit));
+        for (int bit = 0; mask; bit++, mask >>= 1) {
+            if (mask & 1) {
+                out[found++] = i + bit;
+            }
+        }
+    }
+    for (; i < count; i++) {
+        if ((bags[i] & need) == need) {
+            out[found++] = i;
+        }
+    }
+    return found;
+}
+
+FUZZY_TARGET("avx2")
+int FilterAvx2(const quint32 *bags, int count, quint32 need, int *out) {
+    __m256i want = _mm256_set1_epi32((int)need);
+    int found = 0;
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i bag = _mm256_loadu_si256((const __m256i *)(bags + i));
+        __m256i hit = _mm256_cmpeq_epi32(_mm256_and_si256(bag, want), want);
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(hit));
+        for (int bit = 0; mask; bit++, mask >>= 1) {
+            if (mask & 1) {
+                out[found++] = i + bit;
+            }
+        }
+    }
+    for (; i < count; i++) {
+        if ((bags[i] & need) == need) {
+            out[found++] = i;
+        }
+    }
+    return found;
+}
+#endif
+
+int DetectIsa() {
+#if defined(FUZZY_X86) && defined(__GNUC__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return FUZZY_AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return FUZZY_SSE2;
+    }
+#elif defined(FUZZY_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int highest = info[0];
+    __cpuid(info, 1);
+    bool sse2 = (info[3] & (1 << 26)) != 0;
+    bool osAvx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) &&
+                 (_xgetbv(0) & 6) == 6;
+    if (highest >= 7 && osAvx) {
+        __cpuidex(info, 7, 0);
+        if (info[1] & (1 << 5)) {
+            return FUZZY_AVX2;
+        }
+    }
+    if (sse2) {
+        return FUZZY_SSE2;
+    }
+#endif
+    return FUZZY_SCALAR;
+}
+
+FilterFunction FilterFor(int isa) {
+#ifdef FUZZY_X86
+    if (isa == FUZZY_AVX2) {
+        return FilterAvx2;
+    }
+    if (isa == FUZZY_SSE2) {
+        return FilterSse2;
+    }
+#else
+    Q_UNUSED(isa);
+#endif
+    return FilterScalar;
+}
+
+// Extra score for matching the character at position of text
+int BonusAt(const QString &text, int position) {
+    if (position == 0) {
+        return FUZZY_BONUS_BOUNDARY;
+    }
+    QChar previous = text.at(position - 1);
+    QChar current = text.at(position);
+    if (!previous.isLetterOrNumber() && current.isLetterOrNumber()) {
+        return FUZZY_BONUS_BOUNDARY;
+    }
+    if ((previous.isLower() && current.isUpper()) ||
+            (!previous.isDigit() && current.isDigit())) {
+        return FUZZY_BONUS_CAMEL;
+    }
+    return 0;
+}
+
+struct Ranked {
+    int index;
+    int score;
+    int length;
+};
+
+bool RanksBefore(const Ranked &a, const Ranked &b) {
+    if (a.score != b.score) {
+        return a.score > b.score;
+    }
+    if (a.length != b.length) {
+        return a.length < b.length;
+    }
+    return a.index < b.index;
+}
+
+} // namespace
+
+FuzzyMatcher::FuzzyMatcher() : m_isa(BestIsa()) {
+    m_starts.append(0);
+}
+
+int FuzzyMatcher::BestIsa() {
+    static const int isa = DetectIsa();
+    return isa;
+}
+
+const char *FuzzyMatcher::IsaName(int isa) {
+    switch (isa) {
+    case FUZZY_AVX2:
+        return "avx2";
+    case FUZZY_SSE2:
+        return "sse2";
+    default:
+        return "scalar";
+    }
+}
+
+int FuzzyMatcher::Isa() const {
+    return m_isa;
+}
+
+void FuzzyMatcher::SetIsa(int isa) {
+    m_isa = qBound((int)FUZZY_SCALAR, isa, BestIsa());
+}
+
+void FuzzyMatcher::SetCandidates(const QStringList &candidates) {
+    m_candidates.clear();
+    m_folded.clear();
+    m_bonuses.clear();
+    m_starts.clear();
+    m_bags.clear();
+    m_enabled.clear();
+    m_candidates.reserve(candidates.size());
+    m_starts.reserve(candidates.size() + 1);
+    m_bags.reserve(candidates.size());
+    m_enabled.reserve(candidates.size());
+    m_starts.append(0);
+    foreach (const QString &text, candidates) {
+        Append(text);
+    }
+}
+
+void FuzzyMatcher::Append(const QString &candidate, bool enabled) {
+    quint32 bag = 0;
+    for (int i = 0; i < candidate.length(); i++) {
+        ushort c = Fold(candidate.at(i));
+        m_folded.append(c);
+        m_bonuses.append(BonusAt(candidate, i));
+        bag |= BagBit(c);
+    }
+    m_candidates.append(candidate);
+    m_starts.append(m_folded.size());
+    m_bags.append(enabled ? bag : 0);
+    m_enabled.append(enabled);
+}
+
+// WHY:
+// A switched off candidate keeps its packed text and gets an empty mask, a
+// pattern always needs at least one bit so the filter drops it
+void FuzzyMatcher::SetEnabled(int candidate, bool enabled) {
+    if (m_enabled.at(candidate) == enabled) {
+        return;
+    }
+    m_enabled[candidate] = enabled;
+    m_bags[candidate] = enabled ? BagOf(candidate) : 0;
+}
+
+quint32 FuzzyMatcher::BagOf(int candidate) const {
+    quint32 bag = 0;
+    for (int i = m_starts.at(candidate); i < m_starts.at(candidate + 1); i++) {
+        bag |= BagBit(m_folded.at(i));
+    }
+    return bag;
+}
+
+int FuzzyMatcher::Size() const {
+    return m_candidates.size();
+}
+
+QVector<int> FuzzyMatcher::Rank(const QString &pattern, int limit) const {
+    QVector<int> result;
+    if (pattern.isEmpty()) {
+        for (int i = 0; i < Size() && result.size() < limit; i++) {
+            if (m_enabled.at(i)) {
+                result.append(i);
+            }
+        }
+        return result;
+    }
+    QVector<ushort> folded;
+    quint32 need = 0;
+    for (int i = 0; i < pattern.length(); i++) {
+        folded.append(Fold(pattern.at(i)));
+        need |= BagBit(folded.last());
+    }
+
+    QVector<int> survivors(Size());
+    int count = FilterFor(m_isa)(m_bags.constData(), Size(), need,
+                                 survivors.data());
+    QVector<Ranked> ranked;
+    ranked.reserve(count);
+    for (int i = 0; i < count; i++) {
+        int index = survivors.at(i);
+        int score = ScoreFolded(folded, index);
+        if (score >= 0) {
+            Ranked match = {index, score, m_starts.at(index + 1) - m_starts.at(index)};
+            ranked.append(match);
+        }
+    }
+    int best = qMin(limit, ranked.size());
+    std::partial_sort(ranked.begin(), ranked.begin() + best, ranked.end(),
+                      RanksBefore);
+    for (int i = 0; i < best; i++) {
+        result.append(ranked.at(i).index);
+    }
+    return result;
+}
+
+QStringList FuzzyMatcher::Match(const QString &pattern, int limit) const {
+    QStringList result;
+    foreach (int index, Rank(pattern, limit)) {
+        result.append(m_candidates.at(index));
+    }
+    return result;
+}
+
+int FuzzyMatcher::Score(const QString &pattern, int candidate) const {
+    QVector<ushort> folded;
+    for (int i = 0; i < pattern.length(); i++) {
+        folded.append(Fold(pattern.at(i)));
+    }
+    return ScoreFolded(folded, candidate);
+}
+
+// Like fzf v1: the first match found going forward is narrowed going
+// backward to the shortest window, only that window is scored
+int FuzzyMatcher::ScoreFolded(const QVector<ushort> &pattern,
+                              int candidate) const {
+    const ushort *text = m_folded.constData() + m_starts.at(candidate);
+    const quint8 *bonuses = m_bonuses.constData() + m_starts.at(candidate);
+    int length = m_starts.at(candidate + 1) - m_starts.at(candidate);
+    int size = pattern.size();
+    if (size == 0) {
+        return 0;
+    }
+    int matched = 0;
+    int end = -1;
+    for (int i = 0; i < length; i++) {
+        if (text[i] == pattern.at(matched) && ++matched == size) {
+            end = i;
+            break;
+        }
+    }
+    if (end < 0) {
+        return -1;
+    }
+    int start = end;
+    matched = size - 1;
+    for (int i = end; i >= 0; i--) {
+        if (text[i] == pattern.at(matched) && --matched < 0) {
+            start = i;
+            break;
+        }
+    }
+
+    int score = 0;
+    int chunkBonus = 0; // bonus of the first character of a consecutive run
+    bool previousMatched = false;
+    bool inGap = false;
+    matched = 0;
+    for (int i = start; i <= end; i++) {
+        if (matched < size && text[i] == pattern.at(matched)) {
+            int bonus = bonuses[i];
+            if (previousMatched) {
+                bonus = qMax(bonus, qMax(chunkBonus, FUZZY_BONUS_CONSECUTIVE));
+            } else {
+                chunkBonus = bonus;
+            }
+            score += FUZZY_SCORE_MATCH +
+                     (matched == 0 ? bonus * FUZZY_BONUS_FIRST_MULTIPLIER : bonus);
+            matched++;
+            previousMatched = true;
+            inGap = false;
+        } else {
+            score += inGap ? FUZZY_SCORE_GAP_EXTENSION : FUZZY_SCORE_GAP_START;
+            previousMatched = false;
+            inGap = true;
+        }
+    }
+    // Scores are compared, never negative so -1 stays "no match"
+    return qMax(score, 0);
+}
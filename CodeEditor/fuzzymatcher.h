@@ -0,0 +1,61 @@
+#ifndef FUZZYMATCHER_H
+#define FUZZYMATCHER_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// Scoring, close to fzf: every matched character scores, word starts and
+// camel humps score extra, gaps cost
+#define FUZZY_SCORE_MATCH 16
+#define FUZZY_SCORE_GAP_START -3
+#define FUZZY_SCORE_GAP_EXTENSION -1
+#define FUZZY_BONUS_BOUNDARY 8
+#define FUZZY_BONUS_CAMEL 7
+#define FUZZY_BONUS_CONSECUTIVE 4
+#define FUZZY_BONUS_FIRST_MULTIPLIER 2
+
+// Instruction sets the candidate filter can use
+enum FuzzyIsa {
+    FUZZY_SCALAR,
+    FUZZY_SSE2,
+    FUZZY_AVX2
+};
+
+// Ranks candidates containing the pattern's characters in order
+// Candidates are packed once: case folded text and the bonus of each
+// character in flat buffers, plus a 32 bit mask of the characters each one
+// contains. A search first drops every candidate missing a pattern
+// character, comparing 4 (SSE2) or 8 (AVX2) masks at a time, and only
+// scores the rest. The instruction set is picked at run time, other CPUs
+// use the scalar loop. Candidates can be appended and switched off one by
+// one, a list that changes while typing is never packed again.
+class FuzzyMatcher {
+  public:
+    FuzzyMatcher();
+    void SetCandidates(const QStringList &candidates);
+    void Append(const QString &candidate, bool enabled = true);
+    void SetEnabled(int candidate, bool enabled);
+    int Size() const;
+    // Indexes of matching candidates, best first
+    QVector<int> Rank(const QString &pattern, int limit) const;
+    QStringList Match(const QString &pattern, int limit) const;
+    int Score(const QString &pattern, int candidate) const; // -1 no match
+    int Isa() const;
+    void SetIsa(int isa); // lowered to what the CPU supports
+    static int BestIsa();
+    static const char *IsaName(int isa);
+
+  private:
+    QStringList m_candidates;
+    QVector<ushort> m_folded; // all candidates back to back
+    QVector<quint8> m_bonuses; // bonus for matching each folded character
+    QVector<int> m_starts; // candidate i is m_starts[i] .. m_starts[i + 1]
+    QVector<quint32> m_bags; // characters present in each candidate
+    QVector<bool> m_enabled;
+    int m_isa;
+    int ScoreFolded(const QVector<ushort> &pattern, int candidate) const;
+    quint32 BagOf(int candidate) const;
+};
+
+#endif // FUZZYMATCHER_H
@@ -0,0 +1,471 @@
+#include "CodeEditor/largefileview.h"
+#include <QtWidgets>
+#include <QtConcurrent>
+#include <QSaveFile>
+#include <algorithm>
+#include <cstring>
+
+LargeFileView::LargeFileView(QWidget *parent)
+    : QAbstractScrollArea(parent), m_data(nullptr), m_size(0), m_scanned(0),
+      m_currentLine(0), m_matchOffset(-1), m_matchLength(0), m_generation(0),
+      m_textWidth(0), m_cancel(0) {
+    qRegisterMetaType<QVector<qint64>>("QVector<qint64>");
+    connect(&m_finder, &QFutureWatcher<qint64>::finished, this,
+            &LargeFileView::FindDone);
+
+    setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    QPalette p = this->palette();
+    p.setColor(QPalette::Base, Qt::black);
+    p.setColor(QPalette::Text, Qt::white);
+    this->setPalette(p);
+    setFocusPolicy(Qt::StrongFocus);
+}
+
+LargeFileView::~LargeFileView() {
+    Close();
+}
+
+void LargeFileView::Open(const QString &fileName, bool &success) {
+    success = false;
+    Close();
+
+    m_file.setFileName(fileName);
+    if (!m_file.open(QFile::ReadOnly)) {
+        return;
+    }
+    m_size = m_file.size();
+    if (m_size > 0) {
+        // WHY:
+        // Pages are loaded by the OS as they are drawn or indexed,
+        // opening costs the same for 1 MB and 1 GB
+        m_data = reinterpret_cast<const char *>(m_file.map(0, m_size));
+        if (!m_data) {
+            m_file.close();
+            m_size = 0;
+            return;
+        }
+    }
+
+    m_lineStarts.clear();
+    if (m_size > 0) {
+        m_lineStarts.append(0);
+    }
+    m_scanned = 0;
+    m_generation++;
+    m_cancel.store(0);
+    if (m_size > 0) {
+        m_indexer = QtConcurrent::run(this, &LargeFileView::BuildIndex,
+                                      m_generation);
+    }
+    UpdateScrollBars();
+    viewport()->update();
+    success = true;
+    if (m_size == 0) {
+        emit IndexFinished(0);
+    }
+}
+
+void LargeFileView::Close() {
+    m_cancel.store(1);
+    m_indexer.waitForFinished();
+    m_finder.waitForFinished();
+    m_finder.setFuture(QFuture<qint64>()); // drop a result not delivered yet
+    if (m_data) {
+        m_file.unmap(reinterpret_cast<uchar *>(const_cast<char *>(m_data)));
+    }
+    m_file.close();
+    m_data = nullptr;
+    m_size = 0;
+    m_scanned = 0;
+    m_lineStarts.clear();
+    m_edits.clear();
+    m_currentLine = 0;
+    m_matchOffset = -1;
+    m_textWidth = 0;
+    m_generation++;
+    UpdateScrollBars();
+    viewport()->update();
+}
+
+// Edited lines replace their original text, everything else is copied
+// straight from the mapping
+void LargeFileView::Save(bool &success) {
+    success = false;
+    if (IsIndexing()) {
+        return;
+    }
+    QString fileName = FileName();
+    QSaveFile out(fileName);
+    if (!out.open(QFile::WriteOnly)) {
+        return;
+    }
+    qint64 pos = 0;
+    for (QMap<qint64, QString>::const_iterator edit = m_edits.constBegin();
+            edit != m_edits.constEnd(); ++edit) {
+        qint64 start = m_lineStarts.at(edit.key());
+        qint64 end = LineEnd(edit.key());
+        while (end > start && (m_data[end - 1] == '\n' || m_data[end - 1] == '\r')) {
+            end--;
+        }
+        out.write(m_data + pos, start - pos);
+        out.write(edit.value().toUtf8());
+        pos = end;
+    }
+    out.write(m_data + pos, m_size - pos);
+
+    // Mapping must go before the new file replaces the old one
+    QMap<qint64, QString> edits = m_edits;
+    Close();
+    success = out.commit();
+    bool reopened;
+    Open(fileName, reopened);
+    if (!success && reopened) {
+        // The old file is still there, so are its line numbers
+        m_edits = edits;
+        viewport()->update();
+    }
+    success = success && reopened;
+}
+
+QString LargeFileView::FileName() const {
+    return m_file.fileName();
+}
+
+qint64 LargeFileView::FileSize() const {
+    return m_size;
+}
+
+// Last line is not counted until indexing reaches its end
+qint64 LargeFileView::LineCount() const {
+    if (IsIndexing()) {
+        return qMax(0, m_lineStarts.size() - 1);
+    }
+    return m_lineStarts.size();
+}
+
+qint64 LargeFileView::CurrentLine() const {
+    return m_currentLine;
+}
+
+bool LargeFileView::IsIndexing() const {
+    return m_data && m_scanned < m_size;
+}
+
+bool LargeFileView::IsModified() const {
+    return !m_edits.isEmpty();
+}
+
+// Runs on a pool thread, mapping stays valid until Close() waits for it
+void LargeFileView::BuildIndex(int generation) {
+    qint64 pos = 0;
+    while (pos < m_size && !m_cancel.load()) {
+        qint64 end = qMin(m_size, pos + LARGE_FILE_INDEX_CHUNK);
+        QVector<qint64> starts;
+        const char *scan = m_data + pos;
+        const char *stop = m_data + end;
+        while (scan < stop) {
+            const char *newline = static_cast<const char *>(
+                                      memchr(scan, '\n', stop - scan));
+            if (!newline) {
+                break;
+            }
+            scan = newline + 1;
+            if (scan < m_data + m_size) {
+                starts.append(scan - m_data);
+            }
+        }
+        pos = end;
+        QMetaObject::invokeMethod(this, "AppendIndex", Qt::QueuedConnection,
+                                  Q_ARG(int, generation),
+                                  Q_ARG(QVector<qint64>, starts),
+                                  Q_ARG(qint64, pos));
+    }
+}
+
+void LargeFileView::AppendIndex(int generation,
+                                const QVector<qint64> &lineStarts,
+                                qint64 scanned) {
+    if (generation != m_generation) {
+        return;
+    }
+    m_lineStarts += lineStarts;
+    m_scanned = scanned;
+    UpdateScrollBars();
+    viewport()->update();
+    emit IndexProgress(static_cast<int>(m_scanned * 100 / qMax(m_size, 1LL)));
+    if (!IsIndexing()) {
+        emit IndexFinished(LineCount());
+    }
+}
+
+void LargeFileView::GotoLine(qint64 line) {
+    if (LineCount() == 0) {
+        return;
+    }
+    m_currentLine = qBound(0LL, line, LineCount() - 1);
+    m_matchOffset = -1;
+    qint64 first = verticalScrollBar()->value();
+    if (m_currentLine < first || m_currentLine >= first + VisibleLines()) {
+        verticalScrollBar()->setValue(
+            static_cast<int>(qMax(0LL, m_currentLine - VisibleLines() / 2)));
+    }
+    viewport()->update();
+}
+
+// Searches UTF-8 bytes of the indexed part on a pool thread, case sensitive
+void LargeFileView::Find(const QString &text, bool forward) {
+    if (text.isEmpty() || !m_data || m_finder.isRunning()) {
+        return;
+    }
+    QByteArray needle = text.toUtf8();
+    qint64 from;
+    if (m_matchOffset >= 0) {
+        from = forward ? m_matchOffset + 1 : m_matchOffset - 1;
+    } else if (LineCount() > 0) {
+        from = forward ? m_lineStarts.at(m_currentLine) :
+               LineEnd(m_currentLine) - 1;
+    } else {
+        from = 0;
+    }
+    m_matchLength = needle.size();
+    m_finder.setFuture(QtConcurrent::run(&LargeFileView::Search, m_data,
+                                         m_scanned, needle, from, forward));
+}
+
+void LargeFileView::FindDone() {
+    if (m_finder.future().resultCount() == 0) {
+        return;
+    }
+    qint64 offset = m_finder.result();
+    if (offset < 0 || offset >= m_scanned) {
+        emit FindFinished(-1);
+        return;
+    }
+    qint64 line = LineOfOffset(offset);
+    GotoLine(line);
+    m_matchOffset = offset;
+    emit FindFinished(line);
+}
+
+qint64 LargeFileView::Search(const char *data, qint64 size,
+                             const QByteArray &needle, qint64 from, bool forward) {
+    qint64 length = needle.size();
+    if (length == 0 || length > size || from < 0) {
+        return -1;
+    }
+    const char *first = needle.constData();
+    if (forward) {
+        const char *scan = data + from;
+        const char *stop = data + size - length + 1;
+        while (scan < stop) {
+            scan = static_cast<const char *>(memchr(scan, *first, stop - scan));
+            if (!scan) {
+                return -1;
+            }
+            if (memcmp(scan, first, length) == 0) {
+                return scan - data;
+            }
+            scan++;
+        }
+        return -1;
+    }
+    for (qint64 i = qMin(from, size - length); i >= 0; i--) {
+        if (data[i] == *first && memcmp(data + i, first, length) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void LargeFileView::EditLine(qint64 line) {
+    if (line < 0 || line >= LineCount()) {
+        return;
+    }
+    // WHY:
+    // Long lines are shown cut, saving the cut text would drop the rest.
+    // A character is at least a byte, so this many bytes always fit.
+    qint64 start = m_lineStarts.at(line);
+    qint64 end = LineEnd(line);
+    while (end > start && (m_data[end - 1] == '\n' || m_data[end - 1] == '\r')) {
+        end--;
+    }
+    if (end - start > LARGE_FILE_MAX_LINE_CHARS) {
+        QMessageBox::information(this, tr("Edit line %1").arg(line + 1),
+                                 tr("Lines longer than %1 characters can not be edited here.")
+                                 .arg(LARGE_FILE_MAX_LINE_CHARS));
+        return;
+    }
+    bool ok = false;
+    QString text = QInputDialog::getText(this, tr("Edit line %1").arg(line + 1),
+                                         tr("Line:"), QLineEdit::Normal,
+                                         LineText(line), &ok);
+    if (!ok) {
+        return;
+    }
+    if (text == OriginalLine(line)) {
+        m_edits.remove(line);
+    } else {
+        m_edits.insert(line, text);
+    }
+    viewport()->update();
+}
+
+QString LargeFileView::LineText(qint64 line) const {
+    return m_edits.contains(line) ? m_edits.value(line) : OriginalLine(line);
+}
+
+QString LargeFileView::OriginalLine(qint64 line) const {
+    if (line < 0 || line >= LineCount()) {
+        return QString();
+    }
+    qint64 start = m_lineStarts.at(line);
+    qint64 end = LineEnd(line);
+    while (end > start && (m_data[end - 1] == '\n' || m_data[end - 1] == '\r')) {
+        end--;
+    }
+    // UTF-8 is at most 4 bytes per character, longer lines are cut
+    int bytes = static_cast<int>(qMin(end - start,
+                                      qint64(LARGE_FILE_MAX_LINE_CHARS) * 4));
+    return QString::fromUtf8(m_data + start, bytes).left(LARGE_FILE_MAX_LINE_CHARS);
+}
+
+qint64 LargeFileView::LineOfOffset(qint64 offset) const {
+    QVector<qint64>::const_iterator found =
+        std::upper_bound(m_lineStarts.constBegin(), m_lineStarts.constEnd(),
+                         offset);
+    return qMax(0LL, static_cast<qint64>(found - m_lineStarts.constBegin()) - 1);
+}
+
+// Offset just after the line, including its line ending
+qint64 LargeFileView::LineEnd(qint64 line) const {
+    if (line + 1 < m_lineStarts.size()) {
+        return m_lineStarts.at(line + 1);
+    }
+    return IsIndexing() ? m_scanned : m_size;
+}
+
+int LargeFileView::LineHeight() const {
+    return fontMetrics().height();
+}
+
+int LargeFileView::GutterWidth() const {
+    int digits = QString::number(qMax(1LL, LineCount())).length();
+    return 6 + fontMetrics().width(QLatin1Char('9')) * digits;
+}
+
+int LargeFileView::VisibleLines() const {
+    return qMax(1, viewport()->height() / LineHeight());
+}
+
+void LargeFileView::UpdateScrollBars() {
+    int visible = VisibleLines();
+    verticalScrollBar()->setRange(
+        0, static_cast<int>(qMax(0LL, LineCount() - visible)));
+    verticalScrollBar()->setPageStep(visible);
+    verticalScrollBar()->setSingleStep(1);
+    int textArea = viewport()->width() - GutterWidth();
+    horizontalScrollBar()->setRange(0, qMax(0, m_textWidth - textArea));
+    horizontalScrollBar()->setPageStep(qMax(1, textArea));
+}
+
+void LargeFileView::resizeEvent(QResizeEvent *event) {
+    QAbstractScrollArea::resizeEvent(event);
+    UpdateScrollBars();
+}
+
+// Only the visible window is decoded, so cost does not depend on file size
+void LargeFileView::paintEvent(QPaintEvent *event) {
+    QPainter painter(viewport());
+    painter.fillRect(event->rect(), palette().color(QPalette::Base));
+    QFontMetrics metrics = fontMetrics();
+    int lineHeight = LineHeight();
+    int gutter = GutterWidth();
+    int x = gutter + 4 - horizontalScrollBar()->value();
+    qint64 first = verticalScrollBar()->value();
+    qint64 last = qMin(LineCount(), first + VisibleLines() + 1);
+    qint64 matchLine = (m_matchOffset >= 0) ? LineOfOffset(m_matchOffset) : -1;
+    int widest = m_textWidth;
+
+    for (qint64 line = first; line < last; line++) {
+        int y = static_cast<int>(line - first) * lineHeight;
+        if (line == m_currentLine) {
+            painter.fillRect(gutter, y, viewport()->width(), lineHeight,
+                             QColor(45, 45, 45));
+        }
+        QString text = LineText(line).replace('\t', "    ");
+        if (line == matchLine && !m_edits.contains(line)) {
+            qint64 start = m_lineStarts.at(line);
+            int column = QString::fromUtf8(m_data + start,
+                                           static_cast<int>(m_matchOffset - start))
+                         .replace('\t', "    ").length();
+            int length = QString::fromUtf8(m_data + m_matchOffset,
+                                           m_matchLength).length();
+            painter.fillRect(x + metrics.width(text.left(column)), y,
+                             metrics.width(text.mid(column, length)), lineHeight,
+                             QColor(120, 100, 0));
+        }
+        painter.setPen(m_edits.contains(line) ? QColor(255, 200, 100) :
+                       palette().color(QPalette::Text));
+        painter.drawText(x, y + metrics.ascent(), text);
+        widest = qMax(widest, metrics.width(text) + 8);
+    }
+
+    // Gutter is drawn last, it covers text scrolled to the left
+    painter.fillRect(0, 0, gutter, viewport()->height(), QColor(30, 30, 30));
+    painter.setPen(Qt::gray);
+    for (qint64 line = first; line < last; line++) {
+        int y = static_cast<int>(line - first) * lineHeight;
+        painter.drawText(0, y, gutter - 3, lineHeight, Qt::AlignRight,
+                         QString::number(line + 1));
+    }
+
+    if (widest > m_textWidth) {
+        m_textWidth = widest;
+        UpdateScrollBars();
+    }
+}
+
+void LargeFileView::mousePressEvent(QMouseEvent *event) {
+    GotoLine(verticalScrollBar()->value() + event->pos().y() / LineHeight());
+    QAbstractScrollArea::mousePressEvent(event);
+}
+
+void LargeFileView::mouseDoubleClickEvent(QMouseEvent *event) {
+    EditLine(m_currentLine);
+    event->accept();
+}
+
+void LargeFileView::keyPressEvent(QKeyEvent *event) {
+    if (event->matches(QKeySequence::Copy)) {
+        QApplication::clipboard()->setText(LineText(m_currentLine));
+        return;
+    }
+    qint64 page = VisibleLines();
+    switch (event->key()) {
+    case Qt::Key_Up:
+        GotoLine(m_currentLine - 1);
+        break;
+    case Qt::Key_Down:
+        GotoLine(m_currentLine + 1);
+        break;
+    case Qt::Key_PageUp:
+        GotoLine(m_currentLine - page);
+        break;
+    case Qt::Key_PageDown:
+        GotoLine(m_currentLine + page);
+        break;
+    case Qt::Key_Home:
+        GotoLine(0);
+        break;
+    case Qt::Key_End:
+        GotoLine(LineCount() - 1);
+        break;
+    case Qt::Key_Return:
+    case Qt::Key_Enter:
+    case Qt::Key_F2:
+        EditLine(m_currentLine);
+        break;
+    default:
+        QAbstractScrollArea::keyPressEvent(event);
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef LARGEFILEVIEW_H
+#define LARGEFILEVIEW_H
+
+#include <QAbstractScrollArea>
+#include <QAtomicInt>
+#include <QFile>
+#include <QFutureWatcher>
+#include <QMap>
+#include <QVector>
+
+// Files bigger than this open in LargeFileView instead of an editor
+#define LARGE_FILE_THRESHOLD (32 * 1024 * 1024)
+// Line index is built and published in pieces of this many bytes
+#define LARGE_FILE_INDEX_CHUNK (16 * 1024 * 1024)
+// Longer lines are cut when drawn, file content is not changed
+#define LARGE_FILE_MAX_LINE_CHARS 4096
+
+// Read-only view over a memory mapped file
+// Only the visible lines are decoded and drawn, the line offset index is
+// built on a background thread while the beginning is already visible.
+// Edited lines are kept aside and only merged into the file on save.
+class LargeFileView : public QAbstractScrollArea {
+    Q_OBJECT
+  public:
+    explicit LargeFileView(QWidget *parent = 0);
+    ~LargeFileView();
+    void Open(const QString &fileName, bool &success);
+    void Save(bool &success);
+    void Close();
+    QString FileName() const;
+    qint64 FileSize() const;
+    qint64 LineCount() const;
+    qint64 CurrentLine() const;
+    bool IsIndexing() const;
+    bool IsModified() const;
+    void GotoLine(qint64 line);
+    void Find(const QString &text, bool forward);
+    void EditLine(qint64 line);
+    QString LineText(qint64 line) const;
+
+  signals:
+    void IndexProgress(int percent);
+    void IndexFinished(qint64 lines);
+    void FindFinished(qint64 line); // -1 when nothing is found
+
+  protected:
+    void paintEvent(QPaintEvent *event);
+    void resizeEvent(QResizeEvent *event);
+    void mousePressEvent(QMouseEvent *event);
+    void mouseDoubleClickEvent(QMouseEvent *event);
+    void keyPressEvent(QKeyEvent *event);
+
+  private slots:
+    void AppendIndex(int generation, const QVector<qint64> &lineStarts,
+                     qint64 scanned);
+    void FindDone();
+
+  private:
+    QFile m_file;
+    const char *m_data;
+    qint64 m_size;
+    QVector<qint64> m_lineStarts; // offset of each line found so far
+    qint64 m_scanned; // bytes indexed so far
+    qint64 m_currentLine;
+    qint64 m_matchOffset; // last match, next search continues from here
+    int m_matchLength;
+    QMap<qint64, QString> m_edits; // line -> replaced text
+    int m_generation; // bumped on every open, late index pieces are dropped
+    int m_textWidth; // widest line drawn so far, for horizontal scrolling
+    QAtomicInt m_cancel;
+    QFuture<void> m_indexer;
+    QFutureWatcher<qint64> m_finder;
+    int LineHeight() const;
+    int GutterWidth() const;
+    int VisibleLines() const;
+    void UpdateScrollBars();
+    qint64 LineOfOffset(qint64 offset) const;
+    qint64 LineEnd(qint64 line) const;
+    QString OriginalLine(qint64 line) const;
+    void BuildIndex(int generation);
+    static qint64 Search(const char *data, qint64 size, const QByteArray &needle,
+                         qint64 from, bool forward);
+};
+
+#endif // LARGEFILEVIEW_H
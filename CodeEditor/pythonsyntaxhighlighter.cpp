@@ -34,228 +34,48 @@
 */
 
 #include "CodeEditor/pythonsyntaxhighlighter.h"
+#include <QTextDocument>
+#include <QTextLayout>
+#include <QtConcurrent>
 
-PythonSyntaxHighlighter::PythonSyntaxHighlighter(QTextDocument *parent)
-    : QSyntaxHighlighter(parent) {
-    keywords = QStringList() << "and"
-               << "assert"
-               << "break"
-               << "class"
-               << "continue"
-               << "def"
-               << "del"
-               << "elif"
-               << "else"
-               << "except"
-               << "exec"
-               << "finally"
-               << "for"
-               << "from"
-               << "global"
-               << "if"
-               << "import"
-               << "in"
-               << "is"
-               << "lambda"
-               << "not"
-               << "or"
-               << "pass"
-               << "raise"
-               << "return"
-               << "try"
-               << "while"
-               << "yield"
-               << "None"
-               << "True"
-               << "False";
-
-    operators = QStringList() << "="
-                << "=="
-                << "!="
-                << "<"
-                << "<="
-                << ">"
-                << ">="
-                << "\\+"
-                << "-"
-                << "\\*"
-                << "/"
-                << "//"
-                << "%"
-                << "\\*\\*"
-                << "\\+="
-                << "-="
-                << "\\*="
-                << "/="
-                << "%="
-                << "\\^"
-                << "\\|"
-                << "&"
-                << "~"
-                << ">>"
-                << "<<";
-
-    braces = QStringList() << ":"
-             << ";"
-             << ","
-             << "@"
-             << "{"
-             << "}"
-             << "\\("
-             << "\\)"
-             << "\\["
-             << "\\]";
-
-    builtins = QStringList() << "abs"
-               << "divmod"
-               << "input"
-               << "open"
-               << "staticmethod"
-               << "all"
-               << "enumerate"
-               << "int"
-               << "ord"
-               << "str"
-               << "any"
-               << "eval"
-               << "isinstance"
-               << "pow"
-               << "sum"
-               << "basestring"
-               << "execfile"
-               << "issubclass"
-               << "print"
-               << "super"
-               << "bin"
-               << "file"
-               << "iter"
-               << "property"
-               << "tuple"
-               << "bool"
-               << "filter"
-               << "len"
-               << "range"
-               << "type"
-               << "bytearray"
-               << "float"
-               << "list"
-               << "raw_input"
-               << "unichr"
-               << "callable"
-               << "format"
-               << "locals"
-               << "reduce"
-               << "unicode"
-               << "chr"
-               << "frozenset"
-               << "long"
-               << "reload"
-               << "vars"
-               << "classmethod"
-               << "getattr"
-               << "map"
-               << "repr"
-               << "xrange"
-               << "cmp"
-               << "globals"
-               << "max"
-               << "reversed"
-               << "zip"
-               << "compile"
-               << "hasattr"
-               << "memoryview"
-               << "round"
-               << "__import__"
-               << "complex"
-               << "hash"
-               << "min"
-               << "set"
-               << "apply"
-               << "delattr"
-               << "help"
-               << "next"
-               << "setattr"
-               << "buffer"
-               << "dict"
-               << "hex"
-               << "object"
-               << "slice"
-               << "coerce"
-               << "dir"
-               << "id"
-               << "oct"
-               << "sorted"
-               << "intern";
-
-    exceptions = QStringList() << "BaseException"
-                 << "SystemExit"
-                 << "KeyboardInterrupt"
-                 << "GeneratorExit"
-                 << "Exception"
-                 << "StopIteration"
-                 << "ArithmeticError"
-                 << "FloatingPointError"
-                 << "OverflowError"
-                 << "ZeroDivisionError"
-                 << "AssertionError"
-                 << "AttributeError"
-                 << "BufferError"
-                 << "EOFError"
-                 << "ImportError"
-                 << "LookupError"
-                 << "IndexError"
-                 << "KeyError"
-                 << "MemoryError"
-                 << "NameError"
-                 << "UnboundLocalError"
-                 << "OSError"
-                 << "BlockingIOError"
-                 << "ChildProcessError"
-                 << "ConnectionError"
-                 << "BrokenPipeError"
-                 << "ConnectionAbortedError"
-                 << "ConnectionRefusedError"
-                 << "ConnectionResetError"
-                 << "FileExistsError"
-                 << "FileNotFoundError"
-                 << "InterruptedError"
-                 << "IsADirectoryError"
-                 << "NotADirectoryError"
-                 << "PermissionError"
-                 << "ProcessLookupError"
-                 << "TimeoutError"
-                 << "ReferenceError"
-                 << "RuntimeError"
-                 << "NotImplementedError"
-                 << "SyntaxError"
-                 << "IndentationError"
-                 << "TabError"
-                 << "SystemError"
-                 << "TypeError"
-                 << "ValueError"
-                 << "UnicodeError"
-                 << "UnicodeDecodeError"
-                 << "UnicodeEncodeError"
-                 << "UnicodeTranslateError"
-                 << "Warning"
-                 << "DeprecationWarning"
-                 << "PendingDeprecationWarning"
-                 << "RuntimeWarning"
-                 << "SyntaxWarning"
-                 << "UserWarning"
-                 << "FutureWarning"
-                 << "ImportWarning"
-                 << "UnicodeWarning"
-                 << "BytesWarning"
-                 << "ResourceWarning";
+// What a block was formatted from last time
+// Every edit of a block runs highlightBlock on it again, which updates this
+class HighlightData : public QTextBlockUserData {
+  public:
+    HighlightData() : hash(0), startState(0), formatted(false) {}
+    uint hash;
+    int startState;
+    bool formatted; // false when the old formats were kept as they were
+};
 
+PythonSyntaxHighlighter::PythonSyntaxHighlighter(QTextDocument *parent)
+    : QSyntaxHighlighter(parent), m_version(0), m_tokenizeVersion(-1),
+      m_linesVersion(-1), m_firstVisible(0),
+      m_lastVisible(HIGHLIGHT_APPLY_CHUNK), m_applying(false),
+      m_applyFrom(-1), m_applyTo(-1), m_applyNext(0) {
     setStyles();
-    mSearchRegex = tr("");
-    mSearchHighlight = getTextCharFormat("black", "bold", "yellow");
-    triSingleQuote.setPattern("'''");
-    triDoubleQuote.setPattern("\"\"\"");
 
-    initializeRules();
+    m_idleTimer.setSingleShot(true);
+    m_idleTimer.setInterval(HIGHLIGHT_IDLE_DELAY_MS);
+    connect(&m_idleTimer, &QTimer::timeout, this,
+            &PythonSyntaxHighlighter::StartTokenize);
+    connect(&m_applyTimer, &QTimer::timeout, this,
+            &PythonSyntaxHighlighter::ApplyNextChunk);
+    connect(&m_tokenizeWatcher, &QFutureWatcher<HighlightedLines>::finished,
+            this, &PythonSyntaxHighlighter::TokenizeDone);
+    if (parent) {
+        connect(parent, &QTextDocument::contentsChange, this,
+                &PythonSyntaxHighlighter::DocumentChanged);
+    }
+    if (IsLarge()) {
+        m_idleTimer.start();
+    }
+}
+
+PythonSyntaxHighlighter::~PythonSyntaxHighlighter() {
+    // Worker holds a pointer to m_version, make it stop and wait for it
+    m_version.ref();
+    m_tokenizeWatcher.waitForFinished();
 }
 
 void PythonSyntaxHighlighter::setStyles() {
@@ -273,152 +93,249 @@ void PythonSyntaxHighlighter::setStyles() {
     basicStyles.insert("except", getTextCharFormat("royalblue", "underline"));
     basicStyles.insert("private", getTextCharFormat("white", "italic"));
     basicStyles.insert("bytes", getTextCharFormat("lightsteelblue"));
+    basicStyles.insert("cell", getTextCharFormat("darkgreen", "bold overline",
+                       "honeydew"));
+
+    m_kindFormats.resize(TOKEN_KIND_COUNT);
+    m_kindFormats[TOKEN_KEYWORD] = basicStyles.value("keyword");
+    m_kindFormats[TOKEN_OPERATOR] = basicStyles.value("operator");
+    m_kindFormats[TOKEN_BRACE] = basicStyles.value("brace");
+    m_kindFormats[TOKEN_BUILTIN] = basicStyles.value("builtins");
+    m_kindFormats[TOKEN_EXCEPT] = basicStyles.value("except");
+    m_kindFormats[TOKEN_HACKISH] = basicStyles.value("hackish");
+    m_kindFormats[TOKEN_PRIVATE] = basicStyles.value("private");
+    m_kindFormats[TOKEN_SPECIAL] = basicStyles.value("special");
+    m_kindFormats[TOKEN_BYTES] = basicStyles.value("bytes");
+    m_kindFormats[TOKEN_STRING] = basicStyles.value("string");
+    m_kindFormats[TOKEN_STRING_LONG] = basicStyles.value("stringlong");
+    m_kindFormats[TOKEN_NUMBER] = basicStyles.value("numbers");
+    m_kindFormats[TOKEN_BUG] = basicStyles.value("bugs");
+    m_kindFormats[TOKEN_COMMENT] = basicStyles.value("comment");
+    m_cellFormat = basicStyles.value("cell");
 }
 
-void PythonSyntaxHighlighter::initializeRules() {
-    foreach (QString currKeyword, keywords) {
-        rules.append(HighlightingRule(QString("\\b%1\\b").arg(currKeyword), 0,
-                                      basicStyles.value("keyword")));
-    }
-    foreach (QString currOperator, operators) {
-        rules.append(HighlightingRule(QString("%1").arg(currOperator), 0,
-                                      basicStyles.value("operator")));
-    }
-    foreach (QString currBrace, braces) {
-        rules.append(HighlightingRule(QString("%1").arg(currBrace), 0,
-                                      basicStyles.value("brace")));
+void PythonSyntaxHighlighter::highlightBlock(const QString &text) {
+    int start = qMax(previousBlockState(), 0);
+    if (!IsLarge()) {
+        PythonTokens tokens;
+        setCurrentBlockState(m_tokenizer.Tokenize(text, start, tokens));
+        ApplyTokens(tokens);
+        return;
     }
 
-    foreach (QString currExcept, exceptions) {
-        rules.append(HighlightingRule(QString("\\b%1\\b").arg(currExcept), 0,
-                                      basicStyles.value("except")));
+    // WHY:
+    // Lines away from the screen keep their formats and state until the
+    // background pass reaches them, so an edit that changes the state
+    // (opening a docstring) never cascades through the whole document
+    int number = currentBlock().blockNumber();
+    bool inWindow = m_applying ?
+                    (number >= m_applyFrom && number <= m_applyTo) :
+                    (number >= m_firstVisible && number <= m_lastVisible);
+    if (!inWindow) {
+        KeepFormats();
+        return;
     }
 
-    rules.append(
-        HighlightingRule("\\b__[\\w_]+__\\b", 0, basicStyles.value("hackish")));
-    rules.append(
-        HighlightingRule("\\b_[\\w_]+\\b", 0, basicStyles.value("private")));
-
-    foreach (QString currBuiltin, builtins) {
-        rules.append(HighlightingRule(QString("\\b%1\\b").arg(currBuiltin), 0,
-                                      basicStyles.value("builtins")));
+    uint hash = qHash(text);
+    const HighlightedLine *line = CachedLine(number, hash, start);
+    if (line) {
+        start = line->startState;
+        setCurrentBlockState(line->state);
+        ApplyTokens(line->tokens);
+    } else {
+        PythonTokens tokens;
+        setCurrentBlockState(m_tokenizer.Tokenize(text, start, tokens));
+        ApplyTokens(tokens);
     }
+    MarkFormatted(hash, start, true);
+}
 
-    rules.append(HighlightingRule("\\b_\\b", 0, basicStyles.value("special")));
-    rules.append(HighlightingRule("\\bself\\b", 0, basicStyles.value("special")));
+void PythonSyntaxHighlighter::ApplyTokens(const PythonTokens &tokens) {
+    foreach (const PythonToken &token, tokens) {
+        if (token.kind == TOKEN_COMMENT && token.start == 0 &&
+                PythonTokenizer::IsCellMarker(currentBlock().text())) {
+            // Cells stand out, a line above them marks where one starts
+            setFormat(token.start, token.length, m_cellFormat);
+            continue;
+        }
+        setFormat(token.start, token.length, m_kindFormats.at(token.kind));
+    }
+}
 
-    rules.append(HighlightingRule(
-                     "(b|B|br|Br|bR|BR|rb|rB|Rb|RB)\"[^\"\\\\]*(\\\\.[^\"\\\\]*)*\"", 0,
-                     basicStyles.value("bytes")));
-    rules.append(HighlightingRule(
-                     "(b|B|br|Br|bR|BR|rb|rB|Rb|RB)'[^'\\\\]*(\\\\.[^'\\\\]*)*'", 0,
-                     basicStyles.value("bytes")));
+// Formats are reset before highlightBlock, put back what the block had
+void PythonSyntaxHighlighter::KeepFormats() {
+    foreach (const QTextLayout::FormatRange &range,
+             currentBlock().layout()->formats()) {
+        setFormat(range.start, range.length, range.format);
+    }
+    MarkFormatted(0, 0, false);
+}
 
-    rules.append(HighlightingRule("[uUrR]?\"[^\"\\\\]*(\\\\.[^\"\\\\]*)*\"", 0,
-                                  basicStyles.value("string")));
-    rules.append(HighlightingRule("[uUrR]?'[^'\\\\]*(\\\\.[^'\\\\]*)*'", 0,
-                                  basicStyles.value("string")));
+void PythonSyntaxHighlighter::MarkFormatted(uint hash, int start, bool valid) {
+    HighlightData *data = static_cast<HighlightData *>(currentBlockUserData());
+    if (!data) {
+        if (!valid) {
+            return;
+        }
+        data = new HighlightData();
+        setCurrentBlockUserData(data);
+    }
+    data->hash = hash;
+    data->startState = start;
+    data->formatted = valid;
+}
 
-    rules.append(HighlightingRule("\\b[+-]?[0-9]+[lL]?\\b", 0,
-                                  basicStyles.value("numbers")));
-    rules.append(HighlightingRule("\\b[+-]?0[xX][0-9A-Fa-f]+[lL]?\\b", 0,
-                                  basicStyles.value("numbers")));
-    rules.append(
-        HighlightingRule("\\b[+-]?[0-9]+(?:\\.[0-9]+)?(?:[eE][+-]?[0-9]+)?\\b", 0,
-                         basicStyles.value("numbers")));
+// Tokens only depend on the text and the state before it, so a line can be
+// reused even after lines above it moved. While a finished pass is applied
+// its state is trusted over the line above, which may not be formatted yet.
+const HighlightedLine *PythonSyntaxHighlighter::CachedLine(int number,
+        uint hash, int start) const {
+    if (number >= m_lines.size()) {
+        return 0;
+    }
+    const HighlightedLine &line = m_lines.at(number);
+    if (line.hash != hash) {
+        return 0;
+    }
+    bool trusted = m_applying && m_linesVersion == m_version.load();
+    if (!trusted && line.startState != start) {
+        return 0;
+    }
+    return &line;
+}
 
-    rules.append(HighlightingRule("\\t+", 0, basicStyles.value("bugs")));
-    rules.append(HighlightingRule("\\?", 0, basicStyles.value("bugs")));
-    rules.append(HighlightingRule("\\$", 0, basicStyles.value("bugs")));
+bool PythonSyntaxHighlighter::IsCurrent(const QTextBlock &block) const {
+    const HighlightData *data =
+        static_cast<const HighlightData *>(block.userData());
+    if (!data || !data->formatted) {
+        return false;
+    }
+    int number = block.blockNumber();
+    if (m_linesVersion == m_version.load() && number < m_lines.size()) {
+        const HighlightedLine &line = m_lines.at(number);
+        return data->hash == line.hash && data->startState == line.startState;
+    }
+    return data->startState == qMax(block.previous().userState(), 0);
+}
 
-    rules.append(HighlightingRule("#[^\\n]*", 0, basicStyles.value("comment")));
+bool PythonSyntaxHighlighter::IsLarge() const {
+    return document() && document()->blockCount() > HIGHLIGHT_SYNC_BLOCKS;
 }
 
-void PythonSyntaxHighlighter::highlightBlock(const QString &text) {
-    int len = text.length();
-    for (int i = 0; i < len; i++) {
-        foreach (HighlightingRule currRule, rules) {
-            int idx = currRule.pattern.indexIn(text, i);
-            if (idx == i) {
-                idx = currRule.pattern.pos(currRule.nth);
-                int length = currRule.pattern.cap(currRule.nth).length();
-                setFormat(idx, length, currRule.format);
-                i = idx + length - 1;
-                break;
-            }
+void PythonSyntaxHighlighter::ApplyBlocks(int first, int last) {
+    m_applying = true;
+    m_applyFrom = first;
+    m_applyTo = last;
+    QTextBlock block = document()->findBlockByNumber(first);
+    for (int number = first; block.isValid() && number <= last; number++) {
+        if (!IsCurrent(block)) {
+            rehighlightBlock(block);
         }
+        block = block.next();
     }
+    m_applying = false;
+    m_applyFrom = -1;
+    m_applyTo = -1;
+}
 
-    setCurrentBlockState(0);
-
-    // Do multi-line strings
-    bool isInMultilne =
-        matchMultiline(text, triSingleQuote, 1, basicStyles.value("stringlong"));
-    if (!isInMultilne) {
-        isInMultilne = matchMultiline(text, triDoubleQuote, 2,
-                                      basicStyles.value("stringlong"));
+void PythonSyntaxHighlighter::SetVisibleBlocks(int first, int last) {
+    m_firstVisible = first;
+    m_lastVisible = last;
+    if (IsLarge()) {
+        ApplyBlocks(first, last);
     }
+}
 
-    // Highlight found stuff
-    if (!mSearchRegex.isNull() && !mSearchRegex.isEmpty()) {
-        QRegExp reg(mSearchRegex);
-        int idx = reg.indexIn(text, 0);
-        while (idx >= 0) {
-            int length = reg.cap(0).length();
-            setFormat(idx, length, mSearchHighlight);
-            idx = reg.indexIn(text, idx + length);
-        }
+void PythonSyntaxHighlighter::DocumentChanged(int position, int charsRemoved,
+        int charsAdded) {
+    Q_UNUSED(position);
+    Q_UNUSED(charsRemoved);
+    Q_UNUSED(charsAdded);
+    if (m_applying) {
+        // Format changes made by ApplyBlocks itself
+        return;
+    }
+    m_version.ref();
+    m_applyTimer.stop();
+    if (IsLarge()) {
+        m_idleTimer.start();
     }
 }
 
-void PythonSyntaxHighlighter::SetSearchRegEx(const QString &text) {
-    mSearchRegex = text;
+void PythonSyntaxHighlighter::StartTokenize() {
+    if (!IsLarge()) {
+        return;
+    }
+    if (m_tokenizeWatcher.isRunning()) {
+        // It stops early when outdated, TokenizeDone starts the next one
+        return;
+    }
+    m_tokenizeVersion = m_version.load();
+    m_tokenizeWatcher.setFuture(QtConcurrent::run(
+                                    &PythonSyntaxHighlighter::TokenizeText, &m_tokenizer,
+                                    document()->toPlainText(), m_lines, m_tokenizeVersion,
+                                    &m_version));
 }
 
-bool PythonSyntaxHighlighter::matchMultiline(const QString &text,
-        const QRegExp &delimiter,
-        const int inState,
-        const QTextCharFormat &style) {
-    int start = -1;
-    int add = -1;
-    int end = -1;
-    int length = 0;
-
-    // If inside triple-single quotes, start at 0
-    if (previousBlockState() == inState) {
-        start = 0;
-        add = 0;
+void PythonSyntaxHighlighter::TokenizeDone() {
+    if (m_tokenizeVersion != m_version.load()) {
+        if (IsLarge()) {
+            m_idleTimer.start();
+        }
+        return;
     }
-    // Otherwise, look for the delimiter on this line
-    else {
-        start = delimiter.indexIn(text);
-        // Move past this match
-        add = delimiter.matchedLength();
+    m_lines = m_tokenizeWatcher.result();
+    m_linesVersion = m_tokenizeVersion;
+    // Screen first, the rest in small slices so typing is never blocked
+    ApplyBlocks(m_firstVisible, m_lastVisible);
+    m_applyNext = 0;
+    m_applyTimer.start();
+}
+
+void PythonSyntaxHighlighter::ApplyNextChunk() {
+    if (m_applyNext >= document()->blockCount()) {
+        m_applyTimer.stop();
+        return;
     }
+    ApplyBlocks(m_applyNext, m_applyNext + HIGHLIGHT_APPLY_CHUNK - 1);
+    m_applyNext += HIGHLIGHT_APPLY_CHUNK;
+}
 
-    // As long as there's a delimiter match on this line...
-    while (start >= 0) {
-        // Look for the ending delimiter
-        end = delimiter.indexIn(text, start + add);
-        // Ending delimiter on this line?
-        if (end >= add) {
-            length = end - start + add + delimiter.matchedLength();
-            setCurrentBlockState(0);
+// Runs on a pool thread, gives up as soon as the document changes since
+// the result would be thrown away anyway
+// Lines with the same text and start state as in the previous pass are
+// copied, so after a local edit only the changed lines are tokenized.
+HighlightedLines PythonSyntaxHighlighter::TokenizeText(
+    const PythonTokenizer *tokenizer, QString text, HighlightedLines previous,
+    int version, QAtomicInt *current) {
+    QStringList lines = text.split(QChar('\n'));
+    HighlightedLines result(lines.size());
+    // Lines below an edit moved by this much
+    int shift = lines.size() - previous.size();
+    int state = 0;
+    for (int i = 0; i < lines.size(); i++) {
+        if (i % HIGHLIGHT_APPLY_CHUNK == 0 && current->load() != version) {
+            return HighlightedLines();
         }
-        // No; multi-line string
-        else {
-            setCurrentBlockState(inState);
-            length = text.length() - start + add;
+        uint hash = qHash(lines.at(i));
+        auto reusable = [&](int index) {
+            return index >= 0 && index < previous.size() &&
+                   previous.at(index).hash == hash &&
+                   previous.at(index).startState == state;
+        };
+        HighlightedLine &line = result[i];
+        if (reusable(i)) {
+            line = previous.at(i);
+        } else if (reusable(i - shift)) {
+            line = previous.at(i - shift);
+        } else {
+            line.hash = hash;
+            line.startState = state;
+            line.state = tokenizer->Tokenize(lines.at(i), state, line.tokens);
         }
-        // Apply formatting and look for next
-        setFormat(start, length, style);
-        start = delimiter.indexIn(text, start + length);
+        state = line.state;
     }
-    // Return True if still inside a multi-line string, False otherwise
-    if (currentBlockState() == inState)
-        return true;
-    else
-        return false;
+    return result;
 }
 
 const QTextCharFormat
@@ -439,5 +356,7 @@ PythonSyntaxHighlighter::getTextCharFormat(const QString &colorName,
         charFormat.setFontItalic(true);
     if (style.contains("underline", Qt::CaseInsensitive))
         charFormat.setFontUnderline(true);
+    if (style.contains("overline", Qt::CaseInsensitive))
+        charFormat.setFontOverline(true);
     return charFormat;
 }
@@ -36,60 +36,82 @@ USE OR OTHER DEALINGS IN THE SOFTWARE.
 #ifndef KICKPYTHONSYNTAXHIGHLIGHTER_H
 #define KICKPYTHONSYNTAXHIGHLIGHTER_H
 
+#include <QAtomicInt>
+#include <QFutureWatcher>
 #include <QSyntaxHighlighter>
-
-//! Container to describe a highlighting rule. Based on a regular expression, a
-// relevant match # and the format.
-class HighlightingRule {
-
-  public:
-    HighlightingRule(const QString &patternStr, int n,
-                     const QTextCharFormat &matchingFormat) {
-        originalRuleStr = patternStr;
-        pattern = QRegExp(patternStr);
-        nth = n;
-        format = matchingFormat;
-    }
-
-    QString originalRuleStr;
-    QRegExp pattern;
-    int nth;
-    QTextCharFormat format;
+#include <QTimer>
+#include "CodeEditor/pythontokenizer.h"
+
+// Documents up to this many lines are highlighted on the GUI thread
+#define HIGHLIGHT_SYNC_BLOCKS 2000
+// Background pass starts after typing stops for this long
+#define HIGHLIGHT_IDLE_DELAY_MS 150
+// Lines formatted per idle slice once a background pass is done
+#define HIGHLIGHT_APPLY_CHUNK 200
+
+// Result of tokenizing one line on the worker thread
+struct HighlightedLine {
+    uint hash; // of the line text
+    int startState;
+    int state; // at the end of the line
+    PythonTokens tokens;
 };
+typedef QVector<HighlightedLine> HighlightedLines;
 
 //! Implementation of highlighting for Python code.
+// Big documents are tokenized from a snapshot on a worker thread, only the
+// visible lines are done right away and the rest is formatted when idle.
 class PythonSyntaxHighlighter : public QSyntaxHighlighter {
     Q_OBJECT
 
   public:
     PythonSyntaxHighlighter(QTextDocument *parent = 0);
+    ~PythonSyntaxHighlighter();
 
-    void SetSearchRegEx(const QString &text);
+  public slots:
+    void SetVisibleBlocks(int first, int last);
 
   protected:
     void highlightBlock(const QString &text);
 
+  private slots:
+    void DocumentChanged(int position, int charsRemoved, int charsAdded);
+    void StartTokenize();
+    void TokenizeDone();
+    void ApplyNextChunk();
+
   private:
-    QStringList keywords;
-    QStringList operators;
-    QStringList braces;
-    QStringList builtins;
-    QStringList exceptions;
-    QString mSearchRegex;
-    QTextCharFormat mSearchHighlight;
     QHash<QString, QTextCharFormat> basicStyles;
-    void initializeRules();
-    //! Highlighst multi-line strings, returns true if after processing we are
-    // still within the multi-line section.
-    bool matchMultiline(const QString &text, const QRegExp &delimiter,
-                        const int inState, const QTextCharFormat &style);
+    QVector<QTextCharFormat> m_kindFormats; // format of each token kind
+    QTextCharFormat m_cellFormat; // comment starting a cell
+    PythonTokenizer m_tokenizer; // shared with the worker, it is read only
+    QAtomicInt m_version; // bumped on every edit, workers stop when it moves
+    int m_tokenizeVersion;
+    QFutureWatcher<HighlightedLines> m_tokenizeWatcher;
+    HighlightedLines m_lines; // last finished background pass
+    int m_linesVersion;
+    int m_firstVisible;
+    int m_lastVisible;
+    bool m_applying;
+    int m_applyFrom;
+    int m_applyTo;
+    int m_applyNext;
+    QTimer m_idleTimer;
+    QTimer m_applyTimer;
     const QTextCharFormat
     getTextCharFormat(const QString &colorName, const QString &style = QString(),
                       const QString &backColorName = QString());
-    QList<HighlightingRule> rules;
-    QRegExp triSingleQuote;
-    QRegExp triDoubleQuote;
     void setStyles();
+    bool IsLarge() const;
+    bool IsCurrent(const QTextBlock &block) const;
+    const HighlightedLine *CachedLine(int number, uint hash, int start) const;
+    void ApplyTokens(const PythonTokens &tokens);
+    void ApplyBlocks(int first, int last);
+    void KeepFormats();
+    void MarkFormatted(uint hash, int start, bool valid);
+    static HighlightedLines TokenizeText(const PythonTokenizer *tokenizer,
+                                         QString text, HighlightedLines previous,
+                                         int version, QAtomicInt *current);
 };
 
 #endif
@@ -0,0 +1,614 @@
+#include "CodeEditor/pythontokenizer.h"
+#include <QStringList>
+
+// Bit layout of a packed state
+// 0-1 string kind, 2 double quote, 3 bytes, 4 f-string, 5-7 f-string depth,
+// 8-12 brackets, 13 continued, 14 raw
+#define STATE_STRING_MASK 3
+#define STATE_DOUBLE_QUOTE (1 << 2)
+#define STATE_BYTES (1 << 3)
+#define STATE_FORMAT (1 << 4)
+#define STATE_FORMAT_DEPTH_SHIFT 5
+#define STATE_BRACKETS_SHIFT 8
+#define STATE_CONTINUED (1 << 13)
+#define STATE_RAW (1 << 14)
+
+PythonLexState::PythonLexState()
+    : string(STRING_NONE), doubleQuote(false), raw(false), bytes(false),
+      format(false),
+      formatDepth(0), brackets(0), continued(false) {}
+
+PythonLexState PythonLexState::Unpack(int state) {
+    PythonLexState lex;
+    if (state < 0) {
+        return lex;
+    }
+    lex.string = state & STATE_STRING_MASK;
+    lex.doubleQuote = (state & STATE_DOUBLE_QUOTE) != 0;
+    lex.raw = (state & STATE_RAW) != 0;
+    lex.bytes = (state & STATE_BYTES) != 0;
+    lex.format = (state & STATE_FORMAT) != 0;
+    lex.formatDepth = (state >> STATE_FORMAT_DEPTH_SHIFT) & PYTHON_MAX_FORMAT_DEPTH;
+    lex.brackets = (state >> STATE_BRACKETS_SHIFT) & PYTHON_MAX_BRACKETS;
+    lex.continued = (state & STATE_CONTINUED) != 0;
+    return lex;
+}
+
+int PythonLexState::Pack() const {
+    int state = string;
+    state |= doubleQuote ? STATE_DOUBLE_QUOTE : 0;
+    state |= raw ? STATE_RAW : 0;
+    state |= bytes ? STATE_BYTES : 0;
+    state |= format ? STATE_FORMAT : 0;
+    state |= formatDepth << STATE_FORMAT_DEPTH_SHIFT;
+    state |= brackets << STATE_BRACKETS_SHIFT;
+    state |= continued ? STATE_CONTINUED : 0;
+    return state;
+}
+
+namespace {
+
+bool IsWordStart(QChar c) {
+    return c.isLetter() || c == QLatin1Char('_');
+}
+
+bool IsWordChar(QChar c) {
+    return c.isLetterOrNumber() || c == QLatin1Char('_');
+}
+
+bool IsOperatorChar(ushort c) {
+    switch (c) {
+    case '=': case '!': case '<': case '>': case '+': case '-': case '*':
+    case '/': case '%': case '^': case '|': case '&': case '~':
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Walks one line once, left to right, updating the state in place
+class LineScanner {
+  public:
+    LineScanner(const PythonTokenizer &words, const QString &text,
+                PythonLexState &state, PythonTokens &tokens)
+        : m_words(words), m_text(text), m_length(text.length()), m_pos(0),
+          m_stringStart(-1), m_shortContinued(false), m_state(state),
+          m_tokens(tokens) {}
+    void Run();
+
+  private:
+    const PythonTokenizer &m_words;
+    const QString &m_text;
+    int m_length;
+    int m_pos;
+    int m_stringStart; // prefix of a string opened on this line
+    bool m_shortContinued; // short string ended the line with a backslash
+    PythonLexState &m_state;
+    PythonTokens &m_tokens;
+
+    ushort At(int pos) const {
+        return pos < m_length ? m_text.at(pos).unicode() : 0;
+    }
+    bool IsTriple(int pos, ushort quote) const {
+        return At(pos) == quote && At(pos + 1) == quote && At(pos + 2) == quote;
+    }
+    void Add(int start, int length, int kind) {
+        if (length > 0 && kind >= 0) {
+            PythonToken token = {start, length, kind};
+            m_tokens.append(token);
+        }
+    }
+    void ScanCode(bool expression);
+    void ScanString();
+    void ScanNestedString(int start);
+    void ScanNumber();
+    void OpenString(int start, int quotePos);
+    void CloseString();
+    bool IsStringPrefix(int start, int end) const;
+};
+
+void LineScanner::Run() {
+    m_state.continued = false;
+    while (m_pos < m_length) {
+        if (m_state.string == STRING_NONE) {
+            ScanCode(false);
+            continue;
+        }
+        if (m_state.formatDepth > 0) {
+            // Line starts inside the {} of a multi-line f-string
+            ScanCode(true);
+        }
+        ScanString();
+    }
+    if (m_state.string == STRING_SHORT && !m_shortContinued) {
+        // Unterminated, python stops the string here too
+        CloseString();
+    }
+}
+
+void LineScanner::ScanCode(bool expression) {
+    ushort outer = m_state.doubleQuote ? '"' : '\'';
+    while (m_pos < m_length) {
+        QChar c = m_text.at(m_pos);
+        ushort u = c.unicode();
+        if (expression && u == outer &&
+                (m_state.string == STRING_SHORT || IsTriple(m_pos, outer))) {
+            // Quote of the f-string itself, the {} was not closed
+            m_state.formatDepth = 0;
+            return;
+        }
+        if (u == '\t') {
+            int start = m_pos;
+            while (At(m_pos) == '\t') {
+                m_pos++;
+            }
+            Add(start, m_pos - start, TOKEN_BUG);
+            continue;
+        }
+        if (c.isSpace()) {
+            m_pos++;
+            continue;
+        }
+        if (u == '#' && !expression) {
+            Add(m_pos, m_length - m_pos, TOKEN_COMMENT);
+            m_pos = m_length;
+            return;
+        }
+        if (u == '\'' || u == '"') {
+            if (expression) {
+                ScanNestedString(m_pos);
+                continue;
+            }
+            OpenString(m_pos, m_pos);
+            return;
+        }
+        if (IsWordStart(c)) {
+            int start = m_pos;
+            while (m_pos < m_length && IsWordChar(m_text.at(m_pos))) {
+                m_pos++;
+            }
+            if ((At(m_pos) == '\'' || At(m_pos) == '"') &&
+                    IsStringPrefix(start, m_pos)) {
+                if (expression) {
+                    ScanNestedString(start);
+                    continue;
+                }
+                OpenString(start, m_pos);
+                return;
+            }
+            Add(start, m_pos - start,
+                m_words.WordKind(m_text.mid(start, m_pos - start)));
+            continue;
+        }
+        if (c.isDigit() || (u == '.' && QChar(At(m_pos + 1)).isDigit())) {
+            ScanNumber();
+            continue;
+        }
+        switch (u) {
+        case '(':
+        case '[':
+        case '{':
+            if (expression) {
+                m_state.formatDepth = qMin(m_state.formatDepth + 1,
+                                           PYTHON_MAX_FORMAT_DEPTH);
+            } else {
+                m_state.brackets = qMin(m_state.brackets + 1, PYTHON_MAX_BRACKETS);
+            }
+            Add(m_pos++, 1, TOKEN_BRACE);
+            continue;
+        case ')':
+        case ']':
+        case '}':
+            if (expression) {
+                if (u == '}' && m_state.formatDepth == 1) {
+                    // End of the {} field, the string goes on from here
+                    m_state.formatDepth = 0;
+                    return;
+                }
+                m_state.formatDepth = qMax(m_state.formatDepth - 1, 1);
+            } else {
+                m_state.brackets = qMax(m_state.brackets - 1, 0);
+            }
+            Add(m_pos++, 1, TOKEN_BRACE);
+            continue;
+        case ':':
+        case ';':
+        case ',':
+        case '@':
+            Add(m_pos++, 1, TOKEN_BRACE);
+            continue;
+        case '?':
+        case '$':
+            Add(m_pos++, 1, TOKEN_BUG);
+            continue;
+        case '\\':
+            if (m_pos == m_length - 1 && !expression) {
+                m_state.continued = true;
+            }
+            m_pos++;
+            continue;
+        default:
+            break;
+        }
+        if (IsOperatorChar(u)) {
+            int start = m_pos;
+            while (IsOperatorChar(At(m_pos))) {
+                m_pos++;
+            }
+            Add(start, m_pos - start, TOKEN_OPERATOR);
+            continue;
+        }
+        m_pos++;
+    }
+}
+
+void LineScanner::ScanString() {
+    ushort quote = m_state.doubleQuote ? '"' : '\'';
+    bool isLong = (m_state.string == STRING_LONG);
+    int kind = isLong ? TOKEN_STRING_LONG :
+               (m_state.bytes ? TOKEN_BYTES : TOKEN_STRING);
+    // Prefix and opening quotes are part of the first piece
+    int start = (m_stringStart >= 0) ? m_stringStart : m_pos;
+    m_stringStart = -1;
+    while (m_pos < m_length) {
+        ushort u = At(m_pos);
+        if (u == '\\') {
+            // WHY:
+            // Escapes a quote even in raw strings, r"\"" is one string
+            m_shortContinued = (m_pos == m_length - 1);
+            ushort next = At(m_pos + 1);
+            if (m_state.raw && next != quote && next != '\\') {
+                // Kept as is, rf"\{x}" still opens a field
+                m_pos++;
+                continue;
+            }
+            m_pos += 2;
+            continue;
+        }
+        if (u == quote && (!isLong || IsTriple(m_pos, quote))) {
+            m_pos += isLong ? 3 : 1;
+            Add(start, m_pos - start, kind);
+            CloseString();
+            return;
+        }
+        if (u == '{' && m_state.format) {
+            if (At(m_pos + 1) == '{') {
+                m_pos += 2;
+                continue;
+            }
+            m_pos++;
+            Add(start, m_pos - start, kind);
+            m_state.formatDepth = 1;
+            ScanCode(true);
+            if (m_state.formatDepth > 0) {
+                // Field goes on in the next line
+                return;
+            }
+            start = m_pos;
+            continue;
+        }
+        m_pos++;
+    }
+    m_pos = m_length;
+    Add(start, m_length - start, kind);
+}
+
+// String inside an f-string field, always ends on its own line
+void LineScanner::ScanNestedString(int start) {
+    while (At(m_pos) != '\'' && At(m_pos) != '"') {
+        m_pos++;
+    }
+    ushort quote = At(m_pos++);
+    while (m_pos < m_length) {
+        ushort u = At(m_pos);
+        if (u == '\\') {
+            m_pos += 2;
+            continue;
+        }
+        m_pos++;
+        if (u == quote) {
+            break;
+        }
+    }
+    m_pos = qMin(m_pos, m_length);
+    Add(start, m_pos - start, TOKEN_STRING);
+}
+
+void LineScanner::ScanNumber() {
+    int start = m_pos;
+    ushort next = At(m_pos + 1) | 0x20; // lower case for ascii letters
+    if (At(m_pos) == '0' && (next == 'x' || next == 'o' || next == 'b')) {
+        m_pos += 2;
+        while (m_pos < m_length && IsWordChar(m_text.at(m_pos))) {
+            m_pos++;
+        }
+    } else {
+        while (QChar(At(m_pos)).isDigit() || At(m_pos) == '_') {
+            m_pos++;
+        }
+        if (At(m_pos) == '.') {
+            m_pos++;
+            while (QChar(At(m_pos)).isDigit() || At(m_pos) == '_') {
+                m_pos++;
+            }
+        }
+        ushort sign = At(m_pos + 1);
+        if ((At(m_pos) | 0x20) == 'e' &&
+                (QChar(sign).isDigit() ||
+                 ((sign == '+' || sign == '-') && QChar(At(m_pos + 2)).isDigit()))) {
+            m_pos += 2;
+            while (QChar(At(m_pos)).isDigit() || At(m_pos) == '_') {
+                m_pos++;
+            }
+        }
+        ushort suffix = At(m_pos) | 0x20;
+        if (suffix == 'j' || suffix == 'l') {
+            m_pos++;
+        }
+    }
+    Add(start, m_pos - start, TOKEN_NUMBER);
+}
+
+bool LineScanner::IsStringPrefix(int start, int end) const {
+    if (end - start > 2) {
+        return false;
+    }
+    QString prefix = m_text.mid(start, end - start).toLower();
+    return prefix == "r" || prefix == "u" || prefix == "b" || prefix == "f" ||
+           prefix == "br" || prefix == "rb" || prefix == "fr" || prefix == "rf";
+}
+
+void LineScanner::OpenString(int start, int quotePos) {
+    QString prefix = m_text.mid(start, quotePos - start).toLower();
+    ushort quote = At(quotePos);
+    m_state.doubleQuote = (quote == '"');
+    m_state.raw = prefix.contains(QLatin1Char('r'));
+    m_state.bytes = prefix.contains(QLatin1Char('b'));
+    m_state.format = prefix.contains(QLatin1Char('f'));
+    m_state.formatDepth = 0;
+    if (IsTriple(quotePos, quote)) {
+        m_state.string = STRING_LONG;
+        m_pos = quotePos + 3;
+    } else {
+        m_state.string = STRING_SHORT;
+        m_pos = quotePos + 1;
+    }
+    m_stringStart = start;
+    m_shortContinued = false;
+}
+
+void LineScanner::CloseString() {
+    m_state.string = STRING_NONE;
+    m_state.doubleQuote = false;
+    m_state.raw = false;
+    m_state.bytes = false;
+    m_state.format = false;
+    m_state.formatDepth = 0;
+}
+
+} // namespace
+
+PythonTokenizer::PythonTokenizer() {
+    QStringList keywordsList = QStringList() << "and"
+                               << "assert"
+                               << "break"
+                               << "class"
+                               << "continue"
+                               << "def"
+                               << "del"
+                               << "elif"
+                               << "else"
+                               << "except"
+                               << "exec"
+                               << "finally"
+                               << "for"
+                               << "from"
+                               << "global"
+                               << "if"
+                               << "import"
+                               << "in"
+                               << "is"
+                               << "lambda"
+                               << "not"
+                               << "or"
+                               << "pass"
+                               << "raise"
+                               << "return"
+                               << "try"
+                               << "while"
+                               << "yield"
+                               << "async"
+                               << "await"
+                               << "nonlocal"
+                               << "None"
+                               << "True"
+                               << "False";
+
+    QStringList builtinsList = QStringList() << "abs"
+                               << "divmod"
+                               << "input"
+                               << "open"
+                               << "staticmethod"
+                               << "all"
+                               << "enumerate"
+                               << "int"
+                               << "ord"
+                               << "str"
+                               << "any"
+                               << "eval"
+                               << "isinstance"
+                               << "pow"
+                               << "sum"
+                               << "basestring"
+                               << "execfile"
+                               << "issubclass"
+                               << "print"
+                               << "super"
+                               << "bin"
+                               << "file"
+                               << "iter"
+                               << "property"
+                               << "tuple"
+                               << "bool"
+                               << "filter"
+                               << "len"
+                               << "range"
+                               << "type"
+                               << "bytearray"
+                               << "float"
+                               << "list"
+                               << "raw_input"
+                               << "unichr"
+                               << "callable"
+                               << "format"
+                               << "locals"
+                               << "reduce"
+                               << "unicode"
+                               << "chr"
+                               << "frozenset"
+                               << "long"
+                               << "reload"
+                               << "vars"
+                               << "classmethod"
+                               << "getattr"
+                               << "map"
+                               << "repr"
+                               << "xrange"
+                               << "cmp"
+                               << "globals"
+                               << "max"
+                               << "reversed"
+                               << "zip"
+                               << "compile"
+                               << "hasattr"
+                               << "memoryview"
+                               << "round"
+                               << "__import__"
+                               << "complex"
+                               << "hash"
+                               << "min"
+                               << "set"
+                               << "apply"
+                               << "delattr"
+                               << "help"
+                               << "next"
+                               << "setattr"
+                               << "buffer"
+                               << "dict"
+                               << "hex"
+                               << "object"
+                               << "slice"
+                               << "coerce"
+                               << "dir"
+                               << "id"
+                               << "oct"
+                               << "sorted"
+                               << "intern";
+
+    QStringList exceptionsList = QStringList() << "BaseException"
+                                 << "SystemExit"
+                                 << "KeyboardInterrupt"
+                                 << "GeneratorExit"
+                                 << "Exception"
+                                 << "StopIteration"
+                                 << "ArithmeticError"
+                                 << "FloatingPointError"
+                                 << "OverflowError"
+                                 << "ZeroDivisionError"
+                                 << "AssertionError"
+                                 << "AttributeError"
+                                 << "BufferError"
+                                 << "EOFError"
+                                 << "ImportError"
+                                 << "LookupError"
+                                 << "IndexError"
+                                 << "KeyError"
+                                 << "MemoryError"
+                                 << "NameError"
+                                 << "UnboundLocalError"
+                                 << "OSError"
+                                 << "BlockingIOError"
+                                 << "ChildProcessError"
+                                 << "ConnectionError"
+                                 << "BrokenPipeError"
+                                 << "ConnectionAbortedError"
+                                 << "ConnectionRefusedError"
+                                 << "ConnectionResetError"
+                                 << "FileExistsError"
+                                 << "FileNotFoundError"
+                                 << "InterruptedError"
+                                 << "IsADirectoryError"
+                                 << "NotADirectoryError"
+                                 << "PermissionError"
+                                 << "ProcessLookupError"
+                                 << "TimeoutError"
+                                 << "ReferenceError"
+                                 << "RuntimeError"
+                                 << "NotImplementedError"
+                                 << "SyntaxError"
+                                 << "IndentationError"
+                                 << "TabError"
+                                 << "SystemError"
+                                 << "TypeError"
+                                 << "ValueError"
+                                 << "UnicodeError"
+                                 << "UnicodeDecodeError"
+                                 << "UnicodeEncodeError"
+                                 << "UnicodeTranslateError"
+                                 << "Warning"
+                                 << "DeprecationWarning"
+                                 << "PendingDeprecationWarning"
+                                 << "RuntimeWarning"
+                                 << "SyntaxWarning"
+                                 << "UserWarning"
+                                 << "FutureWarning"
+                                 << "ImportWarning"
+                                 << "UnicodeWarning"
+                                 << "BytesWarning"
+                                 << "ResourceWarning";
+
+    foreach (const QString &word, keywordsList) {
+        keywords.insert(word);
+    }
+    foreach (const QString &word, builtinsList) {
+        builtins.insert(word);
+    }
+    foreach (const QString &word, exceptionsList) {
+        exceptions.insert(word);
+    }
+}
+
+int PythonTokenizer::WordKind(const QString &word) const {
+    if (keywords.contains(word)) {
+        return TOKEN_KEYWORD;
+    }
+    if (exceptions.contains(word)) {
+        return TOKEN_EXCEPT;
+    }
+    if (word.length() > 4 && word.startsWith("__") && word.endsWith("__")) {
+        return TOKEN_HACKISH;
+    }
+    if (word == "_" || word == "self") {
+        return TOKEN_SPECIAL;
+    }
+    if (word.startsWith(QLatin1Char('_'))) {
+        return TOKEN_PRIVATE;
+    }
+    if (builtins.contains(word)) {
+        return TOKEN_BUILTIN;
+    }
+    return -1;
+}
+
+bool PythonTokenizer::IsCellMarker(const QString &text) {
+    return text.startsWith(QLatin1String("# %%")) ||
+           text.startsWith(QLatin1String("#%%"));
+}
+
+int PythonTokenizer::Tokenize(const QString &text, int state,
+                              PythonTokens &tokens) const {
+    PythonLexState lex = PythonLexState::Unpack(state);
+    LineScanner scanner(*this, text, lex, tokens);
+    scanner.Run();
+    return lex.Pack();
+}
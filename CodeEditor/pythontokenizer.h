@@ -0,0 +1,88 @@
+/*
+Python tokenizer used by PythonSyntaxHighlighter
+Word lists come from pythonsyntaxhighlighter.cpp (X11 license, see that file).
+*/
+
+#ifndef PYTHONTOKENIZER_H
+#define PYTHONTOKENIZER_H
+
+#include <QSet>
+#include <QString>
+#include <QVector>
+
+// What a piece of a line is, the highlighter picks a format for each kind
+enum PythonTokenKind {
+    TOKEN_KEYWORD,
+    TOKEN_OPERATOR,
+    TOKEN_BRACE,
+    TOKEN_BUILTIN,
+    TOKEN_EXCEPT,
+    TOKEN_HACKISH,
+    TOKEN_PRIVATE,
+    TOKEN_SPECIAL,
+    TOKEN_BYTES,
+    TOKEN_STRING,
+    TOKEN_STRING_LONG,
+    TOKEN_NUMBER,
+    TOKEN_BUG,
+    TOKEN_COMMENT,
+    TOKEN_KIND_COUNT
+};
+
+// Tokens of a line are in order and never overlap
+struct PythonToken {
+    int start;
+    int length;
+    int kind;
+};
+typedef QVector<PythonToken> PythonTokens;
+
+// Open string at the end of a line
+enum PythonStringKind {
+    STRING_NONE = 0,
+    STRING_SHORT = 1, // 'x' or "x" continued with a backslash
+    STRING_LONG = 2 // ''' or """
+};
+
+// Bracket depth saturates here, deeper nesting is not told apart
+#define PYTHON_MAX_BRACKETS 31
+#define PYTHON_MAX_FORMAT_DEPTH 7
+
+// Everything the lexer carries from one line to the next
+// Packed into the block state, so QSyntaxHighlighter stops going down the
+// document as soon as a line ends in the same state as before.
+struct PythonLexState {
+    int string; // PythonStringKind
+    bool doubleQuote;
+    bool raw;
+    bool bytes;
+    bool format; // f-string
+    int formatDepth; // open { of an f-string expression
+    int brackets; // open ( [ { outside strings
+    bool continued; // line ended with a backslash outside strings
+
+    PythonLexState();
+    static PythonLexState Unpack(int state); // -1 (no state) is the default
+    int Pack() const;
+};
+
+// Splits one line of python into tokens
+// Only the packed state is carried between lines and the word sets are
+// never changed after construction, so one instance can be used from
+// several threads at once.
+class PythonTokenizer {
+  public:
+    PythonTokenizer();
+    // Appends tokens of text to tokens, returns the state at the end of line
+    int Tokenize(const QString &text, int state, PythonTokens &tokens) const;
+    int WordKind(const QString &word) const; // -1 for plain names
+    // "# %%" (or "#%%") at the start of a line, begins a cell
+    static bool IsCellMarker(const QString &text);
+
+  private:
+    QSet<QString> keywords;
+    QSet<QString> builtins;
+    QSet<QString> exceptions;
+};
+
+#endif // PYTHONTOKENIZER_H
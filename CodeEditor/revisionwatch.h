@@ -0,0 +1,30 @@
+#ifndef REVISIONWATCH_H
+#define REVISIONWATCH_H
+
+#include <QTextDocument>
+
+// Tells real edits apart in a document's contentsChange signals
+// WHY:
+// The highlighter reports every line it formats as a change too, those
+// leave the revision alone
+class RevisionWatch {
+  public:
+    explicit RevisionWatch(const QTextDocument *document)
+        : m_document(document), m_seen(document->revision()) {}
+
+    // True once for each new revision, call it on every contentsChange
+    bool Edited() {
+        int revision = m_document->revision();
+        if (revision == m_seen) {
+            return false;
+        }
+        m_seen = revision;
+        return true;
+    }
+
+  private:
+    const QTextDocument *m_document;
+    int m_seen;
+};
+
+#endif // REVISIONWATCH_H
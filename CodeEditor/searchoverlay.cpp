@@ -0,0 +1,251 @@
+#include "CodeEditor/searchoverlay.h"
+#include <QTextBlock>
+#include <QTextDocument>
+#include <QtConcurrent>
+#include <algorithm>
+
+static bool StartsBefore(const SearchMatch &a, const SearchMatch &b) {
+    return a.start < b.start;
+}
+
+static bool SameMatch(const SearchMatch &a, const SearchMatch &b) {
+    return a.start == b.start && a.length == b.length;
+}
+
+SearchOverlay::SearchOverlay(CodeEditor *editor)
+    : QObject(editor), m_editor(editor), m_version(0), m_searchVersion(-1),
+      m_firstVisible(0), m_lastVisible(0) {
+    m_format.setForeground(QColor("black"));
+    m_format.setBackground(QColor("yellow"));
+    m_retryTimer.setSingleShot(true);
+    m_retryTimer.setInterval(SEARCH_RETRY_DELAY_MS);
+    connect(&m_retryTimer, &QTimer::timeout, this, &SearchOverlay::StartSearch);
+    connect(&m_searchWatcher, &QFutureWatcher<SearchMatches>::finished, this,
+            &SearchOverlay::SearchDone);
+    connect(editor->document(), &QTextDocument::contentsChange, this,
+            &SearchOverlay::DocumentChanged);
+    connect(editor, &CodeEditor::VisibleBlocksChanged, this,
+            &SearchOverlay::SetVisibleBlocks);
+}
+
+SearchOverlay::~SearchOverlay() {
+    // Worker holds a pointer to m_version, make it stop and wait for it
+    m_version.ref();
+    m_searchWatcher.waitForFinished();
+}
+
+void SearchOverlay::SetPattern(const QString &pattern) {
+    m_version.ref();
+    m_regex = QRegularExpression(pattern);
+    m_matches.clear();
+    UpdateSelections();
+    if (!IsActive()) {
+        emit MatchesChanged(0, 0);
+        return;
+    }
+    // WHY:
+    // Compiled (and JIT compiled) once here, the worker and every edit
+    // afterwards share the same compiled pattern
+    m_regex.optimize();
+    StartSearch();
+}
+
+int SearchOverlay::MatchCount() const {
+    return m_matches.size();
+}
+
+int SearchOverlay::CurrentMatch() const {
+    QTextCursor cursor = m_editor->textCursor();
+    int index = LowerBound(cursor.selectionStart());
+    if (index < m_matches.size()) {
+        const SearchMatch &match = m_matches.at(index);
+        if (match.start == cursor.selectionStart() &&
+                match.start + match.length == cursor.selectionEnd()) {
+            return index + 1;
+        }
+    }
+    return 0;
+}
+
+void SearchOverlay::FindNext() {
+    if (m_matches.isEmpty()) {
+        return;
+    }
+    int index = LowerBound(m_editor->textCursor().selectionEnd());
+    Select(index < m_matches.size() ? index : 0);
+}
+
+void SearchOverlay::FindPrevious() {
+    if (m_matches.isEmpty()) {
+        return;
+    }
+    int index = LowerBound(m_editor->textCursor().selectionStart()) - 1;
+    Select(index >= 0 ? index : m_matches.size() - 1);
+}
+
+void SearchOverlay::Select(int index) {
+    const SearchMatch &match = m_matches.at(index);
+    QTextCursor cursor(m_editor->document());
+    cursor.setPosition(match.start);
+    cursor.setPosition(match.start + match.length, QTextCursor::KeepAnchor);
+    m_editor->setTextCursor(cursor);
+    m_editor->ensureCursorVisible();
+    emit MatchesChanged(index + 1, m_matches.size());
+}
+
+void SearchOverlay::SetVisibleBlocks(int first, int last) {
+    m_firstVisible = first;
+    m_lastVisible = last;
+    UpdateSelections();
+}
+
+// Only matches on screen become selections, scrolling rebuilds them
+void SearchOverlay::UpdateSelections() {
+    QList<QTextEdit::ExtraSelection> selections;
+    QTextDocument *document = m_editor->document();
+    QTextBlock first = document->findBlockByNumber(m_firstVisible);
+    QTextBlock last = document->findBlockByNumber(m_lastVisible);
+    if (!last.isValid()) {
+        last = document->lastBlock();
+    }
+    if (first.isValid() && !m_matches.isEmpty()) {
+        int end = last.position() + last.length();
+        for (int i = LowerBound(first.position());
+                i < m_matches.size() && m_matches.at(i).start < end; i++) {
+            const SearchMatch &match = m_matches.at(i);
+            QTextEdit::ExtraSelection selection;
+            selection.format = m_format;
+            selection.cursor = QTextCursor(document);
+            selection.cursor.setPosition(match.start);
+            selection.cursor.setPosition(match.start + match.length,
+                                         QTextCursor::KeepAnchor);
+            selections.append(selection);
+        }
+    }
+    m_editor->SetLayerSelections(SELECTION_SEARCH, selections);
+}
+
+// First match starting at or after position
+int SearchOverlay::LowerBound(int position) const {
+    SearchMatch key = {position, 0};
+    return std::lower_bound(m_matches.constBegin(), m_matches.constEnd(), key,
+                            StartsBefore) - m_matches.constBegin();
+}
+
+bool SearchOverlay::IsActive() const {
+    return !m_regex.pattern().isEmpty() && m_regex.isValid();
+}
+
+// Searches the lines an edit touched again and moves the matches after them
+void SearchOverlay::DocumentChanged(int position, int charsRemoved,
+                                    int charsAdded) {
+    if (!IsActive()) {
+        return;
+    }
+    if (m_searchWatcher.isRunning() || m_retryTimer.isActive()) {
+        // Full search result is outdated now, it is done again
+        m_version.ref();
+        return;
+    }
+    QTextDocument *document = m_editor->document();
+    QTextBlock first = document->findBlock(position);
+    QTextBlock last = document->findBlock(position + charsAdded);
+    if (!first.isValid()) {
+        return;
+    }
+    if (!last.isValid()) {
+        last = document->lastBlock();
+    }
+    int delta = charsAdded - charsRemoved;
+    int from = first.position();
+    // Text after the edit is unchanged, so is its end in old positions
+    int oldEnd = last.position() + last.length() - delta;
+
+    SearchMatches found;
+    for (QTextBlock block = first; block.isValid(); block = block.next()) {
+        MatchLine(m_regex, block.text(), block.position(), found);
+        if (block == last) {
+            break;
+        }
+    }
+    int begin = LowerBound(from);
+    int end = LowerBound(oldEnd);
+    if (delta == 0 && end - begin == found.size() &&
+            std::equal(found.constBegin(), found.constEnd(),
+                       m_matches.constBegin() + begin, SameMatch)) {
+        // Nothing moved, e.g. the highlighter reformatting a line
+        return;
+    }
+    SearchMatches matches;
+    matches.reserve(m_matches.size() - (end - begin) + found.size());
+    matches += m_matches.mid(0, begin);
+    matches += found;
+    for (int i = end; i < m_matches.size(); i++) {
+        SearchMatch match = m_matches.at(i);
+        match.start += delta;
+        matches.append(match);
+    }
+    int count = m_matches.size();
+    m_matches = matches;
+    UpdateSelections();
+    if (count != m_matches.size()) {
+        emit MatchesChanged(CurrentMatch(), m_matches.size());
+    }
+}
+
+void SearchOverlay::StartSearch() {
+    if (!IsActive()) {
+        return;
+    }
+    if (m_searchWatcher.isRunning()) {
+        // It stops early when outdated, SearchDone retries
+        return;
+    }
+    m_searchVersion = m_version.load();
+    m_searchWatcher.setFuture(QtConcurrent::run(&SearchOverlay::SearchText,
+                              m_editor->document()->toPlainText(), m_regex,
+                              m_searchVersion, &m_version));
+}
+
+void SearchOverlay::SearchDone() {
+    if (m_searchVersion != m_version.load()) {
+        m_retryTimer.start();
+        return;
+    }
+    m_matches = m_searchWatcher.result();
+    UpdateSelections();
+    emit MatchesChanged(CurrentMatch(), m_matches.size());
+}
+
+void SearchOverlay::MatchLine(const QRegularExpression &regex,
+                              const QString &text, int offset,
+                              SearchMatches &matches) {
+    QRegularExpressionMatchIterator iterator = regex.globalMatch(text);
+    while (iterator.hasNext()) {
+        QRegularExpressionMatch match = iterator.next();
+        if (match.capturedLength() == 0) {
+            // Nothing to paint, e.g. "x*" between two letters
+            continue;
+        }
+        SearchMatch found = {offset + match.capturedStart(),
+                             match.capturedLength()
+                            };
+        matches.append(found);
+    }
+}
+
+// Runs on a pool thread, lines are matched one by one like the editor does
+SearchMatches SearchOverlay::SearchText(QString text, QRegularExpression regex,
+                                        int version, QAtomicInt *current) {
+    SearchMatches matches;
+    QStringList lines = text.split(QChar('\n'));
+    int offset = 0;
+    for (int i = 0; i < lines.size(); i++) {
+        if (i % 256 == 0 && current->load() != version) {
+            return SearchMatches();
+        }
+        MatchLine(regex, lines.at(i), offset, matches);
+        offset += lines.at(i).length() + 1;
+    }
+    return matches;
+}
@@ -0,0 +1,69 @@
+#ifndef SEARCHOVERLAY_H
+#define SEARCHOVERLAY_H
+
+#include <QAtomicInt>
+#include <QFutureWatcher>
+#include <QRegularExpression>
+#include <QTextCharFormat>
+#include <QTimer>
+#include <QVector>
+#include "CodeEditor/codeeditor.h"
+
+// An outdated search is retried after edits stop for this long
+#define SEARCH_RETRY_DELAY_MS 150
+
+// Position in the document, a match never spans lines
+struct SearchMatch {
+    int start;
+    int length;
+};
+typedef QVector<SearchMatch> SearchMatches;
+
+// Marks regex matches in a CodeEditor without touching the document
+// Matches are kept sorted by position, the ones on screen are found with a
+// binary search and painted as extra selections. The whole document is
+// searched on a worker thread, an edit only searches the lines it touched.
+class SearchOverlay : public QObject {
+    Q_OBJECT
+  public:
+    explicit SearchOverlay(CodeEditor *editor);
+    ~SearchOverlay();
+    void SetPattern(const QString &pattern);
+    bool IsActive() const; // has a valid pattern
+    int MatchCount() const;
+    int CurrentMatch() const; // 1 based, 0 when no match is selected
+    void FindNext();
+    void FindPrevious();
+
+  signals:
+    void MatchesChanged(int current, int count);
+
+  public slots:
+    void SetVisibleBlocks(int first, int last);
+
+  private slots:
+    void DocumentChanged(int position, int charsRemoved, int charsAdded);
+    void StartSearch();
+    void SearchDone();
+
+  private:
+    CodeEditor *m_editor;
+    QRegularExpression m_regex;
+    SearchMatches m_matches;
+    QTextCharFormat m_format;
+    QAtomicInt m_version; // bumped on edits while a search runs
+    int m_searchVersion;
+    QFutureWatcher<SearchMatches> m_searchWatcher;
+    QTimer m_retryTimer;
+    int m_firstVisible;
+    int m_lastVisible;
+    int LowerBound(int position) const;
+    void Select(int index);
+    void UpdateSelections();
+    static void MatchLine(const QRegularExpression &regex, const QString &text,
+                          int offset, SearchMatches &matches);
+    static SearchMatches SearchText(QString text, QRegularExpression regex,
+                                    int version, QAtomicInt *current);
+};
+
+#endif // SEARCHOVERLAY_H
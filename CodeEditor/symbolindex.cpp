@@ -0,0 +1,365 @@
+#include "CodeEditor/symbolindex.h"
+#include <QTextBlock>
+#include <QtConcurrent>
+
+static int IndentOf(const QString &text) {
+    int indent = 0;
+    while (indent < text.length() &&
+            (text.at(indent) == ' ' || text.at(indent) == '\t')) {
+        indent++;
+    }
+    return indent;
+}
+
+static bool IsNameStart(QChar c) {
+    return c.isLetter() || c == QLatin1Char('_');
+}
+
+static bool IsNameChar(QChar c) {
+    return c.isLetterOrNumber() || c == QLatin1Char('_');
+}
+
+// Name starting at position, empty when there is none
+static QString NameAt(const QString &text, int position) {
+    if (position >= text.length() || !IsNameStart(text.at(position))) {
+        return QString();
+    }
+    int end = position + 1;
+    while (end < text.length() && IsNameChar(text.at(end))) {
+        end++;
+    }
+    return text.mid(position, end - position);
+}
+
+static int SkipSpaces(const QString &text, int position) {
+    while (position < text.length() && text.at(position) == ' ') {
+        position++;
+    }
+    return position;
+}
+
+static bool SameSymbols(const Symbols &a, const Symbols &b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (int i = 0; i < a.size(); i++) {
+        if (a.at(i).name != b.at(i).name || a.at(i).kind != b.at(i).kind ||
+                a.at(i).indent != b.at(i).indent) {
+            return false;
+        }
+    }
+    return true;
+}
+
+SymbolIndex::SymbolIndex(QTextDocument *document)
+    : QObject(document), m_document(document), m_symbolsChanged(true),
+      m_lineCount(-1), m_version(0), m_parseVersion(-1) {
+    IndexedLine empty = {true, Symbols(), QStringList()};
+    m_lines.fill(empty, document->blockCount());
+    m_delayTimer.setSingleShot(true);
+    m_delayTimer.setInterval(SYMBOL_INDEX_DELAY_MS);
+    connect(&m_delayTimer, &QTimer::timeout, this, &SymbolIndex::StartParse);
+    connect(&m_parseWatcher, &QFutureWatcher<IndexedLines>::finished, this,
+            &SymbolIndex::ParseDone);
+    connect(document, &QTextDocument::contentsChange, this,
+            &SymbolIndex::DocumentChanged);
+    StartParse();
+}
+
+SymbolIndex::~SymbolIndex() {
+    // Worker holds a pointer to m_version, make it stop and wait for it
+    m_version.ref();
+    m_parseWatcher.waitForFinished();
+}
+
+// Lines of the edit are marked for parsing, lines after it just move
+// WHY:
+// A marked line keeps its old names until it is parsed again, so the
+// completer does not lose and regain every word on each key press
+void SymbolIndex::DocumentChanged(int position, int /* charsRemoved */,
+                                  int charsAdded) {
+    m_version.ref();
+    QTextBlock first = m_document->findBlock(position);
+    QTextBlock last = m_document->findBlock(position + charsAdded);
+    if (!first.isValid()) {
+        return;
+    }
+    if (!last.isValid()) {
+        last = m_document->lastBlock();
+    }
+    int from = first.blockNumber();
+    int count = last.blockNumber() - from + 1;
+    int oldCount = count - (m_document->blockCount() - m_lines.size());
+    if (oldCount < 1 || from + oldCount > m_lines.size()) {
+        // Out of step, e.g. changed before the index was made
+        from = 0;
+        count = m_document->blockCount();
+        oldCount = m_lines.size();
+    }
+
+    for (int i = from; i < from + oldCount; i++) {
+        m_lines[i].dirty = true;
+    }
+    if (oldCount > count) {
+        for (int i = from + count; i < from + oldCount; i++) {
+            CountWords(m_lines.at(i).words, -1);
+            m_symbolsChanged = m_symbolsChanged || !m_lines.at(i).symbols.isEmpty();
+        }
+        m_lines.remove(from + count, oldCount - count);
+    } else if (count > oldCount) {
+        IndexedLine empty = {true, Symbols(), QStringList()};
+        m_lines.insert(from + oldCount, count - oldCount, empty);
+    }
+    m_delayTimer.start();
+}
+
+void SymbolIndex::StartParse() {
+    if (m_parseWatcher.isRunning()) {
+        // It stops early when outdated, ParseDone starts again
+        return;
+    }
+    m_parseLines.clear();
+    QStringList texts;
+    QVector<int> states;
+    QTextBlock block;
+    for (int i = 0; i < m_lines.size(); i++) {
+        if (!m_lines.at(i).dirty) {
+            continue;
+        }
+        block = (block.isValid() && block.blockNumber() == i - 1) ? block.next()
+                : m_document->findBlockByNumber(i);
+        if (!block.isValid()) {
+            break;
+        }
+        QTextBlock previous = block.previous();
+        m_parseLines.append(i);
+        texts.append(block.text());
+        states.append(previous.isValid() ? previous.userState() : -1);
+    }
+    if (m_parseLines.isEmpty()) {
+        return;
+    }
+    m_parseVersion = m_version.load();
+    m_parseWatcher.setFuture(QtConcurrent::run(&SymbolIndex::ParseLines,
+                             &m_tokenizer, texts, states, m_parseVersion,
+                             &m_version));
+}
+
+void SymbolIndex::ParseDone() {
+    if (m_parseVersion != m_version.load()) {
+        // Lines moved meanwhile, they are still marked and done again
+        m_delayTimer.start();
+        return;
+    }
+    IndexedLines parsed = m_parseWatcher.result();
+    for (int i = 0; i < parsed.size(); i++) {
+        IndexedLine &line = m_lines[m_parseLines.at(i)];
+        CountWords(line.words, -1);
+        CountWords(parsed.at(i).words, 1);
+        if (!SameSymbols(line.symbols, parsed.at(i).symbols)) {
+            m_symbolsChanged = true;
+        }
+        line = parsed.at(i);
+    }
+    m_parseLines.clear();
+
+    if (m_symbolsChanged) {
+        m_symbolsChanged = false;
+        m_lineCount = m_lines.size();
+        emit SymbolsChanged();
+    } else if (m_lineCount != m_lines.size()) {
+        // Same symbols, inserted or removed lines moved some of them
+        m_lineCount = m_lines.size();
+        emit SymbolsMoved();
+    }
+    if (!m_wordDeltas.isEmpty()) {
+        QHash<QString, int> uses = m_wordDeltas;
+        m_wordDeltas.clear();
+        emit WordsChanged(uses);
+    }
+}
+
+// Collects changes in the number of lines using each name, a line parsed
+// again with the same names cancels out
+void SymbolIndex::CountWords(const QStringList &words, int delta) {
+    foreach (const QString &word, words) {
+        int &count = m_wordDeltas[word];
+        count += delta;
+        if (count == 0) {
+            m_wordDeltas.remove(word);
+        }
+    }
+}
+
+// Classes and functions nest by indent, the line numbers are filled in
+Symbols SymbolIndex::Outline() const {
+    Symbols outline;
+    QVector<int> open; // indents of the enclosing classes and functions
+    for (int i = 0; i < m_lines.size(); i++) {
+        foreach (const Symbol &symbol, m_lines.at(i).symbols) {
+            while (!open.isEmpty() && open.last() >= symbol.indent) {
+                open.removeLast();
+            }
+            Symbol placed = symbol;
+            placed.line = i;
+            placed.depth = open.size();
+            outline.append(placed);
+            if (symbol.kind != SYMBOL_VARIABLE) {
+                open.append(symbol.indent);
+            }
+        }
+    }
+    return outline;
+}
+
+// Closest definition above line, otherwise the first one below it
+int SymbolIndex::Definition(const QString &name, int line) const {
+    for (int i = qMin(line, m_lines.size() - 1); i >= 0; i--) {
+        foreach (const Symbol &symbol, m_lines.at(i).symbols) {
+            if (symbol.name == name) {
+                return i;
+            }
+        }
+    }
+    for (int i = qMax(line + 1, 0); i < m_lines.size(); i++) {
+        foreach (const Symbol &symbol, m_lines.at(i).symbols) {
+            if (symbol.name == name) {
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+// Names used within radius lines of line, with their distance from it
+QHash<QString, int> SymbolIndex::NearbyWords(int line, int radius) const {
+    QHash<QString, int> nearby;
+    int first = qMax(line - radius, 0);
+    int last = qMin(line + radius, m_lines.size() - 1);
+    for (int i = first; i <= last; i++) {
+        int distance = qAbs(i - line);
+        foreach (const QString &word, m_lines.at(i).words) {
+            QHash<QString, int>::iterator it = nearby.find(word);
+            if (it == nearby.end()) {
+                nearby.insert(word, distance);
+            } else if (distance < it.value()) {
+                it.value() = distance;
+            }
+        }
+    }
+    return nearby;
+}
+
+// Runs on a pool thread
+IndexedLines SymbolIndex::ParseLines(const PythonTokenizer *tokenizer,
+                                     QStringList texts, QVector<int> states,
+                                     int version, QAtomicInt *current) {
+    IndexedLines parsed(texts.size());
+    for (int i = 0; i < texts.size(); i++) {
+        if (i % 256 == 0 && current->load() != version) {
+            return IndexedLines();
+        }
+        ParseLine(*tokenizer, texts.at(i), states.at(i), parsed[i]);
+    }
+    return parsed;
+}
+
+void SymbolIndex::ParseLine(const PythonTokenizer &tokenizer,
+                            const QString &text, int state, IndexedLine &line) {
+    line.dirty = false;
+    line.symbols.clear();
+    line.words.clear();
+
+    // Names outside strings, comments and numbers
+    PythonTokens tokens;
+    tokenizer.Tokenize(text, state, tokens);
+    int token = 0;
+    int position = 0;
+    while (position < text.length()) {
+        while (token < tokens.size() &&
+                tokens.at(token).start + tokens.at(token).length <= position) {
+            token++;
+        }
+        if (token < tokens.size() && tokens.at(token).start <= position) {
+            int kind = tokens.at(token).kind;
+            if (kind == TOKEN_STRING || kind == TOKEN_STRING_LONG ||
+                    kind == TOKEN_BYTES || kind == TOKEN_COMMENT ||
+                    kind == TOKEN_NUMBER) {
+                position = tokens.at(token).start + tokens.at(token).length;
+                continue;
+            }
+        }
+        QString word = NameAt(text, position);
+        if (word.isEmpty()) {
+            position++;
+            continue;
+        }
+        position += word.length();
+        int kind = tokenizer.WordKind(word);
+        if (word.length() >= SYMBOL_MIN_WORD_LENGTH && kind != TOKEN_KEYWORD &&
+                kind != TOKEN_BUILTIN && kind != TOKEN_EXCEPT &&
+                kind != TOKEN_SPECIAL && !line.words.contains(word)) {
+            line.words.append(word);
+        }
+    }
+
+    // Definitions only start a statement
+    PythonLexState start = PythonLexState::Unpack(state);
+    if (start.string != STRING_NONE || start.brackets > 0 || start.continued) {
+        return;
+    }
+    int indent = IndentOf(text);
+    QStringRef rest = text.midRef(indent);
+    int kind = -1;
+    int nameAt = indent;
+    if (rest.startsWith("class ")) {
+        kind = SYMBOL_CLASS;
+        nameAt += 6;
+    } else if (rest.startsWith("def ")) {
+        kind = SYMBOL_FUNCTION;
+        nameAt += 4;
+    } else if (rest.startsWith("async def ")) {
+        kind = SYMBOL_FUNCTION;
+        nameAt += 10;
+    }
+    if (kind >= 0) {
+        QString name = NameAt(text, SkipSpaces(text, nameAt));
+        if (!name.isEmpty()) {
+            Symbol symbol = {name, kind, 0, indent, 0};
+            line.symbols.append(symbol);
+        }
+        return;
+    }
+    if (indent > 0) {
+        return;
+    }
+
+    // Top level assignment: a = ..., a, b = ... or a: int = ...
+    QStringList names;
+    int at = 0;
+    forever {
+        QString name = NameAt(text, at);
+        if (name.isEmpty() || tokenizer.WordKind(name) == TOKEN_KEYWORD) {
+            return;
+        }
+        names.append(name);
+        at = SkipSpaces(text, at + name.length());
+        if (at < text.length() && text.at(at) == ',') {
+            at = SkipSpaces(text, at + 1);
+            continue;
+        }
+        break;
+    }
+    if (at >= text.length()) {
+        return;
+    }
+    QChar next = text.at(at);
+    bool assigned = next == '=' && !text.midRef(at).startsWith("==");
+    bool annotated = next == ':' && names.size() == 1;
+    if (assigned || annotated) {
+        foreach (const QString &name, names) {
+            Symbol symbol = {name, SYMBOL_VARIABLE, 0, 0, 0};
+            line.symbols.append(symbol);
+        }
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef SYMBOLINDEX_H
+#define SYMBOLINDEX_H
+
+#include <QAtomicInt>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QStringList>
+#include <QTextDocument>
+#include <QTimer>
+#include <QVector>
+#include "CodeEditor/pythontokenizer.h"
+
+// Changed lines are parsed after edits stop for this long
+#define SYMBOL_INDEX_DELAY_MS 300
+// Shorter names are not offered to the completer
+#define SYMBOL_MIN_WORD_LENGTH 3
+
+enum SymbolKind {
+    SYMBOL_CLASS,
+    SYMBOL_FUNCTION,
+    SYMBOL_VARIABLE // assigned at the top level
+};
+
+struct Symbol {
+    QString name;
+    int kind; // SymbolKind
+    int line; // 0 based
+    int indent;
+    int depth; // enclosing classes and functions, filled in by Outline
+};
+typedef QVector<Symbol> Symbols;
+
+// What one line defines and which names it uses
+struct IndexedLine {
+    bool dirty; // changed since it was parsed
+    Symbols symbols;
+    QStringList words;
+};
+typedef QVector<IndexedLine> IndexedLines;
+
+// Classes, functions and top level names of a python document
+// Lines are kept in step with the document, an edit only marks the lines
+// it touched and those are parsed again on a worker thread. Lines inside
+// strings or brackets are told apart with the block states the highlighter
+// leaves behind.
+class SymbolIndex : public QObject {
+    Q_OBJECT
+  public:
+    explicit SymbolIndex(QTextDocument *document);
+    ~SymbolIndex();
+    Symbols Outline() const;
+    int Definition(const QString &name, int line) const; // -1 when unknown
+    QHash<QString, int> NearbyWords(int line, int radius) const;
+
+  signals:
+    void SymbolsChanged();
+    void SymbolsMoved(); // only their line numbers changed
+    // Change in the number of lines using each name
+    void WordsChanged(const QHash<QString, int> &uses);
+
+  private slots:
+    void DocumentChanged(int position, int charsRemoved, int charsAdded);
+    void StartParse();
+    void ParseDone();
+
+  private:
+    QTextDocument *m_document;
+    PythonTokenizer m_tokenizer; // shared with the worker, it is read only
+    IndexedLines m_lines; // one per block
+    QHash<QString, int> m_wordDeltas; // not sent with WordsChanged yet
+    bool m_symbolsChanged;
+    int m_lineCount; // when SymbolsChanged was last sent
+    QAtomicInt m_version; // bumped on every edit
+    int m_parseVersion;
+    QVector<int> m_parseLines; // sent to the worker
+    QFutureWatcher<IndexedLines> m_parseWatcher;
+    QTimer m_delayTimer;
+    void CountWords(const QStringList &words, int delta);
+    static IndexedLines ParseLines(const PythonTokenizer *tokenizer,
+                                   QStringList texts, QVector<int> states,
+                                   int version, QAtomicInt *current);
+    static void ParseLine(const PythonTokenizer &tokenizer, const QString &text,
+                          int state, IndexedLine &line);
+};
+
+#endif // SYMBOLINDEX_H
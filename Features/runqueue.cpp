@@ -0,0 +1,291 @@
+#include "Features/runqueue.h"
+#include "Features/testrunner.h"
+#include <QDir>
+#include <QTextCodec>
+#include <QThread>
+
+RunQueue::RunQueue(QObject *parent)
+    : QObject(parent), m_maxProcesses(2), m_nextId(1), m_embedded(-1) {
+    SetMaxProcesses(QThread::idealThreadCount());
+}
+
+// bootstrap is ep_case.py, it runs a code file as __main__
+void RunQueue::SetPython(const QString &python, const QString &bootstrap) {
+    m_python = python;
+    m_bootstrap = bootstrap;
+}
+
+void RunQueue::SetMaxProcesses(int maxProcesses) {
+    m_maxProcesses = qMax(1, maxProcesses);
+    Schedule();
+}
+
+// Returns the id of the run, StateChanged reports it queued before it can
+// start
+int RunQueue::Add(RunJob job) {
+    job.id = m_nextId++;
+    job.state = RUN_QUEUED;
+    job.elapsedMs = 0;
+    job.peakKb = -1;
+    job.cancelling = false;
+    m_jobs.insert(job.id, job);
+    emit StateChanged(job.id, RUN_QUEUED);
+    Schedule();
+    return job.id;
+}
+
+// A queued run is dropped, a running one is stopped
+void RunQueue::Cancel(int id) {
+    if (!m_jobs.contains(id)) {
+        return;
+    }
+    RunJob &job = m_jobs[id];
+    if (job.state == RUN_QUEUED) {
+        Finish(id, RUN_CANCELLED, 0);
+        return;
+    }
+    if (job.state != RUN_RUNNING || job.cancelling) {
+        return;
+    }
+    job.cancelling = true;
+    if (job.target == TARGET_EMBEDDED) {
+        emit StopEmbedded(id);
+        return;
+    }
+    foreach (QProcess *process, m_active.keys()) {
+        if (m_active.value(process).id == id) {
+            process->kill();
+        }
+    }
+}
+
+void RunQueue::Forget(int id) {
+    if (m_jobs.contains(id) && m_jobs.value(id).state > RUN_RUNNING) {
+        m_jobs.remove(id);
+        emit Forgotten(id);
+    }
+}
+
+bool RunQueue::Contains(int id) const {
+    return m_jobs.contains(id);
+}
+
+RunJob RunQueue::Job(int id) const {
+    return m_jobs.value(id);
+}
+
+int RunQueue::Count(int state) const {
+    int count = 0;
+    foreach (const RunJob &job, m_jobs) {
+        if (job.state == state) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// The view ran id in the interpreter, ok is false when it failed
+void RunQueue::EmbeddedFinished(int id, bool ok) {
+    if (id != m_embedded || !m_jobs.contains(id)) {
+        return;
+    }
+    m_embedded = -1;
+    int state = m_jobs.value(id).cancelling ? RUN_CANCELLED :
+                ok ? RUN_DONE : RUN_FAILED;
+    Finish(id, state, m_embeddedTimer.elapsed());
+    Schedule();
+}
+
+// WHY:
+// Only a few runs wait at a time, looking through all of them is cheaper
+// than keeping a priority queue in step with cancels
+int RunQueue::Next(int target) const {
+    int best = -1;
+    int priority = 0;
+    foreach (const RunJob &job, m_jobs) {
+        if (job.state == RUN_QUEUED && job.target == target &&
+                (best < 0 || job.priority < priority)) {
+            best = job.id;
+            priority = job.priority;
+        }
+    }
+    return best;
+}
+
+void RunQueue::Schedule() {
+    if (m_embedded < 0) {
+        int id = Next(TARGET_EMBEDDED);
+        if (id >= 0) {
+            m_embedded = id;
+            m_jobs[id].state = RUN_RUNNING;
+            m_embeddedTimer.start();
+            emit StateChanged(id, RUN_RUNNING);
+            emit StartEmbedded(id);
+        }
+    }
+    while (m_active.size() < m_maxProcesses) {
+        int id = Next(TARGET_PROCESS);
+        if (id < 0) {
+            break;
+        }
+        StartProcess(m_jobs[id]);
+    }
+}
+
+void RunQueue::StartProcess(RunJob &job) {
+    QTemporaryFile *codeFile =
+        new QTemporaryFile(QDir::tempPath() + "/ep_run_XXXXXX.py");
+    if (!codeFile->open()) {
+        delete codeFile;
+        emit Output(job.id, tr("Could not write the code to a file\n"), true);
+        Finish(job.id, RUN_FAILED, 0);
+        return;
+    }
+    codeFile->write(job.code.toUtf8());
+    codeFile->close();
+
+    QProcess *process = new QProcess(this);
+    process->setProcessChannelMode(QProcess::SeparateChannels);
+    connect(process, &QProcess::readyReadStandardOutput, this,
+            &RunQueue::ReadProcess);
+    connect(process, &QProcess::readyReadStandardError, this,
+            &RunQueue::ReadProcess);
+    connect(process,
+            static_cast<void (QProcess::*)(int, QProcess::ExitStatus)>(
+                &QProcess::finished),
+            this, &RunQueue::ProcessFinished);
+    connect(process, &QProcess::errorOccurred, this, &RunQueue::ProcessFailed);
+
+    QTextCodec *utf8 = QTextCodec::codecForName("UTF-8");
+    ActiveRun active;
+    active.id = job.id;
+    active.codeFile = codeFile;
+    active.output = utf8->makeDecoder();
+    active.errors = utf8->makeDecoder();
+    m_active.insert(process, active);
+    m_active[process].timer.start();
+
+    job.state = RUN_RUNNING;
+    emit StateChanged(job.id, RUN_RUNNING);
+    if (!job.inputFile.isEmpty()) {
+        process->setStandardInputFile(job.inputFile);
+    }
+    process->start(m_python, QStringList() << "-u"
+                   << "-c" << m_bootstrap
+                   << codeFile->fileName());
+    if (job.inputFile.isEmpty()) {
+        process->write(job.input.toUtf8());
+        process->closeWriteChannel();
+    }
+}
+
+void RunQueue::ReadProcess() {
+    QProcess *process = qobject_cast<QProcess *>(sender());
+    if (process && m_active.contains(process)) {
+        Drain(process);
+    }
+}
+
+// Peak memory written by the bootstrap on exit is kept out of the output
+void RunQueue::Drain(QProcess *process) {
+    const ActiveRun &active = m_active[process];
+    QString text = active.output->toUnicode(process->readAllStandardOutput());
+    if (!text.isEmpty()) {
+        emit Output(active.id, text, false);
+    }
+    QByteArray errors = process->readAllStandardError();
+    int marker = errors.lastIndexOf(PEAK_MEMORY_MARKER);
+    if (marker >= 0) {
+        int start = marker + QByteArray(PEAK_MEMORY_MARKER).length();
+        int end = errors.indexOf('\n', start);
+        bool ok;
+        qint64 value = errors.mid(start, end < 0 ? -1 : end - start).trimmed()
+                       .toLongLong(&ok);
+        if (ok) {
+            m_jobs[active.id].peakKb = value;
+        }
+        // The bootstrap starts the marker on a new line of its own
+        errors.truncate(marker > 0 && errors.at(marker - 1) == '\n' ?
+                        marker - 1 : marker);
+    }
+    text = active.errors->toUnicode(errors);
+    if (!text.isEmpty()) {
+        emit Output(active.id, text, true);
+    }
+}
+
+void RunQueue::ProcessFinished(int exitCode, QProcess::ExitStatus exitStatus) {
+    QProcess *process = qobject_cast<QProcess *>(sender());
+    if (!process || !m_active.contains(process)) {
+        return;
+    }
+    Drain(process);
+    ActiveRun active = m_active.take(process);
+    int state = m_jobs.value(active.id).cancelling ? RUN_CANCELLED :
+                (exitStatus == QProcess::NormalExit && exitCode == 0) ? RUN_DONE :
+                RUN_FAILED;
+    delete active.codeFile; // removes the temporary file
+    delete active.output;
+    delete active.errors;
+    process->deleteLater();
+    Finish(active.id, state, active.timer.elapsed());
+    Schedule();
+}
+
+void RunQueue::ProcessFailed(QProcess::ProcessError error) {
+    // Other errors are followed by finished()
+    if (error != QProcess::FailedToStart) {
+        return;
+    }
+    QProcess *process = qobject_cast<QProcess *>(sender());
+    if (!process || !m_active.contains(process)) {
+        return;
+    }
+    ActiveRun active = m_active.take(process);
+    delete active.codeFile;
+    delete active.output;
+    delete active.errors;
+    process->deleteLater();
+    emit Output(active.id, tr("Could not start %1\n").arg(m_python), true);
+    Finish(active.id, RUN_FAILED, 0);
+    Schedule();
+}
+
+void RunQueue::Finish(int id, int state, qint64 elapsedMs) {
+    RunJob &job = m_jobs[id];
+    job.state = state;
+    job.elapsedMs = elapsedMs;
+    emit StateChanged(id, state);
+    ForgetOld();
+}
+
+// Oldest finished runs go first
+void RunQueue::ForgetOld() {
+    int finished = 0;
+    foreach (const RunJob &job, m_jobs) {
+        if (job.state > RUN_RUNNING) {
+            finished++;
+        }
+    }
+    QList<int> ids = m_jobs.keys();
+    for (int i = 0; i < ids.size() && finished > RUN_QUEUE_KEEP_FINISHED; i++) {
+        if (m_jobs.value(ids.at(i)).state > RUN_RUNNING) {
+            m_jobs.remove(ids.at(i));
+            finished--;
+            emit Forgotten(ids.at(i));
+        }
+    }
+}
+
+RunQueue::~RunQueue() {
+    foreach (QProcess *process, m_active.keys()) {
+        process->disconnect(this);
+        process->kill();
+        process->waitForFinished(1000);
+        const ActiveRun &active = m_active[process];
+        delete active.codeFile;
+        delete active.output;
+        delete active.errors;
+    }
+    m_active.clear();
+}
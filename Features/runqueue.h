@@ -0,0 +1,117 @@
+#ifndef RUNQUEUE_H
+#define RUNQUEUE_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QMap>
+#include <QProcess>
+#include <QTemporaryFile>
+#include <QTextDecoder>
+
+// Finished runs kept, older ones are forgotten
+#define RUN_QUEUE_KEEP_FINISHED 20
+
+// Lower runs first, runs of the same priority start in the order added
+enum RunPriority {
+    PRIORITY_HIGH = 0,
+    PRIORITY_NORMAL,
+    PRIORITY_LOW
+};
+
+enum RunState {
+    RUN_QUEUED = 0,
+    RUN_RUNNING,
+    // finished states follow
+    RUN_DONE,
+    RUN_FAILED,
+    RUN_CANCELLED
+};
+
+// What started a run, the view prepares each kind its own way
+enum RunKind {
+    RUN_CODE = 0,
+    RUN_SNIPPET,
+    RUN_TUTE,
+    RUN_BACKGROUND
+};
+
+// Where a run executes
+enum RunTarget {
+    TARGET_EMBEDDED = 0, // embedded interpreter, has express_api, one at a time
+    TARGET_PROCESS // child process of its own, several at a time
+};
+
+struct RunJob {
+    int id;
+    int kind; // RunKind
+    int target; // RunTarget
+    int priority; // RunPriority
+    int state; // RunState
+    int tag; // set by the view, the tutorial question for RUN_TUTE
+    QString name;
+    QString code;
+    QString input; // child processes only, embedded runs ask the view
+    QString inputFile;
+    qint64 elapsedMs;
+    qint64 peakKb; // child processes only, -1 when unknown
+    bool cancelling;
+};
+
+// Queue of runs waiting for the embedded interpreter or a child process
+// Runs wait in the queue by priority. The embedded interpreter takes one
+// run at a time: the queue asks the view to start it with StartEmbedded and
+// is told when it ends. Background runs go to child processes started from
+// the test case bootstrap, up to a limit, and stream their output back.
+class RunQueue : public QObject {
+    Q_OBJECT
+  public:
+    explicit RunQueue(QObject *parent = 0);
+    ~RunQueue();
+    void SetPython(const QString &python, const QString &bootstrap);
+    void SetMaxProcesses(int maxProcesses);
+    int Add(RunJob job);
+    void Cancel(int id);
+    void Forget(int id); // finished runs only
+    bool Contains(int id) const;
+    RunJob Job(int id) const;
+    int Count(int state) const;
+    void EmbeddedFinished(int id, bool ok);
+
+  signals:
+    void StartEmbedded(int id);
+    void StopEmbedded(int id);
+    void Output(int id, const QString &text, bool error);
+    void StateChanged(int id, int state);
+    void Forgotten(int id);
+
+  private slots:
+    void ReadProcess();
+    void ProcessFinished(int exitCode, QProcess::ExitStatus exitStatus);
+    void ProcessFailed(QProcess::ProcessError error);
+
+  private:
+    struct ActiveRun {
+        int id;
+        QElapsedTimer timer;
+        QTemporaryFile *codeFile;
+        QTextDecoder *output; // keeps characters split between reads
+        QTextDecoder *errors;
+    };
+
+    QString m_python;
+    QString m_bootstrap;
+    int m_maxProcesses;
+    int m_nextId;
+    int m_embedded; // running in the interpreter, -1 when idle
+    QElapsedTimer m_embeddedTimer;
+    QMap<int, RunJob> m_jobs; // by id, so also in the order added
+    QMap<QProcess *, ActiveRun> m_active;
+    int Next(int target) const;
+    void Schedule();
+    void StartProcess(RunJob &job);
+    void Drain(QProcess *process);
+    void Finish(int id, int state, qint64 elapsedMs);
+    void ForgetOld();
+};
+
+#endif // RUNQUEUE_H
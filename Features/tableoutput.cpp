@@ -0,0 +1,261 @@
+#include "Features/tableoutput.h"
+#include <QtConcurrent>
+#include <QtNumeric>
+#include <algorithm>
+
+void TableColumn::ToText() {
+    if (!numeric) {
+        return;
+    }
+    texts.reserve(numbers.size());
+    foreach (double number, numbers) {
+        texts.append(qIsNaN(number) ? QString() :
+                     QString::number(number, 'g', 15));
+    }
+    numbers = QVector<double>();
+    numeric = false;
+}
+
+// Empty cells are NaN in numeric columns and empty strings otherwise
+void TableColumn::PadTo(int rows) {
+    if (numeric) {
+        while (numbers.size() < rows) {
+            numbers.append(qQNaN());
+        }
+    } else if (texts.size() < rows) {
+        texts.resize(rows);
+    }
+}
+
+TableOutputModel::TableOutputModel(QObject *parent)
+    : QAbstractTableModel(parent), m_rowCount(0), m_sortColumn(-1),
+      m_sortOrder(Qt::AscendingOrder), m_revision(0), m_sortRevision(-1) {
+    qRegisterMetaType<TableColumns>("TableColumns");
+    connect(&m_sortWatcher, &QFutureWatcher<QVector<int>>::finished, this,
+            &TableOutputModel::SortDone);
+    m_resortTimer.setSingleShot(true);
+    m_resortTimer.setInterval(TABLE_RESORT_DELAY_MS);
+    connect(&m_resortTimer, &QTimer::timeout, this, &TableOutputModel::StartSort);
+}
+
+int TableOutputModel::rowCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : m_rowCount;
+}
+
+int TableOutputModel::columnCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : m_columns.size();
+}
+
+QVariant TableOutputModel::data(const QModelIndex &index, int role) const {
+    if (!index.isValid() || index.row() >= m_rowCount) {
+        return QVariant();
+    }
+    int row = m_order.isEmpty() ? index.row() : m_order.at(index.row());
+    const TableColumn &column = m_columns.at(index.column());
+    if (role == Qt::TextAlignmentRole) {
+        return column.numeric ? int(Qt::AlignRight | Qt::AlignVCenter) :
+               int(Qt::AlignLeft | Qt::AlignVCenter);
+    }
+    if (role != Qt::DisplayRole || row >= column.size()) {
+        return QVariant();
+    }
+    if (column.numeric) {
+        double number = column.numbers.at(row);
+        return qIsNaN(number) ? QVariant() : QVariant(number);
+    }
+    return column.texts.at(row);
+}
+
+QVariant TableOutputModel::headerData(int section, Qt::Orientation orientation,
+                                      int role) const {
+    if (role != Qt::DisplayRole) {
+        return QVariant();
+    }
+    if (orientation == Qt::Vertical) {
+        return section + 1;
+    }
+    if (section < 0 || section >= m_columns.size()) {
+        return QVariant();
+    }
+    const QString &name = m_columns.at(section).name;
+    return name.isEmpty() ? QString::number(section + 1) : name;
+}
+
+void TableOutputModel::Clear(const QStringList &headers) {
+    beginResetModel();
+    m_columns.clear();
+    foreach (const QString &header, headers) {
+        TableColumn column;
+        column.name = header;
+        m_columns.append(column);
+    }
+    m_rowCount = 0;
+    m_order.clear();
+    m_sortColumn = -1;
+    m_revision++;
+    m_resortTimer.stop();
+    endResetModel();
+}
+
+// Columns are appended side by side, missing cells stay empty
+void TableOutputModel::AppendColumns(const TableColumns &columns) {
+    int added = 0;
+    foreach (const TableColumn &column, columns) {
+        added = qMax(added, column.size());
+    }
+    if (columns.size() > m_columns.size()) {
+        beginInsertColumns(QModelIndex(), m_columns.size(), columns.size() - 1);
+        for (int i = m_columns.size(); i < columns.size(); i++) {
+            TableColumn column;
+            column.name = columns.at(i).name;
+            m_columns.append(column);
+        }
+        endInsertColumns();
+    }
+    if (added == 0) {
+        return;
+    }
+
+    beginInsertRows(QModelIndex(), m_rowCount, m_rowCount + added - 1);
+    for (int i = 0; i < m_columns.size(); i++) {
+        TableColumn &target = m_columns[i];
+        TableColumn source = i < columns.size() ? columns.at(i) : TableColumn();
+        if (target.name.isEmpty()) {
+            target.name = source.name;
+        }
+        // Pad so the new cells line up with the new rows
+        target.PadTo(m_rowCount);
+        if (target.numeric && source.numeric) {
+            target.numbers += source.numbers;
+        } else {
+            target.ToText();
+            source.ToText();
+            target.texts += source.texts;
+        }
+    }
+    for (int row = m_rowCount; row < m_rowCount + added; row++) {
+        if (!m_order.isEmpty()) {
+            m_order.append(row);
+        }
+    }
+    m_rowCount += added;
+    m_revision++;
+    endInsertRows();
+
+    if (m_sortColumn >= 0) {
+        m_resortTimer.start();
+    }
+}
+
+void TableOutputModel::sort(int column, Qt::SortOrder order) {
+    if (column < 0 || column >= m_columns.size()) {
+        return;
+    }
+    m_sortColumn = column;
+    m_sortOrder = order;
+    StartSort();
+}
+
+void TableOutputModel::StartSort() {
+    if (m_sortColumn < 0 || m_sortColumn >= m_columns.size()) {
+        return;
+    }
+    // WHY:
+    // Column is implicitly shared, the worker gets it without a copy
+    // and the GUI thread can keep appending (which detaches)
+    m_sortRevision = m_revision;
+    emit SortStarted();
+    m_sortWatcher.setFuture(QtConcurrent::run(
+                                &TableOutputModel::SortedOrder, m_columns.at(m_sortColumn),
+                                m_rowCount, m_sortOrder));
+}
+
+void TableOutputModel::SortDone() {
+    if (m_sortRevision != m_revision) {
+        // Data changed meanwhile, resort timer is already pending
+        return;
+    }
+    QVector<int> order = m_sortWatcher.result();
+    emit layoutAboutToBeChanged(QList<QPersistentModelIndex>(),
+                                QAbstractItemModel::VerticalSortHint);
+    // Selection and current cell follow their rows
+    QModelIndexList from = persistentIndexList();
+    if (!from.isEmpty()) {
+        QVector<int> position(m_rowCount);
+        for (int row = 0; row < m_rowCount; row++) {
+            position[order.at(row)] = row;
+        }
+        QModelIndexList to;
+        foreach (const QModelIndex &index, from) {
+            int stored = m_order.isEmpty() ? index.row() : m_order.at(index.row());
+            to.append(this->index(position.at(stored), index.column()));
+        }
+        changePersistentIndexList(from, to);
+    }
+    m_order = order;
+    emit layoutChanged(QList<QPersistentModelIndex>(),
+                       QAbstractItemModel::VerticalSortHint);
+    emit SortFinished();
+}
+
+// Runs on a pool thread, only touches its own copy of the column
+QVector<int> TableOutputModel::SortedOrder(TableColumn column, int rowCount,
+        Qt::SortOrder order) {
+    QVector<int> rows(rowCount);
+    for (int i = 0; i < rowCount; i++) {
+        rows[i] = i;
+    }
+    int size = column.size();
+    // Empty cells go last in both directions
+    bool ascending = (order == Qt::AscendingOrder);
+    if (column.numeric) {
+        const QVector<double> &keys = column.numbers;
+        // NaN counts as empty, it would break the ordering otherwise
+        auto missing = [&](int row) {
+            return row >= size || qIsNaN(keys.at(row));
+        };
+        std::stable_sort(rows.begin(), rows.end(), [&](int a, int b) {
+            if (missing(a) || missing(b)) {
+                return !missing(a) && missing(b);
+            }
+            return ascending ? keys.at(a) < keys.at(b) : keys.at(b) < keys.at(a);
+        });
+    } else {
+        const QVector<QString> &keys = column.texts;
+        std::stable_sort(rows.begin(), rows.end(), [&](int a, int b) {
+            if (a >= size || b >= size) {
+                return a < size && b >= size;
+            }
+            int result = keys.at(a).compare(keys.at(b), Qt::CaseInsensitive);
+            return ascending ? result < 0 : result > 0;
+        });
+    }
+    return rows;
+}
+
+QString TableOutputModel::CellText(int column, int row) const {
+    QVariant value = data(index(row, column));
+    if (value.type() == QVariant::Double) {
+        return QString::number(value.toDouble(), 'g', 15);
+    }
+    return value.toString();
+}
+
+// Tab separated, in the order shown, pastes cleanly into spreadsheets
+QString TableOutputModel::ToText(int maxRows) const {
+    int rows = (maxRows < 0) ? m_rowCount : qMin(maxRows, m_rowCount);
+    QStringList lines;
+    QStringList headers;
+    for (int column = 0; column < m_columns.size(); column++) {
+        headers.append(headerData(column, Qt::Horizontal).toString());
+    }
+    lines.append(headers.join("\t"));
+    for (int row = 0; row < rows; row++) {
+        QStringList cells;
+        for (int column = 0; column < m_columns.size(); column++) {
+            cells.append(CellText(column, row));
+        }
+        lines.append(cells.join("\t"));
+    }
+    return lines.join("\n");
+}
@@ -0,0 +1,75 @@
+#ifndef TABLEOUTPUT_H
+#define TABLEOUTPUT_H
+
+#include <QAbstractTableModel>
+#include <QFutureWatcher>
+#include <QMetaType>
+#include <QStringList>
+#include <QTimer>
+#include <QVector>
+
+// Sorting waits this long after the last append before restarting
+#define TABLE_RESORT_DELAY_MS 250
+
+// One column of table output, a column is either all numbers or all text
+// Missing cells are NaN in numeric columns
+struct TableColumn {
+    QString name;
+    bool numeric;
+    QVector<double> numbers;
+    QVector<QString> texts;
+
+    TableColumn() : numeric(true) {}
+    int size() const {
+        return numeric ? numbers.size() : texts.size();
+    }
+    void ToText();
+    void PadTo(int rows);
+};
+typedef QVector<TableColumn> TableColumns;
+Q_DECLARE_METATYPE(TableColumns)
+
+// Table output dock's model, rows are never stored as objects
+// Data is kept per column so a million rows is a few flat arrays,
+// sorting only builds a row order on a background thread
+class TableOutputModel : public QAbstractTableModel {
+    Q_OBJECT
+  public:
+    explicit TableOutputModel(QObject *parent = 0);
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const;
+    QVariant data(const QModelIndex &index,
+                  int role = Qt::DisplayRole) const;
+    QVariant headerData(int section, Qt::Orientation orientation,
+                        int role = Qt::DisplayRole) const;
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder);
+    QString ToText(int maxRows = -1) const;
+
+  signals:
+    void SortStarted();
+    void SortFinished();
+
+  public slots:
+    void Clear(const QStringList &headers);
+    void AppendColumns(const TableColumns &columns);
+
+  private slots:
+    void SortDone();
+
+  private:
+    TableColumns m_columns;
+    int m_rowCount;
+    QVector<int> m_order; // view row -> stored row, empty when not sorted
+    int m_sortColumn;
+    Qt::SortOrder m_sortOrder;
+    int m_revision; // bumped on every change, stale sorts are dropped
+    int m_sortRevision;
+    QFutureWatcher<QVector<int>> m_sortWatcher;
+    QTimer m_resortTimer;
+    void StartSort();
+    QString CellText(int column, int row) const;
+    static QVector<int> SortedOrder(TableColumn column, int rowCount,
+                                    Qt::SortOrder order);
+};
+
+#endif // TABLEOUTPUT_H
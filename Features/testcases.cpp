@@ -0,0 +1,124 @@
+#include "Features/testcases.h"
+#include <QTextStream>
+#include <QRegularExpression>
+
+TestCases::TestCases(QObject *parent) : QObject(parent) {
+    bool success;
+    LoadCases(success);
+}
+
+void TestCases::LoadCases(bool &success) {
+    success = false;
+    m_cases.clear();
+
+    QDir dir(TESTCASES_DIR);
+    if (!dir.exists()) {
+        success = true;
+        return;
+    }
+
+    QStringList inputs = dir.entryList(QStringList() << "*" TESTCASE_INPUT_EXT,
+                                       QDir::Files, QDir::Name);
+    foreach (QString fileName, inputs) {
+        TestCase testCase;
+        testCase.name = fileName.left(fileName.length() -
+                                      QString(TESTCASE_INPUT_EXT).length());
+        bool ok;
+        testCase.input = ReadFile(dir.filePath(fileName), ok);
+        if (!ok) {
+            continue;
+        }
+        // Missing expected output is allowed, case will only report time
+        testCase.expected = ReadFile(
+                                dir.filePath(testCase.name + TESTCASE_OUTPUT_EXT), ok);
+        m_cases.insert(testCase.name, testCase);
+    }
+
+    success = true;
+}
+
+void TestCases::AddCase(const QString &name, const QString &input,
+                        const QString &expected, bool &success) {
+    success = false;
+    QDir dir(TESTCASES_DIR);
+    if (!dir.exists() && !dir.mkpath(".")) {
+        return;
+    }
+
+    WriteFile(dir.filePath(name + TESTCASE_INPUT_EXT), input, success);
+    if (!success) {
+        return;
+    }
+    WriteFile(dir.filePath(name + TESTCASE_OUTPUT_EXT), expected, success);
+    if (!success) {
+        return;
+    }
+
+    TestCase testCase;
+    testCase.name = name;
+    testCase.input = input;
+    testCase.expected = expected;
+    m_cases.insert(name, testCase);
+}
+
+void TestCases::RemoveCase(const QString &name, bool &success) {
+    success = false;
+    if (!m_cases.contains(name)) {
+        return;
+    }
+
+    QDir dir(TESTCASES_DIR);
+    dir.remove(name + TESTCASE_INPUT_EXT);
+    dir.remove(name + TESTCASE_OUTPUT_EXT);
+    success = (m_cases.remove(name) > 0);
+}
+
+TestCase TestCases::GetCase(const QString &name, bool &success) {
+    success = m_cases.contains(name);
+    return m_cases.value(name);
+}
+
+bool TestCases::OkToInsert(const QString &name) {
+    return !m_cases.contains(name);
+}
+
+// WHY: The name becomes a file name, separators or .. would leave TESTCASES_DIR
+bool TestCases::IsValidName(const QString &name) {
+    static const QRegularExpression allowed("^[A-Za-z0-9_.-]+$");
+    return allowed.match(name).hasMatch() && !name.contains("..");
+}
+
+QList<QString> TestCases::GetKeys() {
+    return m_cases.keys();
+}
+
+QList<TestCase> TestCases::GetCases() {
+    return m_cases.values();
+}
+
+QString TestCases::ReadFile(const QString &fileName, bool &success) {
+    success = false;
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly | QFile::Text)) {
+        return QString();
+    }
+    QTextStream in(&file);
+    QString text = in.readAll();
+    file.close();
+    success = true;
+    return text;
+}
+
+void TestCases::WriteFile(const QString &fileName, const QString &text,
+                          bool &success) {
+    success = false;
+    QFile file(fileName);
+    if (!file.open(QFile::WriteOnly | QFile::Text)) {
+        return;
+    }
+    QTextStream out(&file);
+    out << text;
+    out.flush();
+    file.close();
+    success = true;
+}
@@ -0,0 +1,44 @@
+#ifndef TESTCASES_H
+#define TESTCASES_H
+
+#include <QObject>
+#include <QMap>
+#include <QList>
+#include <QDir>
+#include <QFile>
+#include <QApplication>
+
+#define TESTCASES_DIR QApplication::applicationDirPath() + "/testcases"
+#define TESTCASE_INPUT_EXT ".in"
+#define TESTCASE_OUTPUT_EXT ".out"
+
+// A single input / expected output pair
+struct TestCase {
+    QString name;
+    QString input;
+    QString expected;
+};
+
+// Test cases are stored as <name>.in and <name>.out pairs
+// inside TESTCASES_DIR, so they can be edited outside expressPython
+class TestCases : public QObject {
+    Q_OBJECT
+  public:
+    explicit TestCases(QObject *parent = 0);
+    void LoadCases(bool &success);
+    void AddCase(const QString &name, const QString &input,
+                 const QString &expected, bool &success);
+    void RemoveCase(const QString &name, bool &success);
+    TestCase GetCase(const QString &name, bool &success);
+    bool OkToInsert(const QString &name);
+    static bool IsValidName(const QString &name);
+    QList<QString> GetKeys();
+    QList<TestCase> GetCases();
+
+  private:
+    QMap<QString, TestCase> m_cases;
+    QString ReadFile(const QString &fileName, bool &success);
+    void WriteFile(const QString &fileName, const QString &text, bool &success);
+};
+
+#endif // TESTCASES_H
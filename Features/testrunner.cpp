@@ -0,0 +1,213 @@
+#include "Features/testrunner.h"
+#include <QDir>
+#include <QTimer>
+#include <QThread>
+
+TestRunner::TestRunner(QObject *parent)
+    : QObject(parent), m_maxWorkers(2), m_next(0), m_passed(0),
+      m_stopping(false), m_codeFile(nullptr) {
+    SetMaxWorkers(QThread::idealThreadCount());
+}
+
+void TestRunner::SetPython(const QString &python, const QString &bootstrap) {
+    m_python = python;
+    m_bootstrap = bootstrap;
+}
+
+void TestRunner::SetMaxWorkers(int maxWorkers) {
+    m_maxWorkers = qMax(1, maxWorkers);
+}
+
+bool TestRunner::IsRunning() {
+    return m_codeFile != nullptr;
+}
+
+void TestRunner::Run(const QString &code, const QList<TestCase> &cases,
+                     bool &success) {
+    success = false;
+    if (IsRunning() || cases.isEmpty()) {
+        return;
+    }
+
+    // WHY:
+    // Code is written only once, all workers share the same file
+    m_codeFile = new QTemporaryFile(QDir::tempPath() + "/ep_case_XXXXXX.py");
+    if (!m_codeFile->open()) {
+        CleanUp();
+        return;
+    }
+    m_codeFile->write(code.toUtf8());
+    m_codeFile->close();
+
+    m_cases = cases;
+    m_next = 0;
+    m_passed = 0;
+    m_stopping = false;
+    success = true;
+
+    StartNext();
+}
+
+void TestRunner::StartNext() {
+    while (!m_stopping && m_active.size() < m_maxWorkers &&
+            m_next < m_cases.size()) {
+        int index = m_next++;
+        QProcess *process = new QProcess(this);
+        process->setProcessChannelMode(QProcess::SeparateChannels);
+        connect(process,
+                static_cast<void (QProcess::*)(int, QProcess::ExitStatus)>(
+                    &QProcess::finished),
+                this, &TestRunner::ProcessFinished);
+        connect(process, &QProcess::errorOccurred, this,
+                &TestRunner::ProcessFailed);
+
+        ActiveCase active;
+        active.index = index;
+        active.timedOut = false;
+        m_active.insert(process, active);
+
+        // Kill runaway cases, timer dies with the process
+        QTimer::singleShot(CASE_TIMEOUT_MS, process, [this, process]() {
+            if (m_active.contains(process)) {
+                m_active[process].timedOut = true;
+                process->kill();
+            }
+        });
+
+        emit CaseStarted(index);
+        m_active[process].timer.start();
+        process->start(m_python, QStringList() << "-u"
+                       << "-c" << m_bootstrap
+                       << m_codeFile->fileName());
+        process->write(m_cases.at(index).input.toUtf8());
+        process->closeWriteChannel();
+    }
+
+    if (m_active.isEmpty() && (m_stopping || m_next >= m_cases.size())) {
+        int total = m_cases.size();
+        CleanUp();
+        emit Finished(m_passed, total);
+    }
+}
+
+void TestRunner::ProcessFinished(int exitCode,
+                                 QProcess::ExitStatus exitStatus) {
+    QProcess *process = qobject_cast<QProcess *>(sender());
+    if (!process || !m_active.contains(process)) {
+        return;
+    }
+
+    const ActiveCase &active = m_active[process];
+    int state;
+    if (m_stopping) {
+        state = TEST_STOPPED;
+    } else if (active.timedOut) {
+        state = TEST_TIMEOUT;
+    } else if (exitStatus != QProcess::NormalExit || exitCode != 0) {
+        state = TEST_ERROR;
+    } else {
+        QString output = QString::fromUtf8(process->readAllStandardOutput());
+        process->setProperty("output", output);
+        const QString &expected = m_cases.at(active.index).expected;
+        state = (Normalize(output) == Normalize(expected)) ? TEST_PASSED :
+                TEST_FAILED;
+    }
+    FinishCase(process, state);
+}
+
+void TestRunner::ProcessFailed(QProcess::ProcessError error) {
+    // Other errors are followed by finished()
+    if (error != QProcess::FailedToStart) {
+        return;
+    }
+    QProcess *process = qobject_cast<QProcess *>(sender());
+    if (process && m_active.contains(process)) {
+        FinishCase(process, TEST_ERROR);
+    }
+}
+
+void TestRunner::FinishCase(QProcess *process, int state) {
+    ActiveCase active = m_active.take(process);
+
+    QString output = process->property("output").toString();
+    if (output.isNull()) {
+        output = QString::fromUtf8(process->readAllStandardOutput());
+    }
+    QByteArray errors = process->readAllStandardError();
+
+    // Peak memory is reported by the bootstrap on exit, if supported
+    qint64 peakKb = -1;
+    int marker = errors.lastIndexOf(PEAK_MEMORY_MARKER);
+    if (marker >= 0) {
+        int start = marker + QByteArray(PEAK_MEMORY_MARKER).length();
+        int end = errors.indexOf('\n', start);
+        bool ok;
+        qint64 value = errors.mid(start, end < 0 ? -1 : end - start).trimmed()
+                       .toLongLong(&ok);
+        if (ok) {
+            peakKb = value;
+        }
+        errors.truncate(marker);
+    }
+    if (state == TEST_ERROR) {
+        output.append(QString::fromUtf8(errors));
+    }
+    if (state == TEST_PASSED) {
+        m_passed++;
+    }
+
+    emit CaseFinished(active.index, state, active.timer.elapsed(), peakKb,
+                      output);
+    process->deleteLater();
+    StartNext();
+}
+
+void TestRunner::Stop() {
+    if (!IsRunning()) {
+        return;
+    }
+    m_stopping = true;
+    while (m_next < m_cases.size()) {
+        emit CaseFinished(m_next++, TEST_STOPPED, 0, -1, QString());
+    }
+    if (m_active.isEmpty()) {
+        StartNext();
+        return;
+    }
+    foreach (QProcess *process, m_active.keys()) {
+        process->kill();
+    }
+}
+
+void TestRunner::CleanUp() {
+    delete m_codeFile; // removes the temporary file
+    m_codeFile = nullptr;
+    m_cases.clear();
+}
+
+// Line endings and trailing whitespace do not make a case fail
+QString TestRunner::Normalize(const QString &text) {
+    QStringList lines = text.split(QRegExp("\r\n|\r|\n"));
+    for (int i = 0; i < lines.size(); i++) {
+        int end = lines[i].length();
+        while (end > 0 && lines[i].at(end - 1).isSpace()) {
+            end--;
+        }
+        lines[i].truncate(end);
+    }
+    while (!lines.isEmpty() && lines.last().isEmpty()) {
+        lines.removeLast();
+    }
+    return lines.join("\n");
+}
+
+TestRunner::~TestRunner() {
+    m_stopping = true;
+    foreach (QProcess *process, m_active.keys()) {
+        process->disconnect(this);
+        process->kill();
+        process->waitForFinished(1000);
+    }
+    m_active.clear();
+    CleanUp();
+}
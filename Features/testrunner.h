@@ -0,0 +1,71 @@
+#ifndef TESTRUNNER_H
+#define TESTRUNNER_H
+
+#include <QObject>
+#include <QMap>
+#include <QList>
+#include <QProcess>
+#include <QElapsedTimer>
+#include <QTemporaryFile>
+#include "Features/testcases.h"
+
+// Marker written to stderr by ep_case.py, followed by peak memory in KB
+#define PEAK_MEMORY_MARKER "\x1e" "EP_PEAK_KB="
+#define CASE_TIMEOUT_MS 10000
+
+enum TestState {
+    TEST_PENDING = 0,
+    TEST_RUNNING,
+    TEST_PASSED,
+    TEST_FAILED,
+    TEST_ERROR,
+    TEST_TIMEOUT,
+    TEST_STOPPED
+};
+
+// Runs one piece of code against many test cases
+// on a bounded pool of child python processes
+class TestRunner : public QObject {
+    Q_OBJECT
+  public:
+    explicit TestRunner(QObject *parent = 0);
+    ~TestRunner();
+    void SetPython(const QString &python, const QString &bootstrap);
+    void SetMaxWorkers(int maxWorkers);
+    void Run(const QString &code, const QList<TestCase> &cases, bool &success);
+    void Stop();
+    bool IsRunning();
+
+  signals:
+    void CaseStarted(int index);
+    void CaseFinished(int index, int state, qint64 elapsedMs, qint64 peakKb,
+                      QString output);
+    void Finished(int passed, int total);
+
+  private slots:
+    void ProcessFinished(int exitCode, QProcess::ExitStatus exitStatus);
+    void ProcessFailed(QProcess::ProcessError error);
+
+  private:
+    struct ActiveCase {
+        int index;
+        QElapsedTimer timer;
+        bool timedOut;
+    };
+
+    QString m_python;
+    QString m_bootstrap;
+    int m_maxWorkers;
+    int m_next;
+    int m_passed;
+    bool m_stopping;
+    QList<TestCase> m_cases;
+    QTemporaryFile *m_codeFile;
+    QMap<QProcess *, ActiveCase> m_active;
+    void StartNext();
+    void FinishCase(QProcess *process, int state);
+    void CleanUp();
+    static QString Normalize(const QString &text);
+};
+
+#endif // TESTRUNNER_H
@@ -5,7 +5,7 @@
 #   - Bhathiya Perera
 #-------------------------------------------------
 
-QT       += core gui
+QT       += core gui concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -16,6 +16,7 @@ TEMPLATE = app
 SOURCES += main.cpp\
         UI/mainview.cpp \
     CodeEditor/pythonsyntaxhighlighter.cpp \
+    CodeEditor/pythontokenizer.cpp \
     CodeEditor/codeeditor.cpp \
     Features/snippets.cpp \
     PythonAccess/emb.cpp \
@@ -23,10 +24,24 @@ SOURCES += main.cpp\
     CodeEditor/codelineedit.cpp \
     Features/xquestion.cpp \
     Features/xtute.cpp \
-    PythonAccess/jedi.cpp 
+    PythonAccess/jedi.cpp \
+    PythonAccess/kernel.cpp \
+    Features/testcases.cpp \
+    Features/testrunner.cpp \
+    Features/runqueue.cpp \
+    Features/tableoutput.cpp \
+    CodeEditor/largefileview.cpp \
+    CodeEditor/searchoverlay.cpp \
+    CodeEditor/symbolindex.cpp \
+    CodeEditor/completionindex.cpp \
+    CodeEditor/fuzzymatcher.cpp \
+    CodeEditor/completioncache.cpp \
+    CodeEditor/diagnostics.cpp \
+    CodeEditor/calltips.cpp
 
 HEADERS  += UI/mainview.h \
     CodeEditor/pythonsyntaxhighlighter.h \
+    CodeEditor/pythontokenizer.h \
     CodeEditor/codeeditor.h \
     Features/snippets.h \
     PythonAccess/emb.h \
@@ -34,7 +49,21 @@ HEADERS  += UI/mainview.h \
     CodeEditor/codelineedit.h \
     Features/xquestion.h \
     Features/xtute.h \
-    PythonAccess/jedi.h 
+    PythonAccess/jedi.h \
+    PythonAccess/kernel.h \
+    Features/testcases.h \
+    Features/testrunner.h \
+    Features/runqueue.h \
+    Features/tableoutput.h \
+    CodeEditor/largefileview.h \
+    CodeEditor/searchoverlay.h \
+    CodeEditor/symbolindex.h \
+    CodeEditor/completionindex.h \
+    CodeEditor/fuzzymatcher.h \
+    CodeEditor/completioncache.h \
+    CodeEditor/diagnostics.h \
+    CodeEditor/revisionwatch.h \
+    CodeEditor/calltips.h
 
 FORMS    += UI/mainview.ui
 
@@ -10,9 +10,12 @@
 #pragma GCC diagnostic ignored "-Wunused-parameter"
 #pragma GCC diagnostic ignored "-Wmissing-field-initializers"
 
+#include <cstring>
 #include <functional>
 #include <iostream>
+#include <new>
 #include <string>
+#include <vector>
 
 #include "PythonAccess/emb.h"
 
@@ -28,36 +31,187 @@ void setWorker(PythonWorker *_worker) {
 MainView *getMainView() {
     return mainView;
 }
+// sys.stdout / sys.stderr replacement, text is handed to the
+// write callback as UTF-8 without intermediate copies
 struct StdOut {
     PyObject_HEAD StdOutWriteType write;
+    const char *name;
 };
+// sys.stdout.buffer, accepts any object supporting the buffer protocol
+// (bytes, bytearray, memoryview, array...) and writes it in place
+struct StdOutBuffer {
+    PyObject_HEAD PyObject *raw; // owning StdOut
+};
+extern PyTypeObject StdoutType;
+extern PyTypeObject StdoutBufferType;
+
+PyObject *StdOutNew(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+    PyObject *self = PyType_GenericNew(type, args, kwds);
+    if (self) {
+        StdOut *impl = reinterpret_cast<StdOut *>(self);
+        new (&impl->write) StdOutWriteType();
+        impl->name = "<stdout>";
+    }
+    return self;
+}
+void StdOutDealloc(PyObject *self) {
+    StdOut *impl = reinterpret_cast<StdOut *>(self);
+    impl->write.~StdOutWriteType();
+    Py_TYPE(self)->tp_free(self);
+}
+void StdOutBufferDealloc(PyObject *self) {
+    Py_XDECREF(reinterpret_cast<StdOutBuffer *>(self)->raw);
+    Py_TYPE(self)->tp_free(self);
+}
+// Send raw bytes to the owner's callback
+void StdOutSend(PyObject *raw, const char *data, Py_ssize_t size) {
+    StdOut *impl = reinterpret_cast<StdOut *>(raw);
+    if (impl->write && size > 0) {
+        impl->write(data, size);
+    }
+}
 PyObject *StdOutWrite(PyObject *self, PyObject *args) {
-    std::size_t written(0);
-    StdOut *selfimpl = reinterpret_cast<StdOut *>(self);
-    if (selfimpl->write) {
-        char *data;
-        if (!PyArg_ParseTuple(args, "s", &data))
-            return 0;
-        std::string str(data);
-        selfimpl->write(str);
-        written = str.size();
+    if (!PyUnicode_Check(args)) {
+        PyErr_Format(PyExc_TypeError, "write() argument must be str, not %.100s",
+                     Py_TYPE(args)->tp_name);
+        return 0;
     }
-    return PyLong_FromSize_t(written);
+    Py_ssize_t size;
+    // UTF-8 form is cached inside the str object, no copy is made here
+    const char *data = PyUnicode_AsUTF8AndSize(args, &size);
+    if (!data)
+        return 0;
+    StdOutSend(self, data, size);
+    return PyLong_FromSsize_t(PyUnicode_GetLength(args));
+}
+PyObject *StdOutWriteLines(PyObject *self, PyObject *args) {
+    // Join first, so many lines are a single transfer to the UI
+    PyObject *empty = PyUnicode_FromString("");
+    PyObject *joined = empty ? PyUnicode_Join(empty, args) : 0;
+    Py_XDECREF(empty);
+    if (!joined)
+        return 0;
+    PyObject *result = StdOutWrite(self, joined);
+    Py_DECREF(joined);
+    if (!result)
+        return 0;
+    Py_DECREF(result);
+    Py_RETURN_NONE;
+}
+PyObject *StdOutBufferWrite(PyObject *self, PyObject *args) {
+    Py_buffer view;
+    if (PyObject_GetBuffer(args, &view, PyBUF_SIMPLE) < 0)
+        return 0;
+    StdOutSend(reinterpret_cast<StdOutBuffer *>(self)->raw,
+               static_cast<const char *>(view.buf), view.len);
+    Py_ssize_t written = view.len;
+    PyBuffer_Release(&view);
+    return PyLong_FromSsize_t(written);
+}
+PyObject *StdOutBufferWriteLines(PyObject *self, PyObject *args) {
+    PyObject *empty = PyBytes_FromStringAndSize(0, 0);
+    PyObject *joined = empty ? PyObject_CallMethod(empty, "join", "O", args) : 0;
+    Py_XDECREF(empty);
+    if (!joined)
+        return 0;
+    PyObject *result = StdOutBufferWrite(self, joined);
+    Py_DECREF(joined);
+    if (!result)
+        return 0;
+    Py_DECREF(result);
+    Py_RETURN_NONE;
 }
 PyObject *StdOutFlush(PyObject *self, PyObject *args) {
     // no-op
     return Py_BuildValue("");
 }
+PyObject *StdOutFalse(PyObject *self, PyObject *args) {
+    Py_RETURN_FALSE;
+}
+PyObject *StdOutTrue(PyObject *self, PyObject *args) {
+    Py_RETURN_TRUE;
+}
+PyObject *StdOutFileNo(PyObject *self, PyObject *args) {
+    PyObject *io = PyImport_ImportModule("io");
+    PyObject *unsupported = io ? PyObject_GetAttrString(io, "UnsupportedOperation") : 0;
+    PyErr_SetString(unsupported ? unsupported : PyExc_OSError,
+                    "redirected stdout has no fileno");
+    Py_XDECREF(unsupported);
+    Py_XDECREF(io);
+    return 0;
+}
+PyObject *StdOutGetBuffer(PyObject *self, void *closure) {
+    // Not cached on the owner, a cached view would form a reference cycle
+    PyObject *buffer = PyType_GenericNew(&StdoutBufferType, 0, 0);
+    if (!buffer)
+        return 0;
+    Py_INCREF(self);
+    reinterpret_cast<StdOutBuffer *>(buffer)->raw = self;
+    return buffer;
+}
+PyObject *StdOutGetEncoding(PyObject *self, void *closure) {
+    return PyUnicode_FromString("utf-8");
+}
+PyObject *StdOutGetErrors(PyObject *self, void *closure) {
+    return PyUnicode_FromString("strict");
+}
+PyObject *StdOutGetName(PyObject *self, void *closure) {
+    return PyUnicode_FromString(reinterpret_cast<StdOut *>(self)->name);
+}
+PyObject *StdOutGetFalse(PyObject *self, void *closure) {
+    Py_RETURN_FALSE;
+}
+PyObject *StdOutGetTrue(PyObject *self, void *closure) {
+    Py_RETURN_TRUE;
+}
+PyObject *StdOutBufferGetRaw(PyObject *self, void *closure) {
+    PyObject *raw = reinterpret_cast<StdOutBuffer *>(self)->raw;
+    Py_INCREF(raw);
+    return raw;
+}
 PyMethodDef stdOutMethods[] = {
-    {"write", StdOutWrite, METH_VARARGS, "sys.stdout.write"},
-    {"flush", StdOutFlush, METH_VARARGS, "sys.stdout.flush"},
+    {"write", StdOutWrite, METH_O, "sys.stdout.write"},
+    {"writelines", StdOutWriteLines, METH_O, "sys.stdout.writelines"},
+    {"flush", StdOutFlush, METH_NOARGS, "sys.stdout.flush"},
+    {"close", StdOutFlush, METH_NOARGS, "sys.stdout.close, does nothing"},
+    {"isatty", StdOutFalse, METH_NOARGS, "sys.stdout.isatty"},
+    {"readable", StdOutFalse, METH_NOARGS, "sys.stdout.readable"},
+    {"seekable", StdOutFalse, METH_NOARGS, "sys.stdout.seekable"},
+    {"writable", StdOutTrue, METH_NOARGS, "sys.stdout.writable"},
+    {"fileno", StdOutFileNo, METH_NOARGS, "sys.stdout.fileno, unsupported"},
     {0, 0, 0, 0} // sentinel
 };
+PyGetSetDef stdOutGetSet[] = {
+    {const_cast<char *>("buffer"), StdOutGetBuffer, 0, 0, 0},
+    {const_cast<char *>("encoding"), StdOutGetEncoding, 0, 0, 0},
+    {const_cast<char *>("errors"), StdOutGetErrors, 0, 0, 0},
+    {const_cast<char *>("name"), StdOutGetName, 0, 0, 0},
+    {const_cast<char *>("closed"), StdOutGetFalse, 0, 0, 0},
+    {const_cast<char *>("line_buffering"), StdOutGetTrue, 0, 0, 0},
+    {0, 0, 0, 0, 0} // sentinel
+};
+PyMethodDef stdOutBufferMethods[] = {
+    {"write", StdOutBufferWrite, METH_O, "sys.stdout.buffer.write"},
+    {"writelines", StdOutBufferWriteLines, METH_O, "sys.stdout.buffer.writelines"},
+    {"flush", StdOutFlush, METH_NOARGS, "sys.stdout.buffer.flush"},
+    {"close", StdOutFlush, METH_NOARGS, "sys.stdout.buffer.close, does nothing"},
+    {"isatty", StdOutFalse, METH_NOARGS, "sys.stdout.buffer.isatty"},
+    {"readable", StdOutFalse, METH_NOARGS, "sys.stdout.buffer.readable"},
+    {"seekable", StdOutFalse, METH_NOARGS, "sys.stdout.buffer.seekable"},
+    {"writable", StdOutTrue, METH_NOARGS, "sys.stdout.buffer.writable"},
+    {"fileno", StdOutFileNo, METH_NOARGS, "sys.stdout.buffer.fileno, unsupported"},
+    {0, 0, 0, 0} // sentinel
+};
+PyGetSetDef stdOutBufferGetSet[] = {
+    {const_cast<char *>("raw"), StdOutBufferGetRaw, 0, 0, 0},
+    {const_cast<char *>("closed"), StdOutGetFalse, 0, 0, 0},
+    {0, 0, 0, 0, 0} // sentinel
+};
 PyTypeObject StdoutType = {
     PyVarObject_HEAD_INIT(0, 0) "emb.StdoutType", /* tp_name */
     sizeof(StdOut),                               /* tp_basicsize */
     0,                                            /* tp_itemsize */
-    0,                                            /* tp_dealloc */
+    StdOutDealloc,                                /* tp_dealloc */
     0,                                            /* tp_print */
     0,                                            /* tp_getattr */
     0,                                            /* tp_setattr */
@@ -82,7 +236,46 @@ PyTypeObject StdoutType = {
     0,                                            /* tp_iternext */
     stdOutMethods,                                /* tp_methods */
     0,                                            /* tp_members */
-    0,                                            /* tp_getset */
+    stdOutGetSet,                                 /* tp_getset */
+    0,                                            /* tp_base */
+    0,                                            /* tp_dict */
+    0,                                            /* tp_descr_get */
+    0,                                            /* tp_descr_set */
+    0,                                            /* tp_dictoffset */
+    0,                                            /* tp_init */
+    0,                                            /* tp_alloc */
+    0,                                            /* tp_new */
+};
+PyTypeObject StdoutBufferType = {
+    PyVarObject_HEAD_INIT(0, 0) "emb.StdoutBufferType", /* tp_name */
+    sizeof(StdOutBuffer),                         /* tp_basicsize */
+    0,                                            /* tp_itemsize */
+    StdOutBufferDealloc,                          /* tp_dealloc */
+    0,                                            /* tp_print */
+    0,                                            /* tp_getattr */
+    0,                                            /* tp_setattr */
+    0,                                            /* tp_reserved */
+    0,                                            /* tp_repr */
+    0,                                            /* tp_as_number */
+    0,                                            /* tp_as_sequence */
+    0,                                            /* tp_as_mapping */
+    0,                                            /* tp_hash */
+    0,                                            /* tp_call */
+    0,                                            /* tp_str */
+    0,                                            /* tp_getattro */
+    0,                                            /* tp_setattro */
+    0,                                            /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,                           /* tp_flags */
+    "emb.StdoutBuffer objects",                   /* tp_doc */
+    0,                                            /* tp_traverse */
+    0,                                            /* tp_clear */
+    0,                                            /* tp_richcompare */
+    0,                                            /* tp_weaklistoffset */
+    0,                                            /* tp_iter */
+    0,                                            /* tp_iternext */
+    stdOutBufferMethods,                          /* tp_methods */
+    0,                                            /* tp_members */
+    stdOutBufferGetSet,                           /* tp_getset */
     0,                                            /* tp_base */
     0,                                            /* tp_dict */
     0,                                            /* tp_descr_get */
@@ -97,16 +290,20 @@ PyModuleDef embModule = {
 };
 // Internal state
 PyObject *gStdOut;
+PyObject *gStdErr;
 PyObject *gStdOutSaved;
 PyObject *gStdErrSaved;
 IsInterruptedType gInterrupter;
 PyMODINIT_FUNC PyInitEmbConnect(void) {
     gStdOut = 0;
+    gStdErr = 0;
     gStdOutSaved = 0;
     gStdErrSaved = 0;
-    StdoutType.tp_new = PyType_GenericNew;
+    StdoutType.tp_new = StdOutNew;
     if (PyType_Ready(&StdoutType) < 0)
         return 0;
+    if (PyType_Ready(&StdoutBufferType) < 0)
+        return 0;
     PyObject *m = PyModule_Create(&embModule);
     if (m) {
         Py_INCREF(&StdoutType);
@@ -114,16 +311,19 @@ PyMODINIT_FUNC PyInitEmbConnect(void) {
     }
     return m;
 }
-void SetStdout(StdOutWriteType write) {
+// stdout and stderr are separate objects so the UI can tell them apart
+void SetStdout(StdOutWriteType write, StdOutWriteType writeError) {
     if (!gStdOut) {
         gStdOutSaved = PySys_GetObject("stdout");
         gStdErrSaved = PySys_GetObject("stderr");
         gStdOut = StdoutType.tp_new(&StdoutType, 0, 0);
+        gStdErr = StdoutType.tp_new(&StdoutType, 0, 0);
+        reinterpret_cast<StdOut *>(gStdErr)->name = "<stderr>";
     }
-    StdOut *impl = reinterpret_cast<StdOut *>(gStdOut);
-    impl->write = write;
+    reinterpret_cast<StdOut *>(gStdOut)->write = write;
+    reinterpret_cast<StdOut *>(gStdErr)->write = writeError;
     PySys_SetObject("stdout", gStdOut);
-    PySys_SetObject("stderr", gStdOut);
+    PySys_SetObject("stderr", gStdErr);
 }
 void SetIsInterruptedCallback(IsInterruptedType cb) {
     gInterrupter = cb;
@@ -135,17 +335,216 @@ void ResetStdOut() {
         PySys_SetObject("stderr", gStdErrSaved);
 
     Py_XDECREF(gStdOut);
+    Py_XDECREF(gStdErr);
     gStdOut = 0;
+    gStdErr = 0;
 }
 //--------------------------------------------------------------------
+// Input snapshot, UTF-8 copy of the input box taken once per call
+// exposed as a read-only buffer and as a lazily sliced list of lines
+//--------------------------------------------------------------------
+struct InputSnapshot {
+    PyObject_HEAD QByteArray data;
+    std::vector<Py_ssize_t> lineStarts; // offset of each line in data
+};
+struct InputLines {
+    PyObject_HEAD PyObject *snapshot;
+    Py_ssize_t start;
+    Py_ssize_t count;
+};
+extern PyTypeObject InputSnapshotType;
+extern PyTypeObject InputLinesType;
+
+PyObject *NewInputSnapshot(const QString &text) {
+    PyObject *self = PyType_GenericNew(&InputSnapshotType, 0, 0);
+    if (!self)
+        return 0;
+    InputSnapshot *impl = reinterpret_cast<InputSnapshot *>(self);
+    new (&impl->data) QByteArray(text.toUtf8());
+    new (&impl->lineStarts) std::vector<Py_ssize_t>();
+    // Same line count as str.splitlines() for \n and \r\n text
+    const char *begin = impl->data.constData();
+    const char *end = begin + impl->data.size();
+    const char *pos = begin;
+    while (pos < end) {
+        impl->lineStarts.push_back(pos - begin);
+        const char *newline = static_cast<const char *>(
+                                  memchr(pos, '\n', end - pos));
+        pos = newline ? newline + 1 : end;
+    }
+    return self;
+}
+void InputSnapshotDealloc(PyObject *self) {
+    InputSnapshot *impl = reinterpret_cast<InputSnapshot *>(self);
+    impl->data.~QByteArray();
+    impl->lineStarts.~vector();
+    Py_TYPE(self)->tp_free(self);
+}
+int InputSnapshotGetBuffer(PyObject *self, Py_buffer *view, int flags) {
+    InputSnapshot *impl = reinterpret_cast<InputSnapshot *>(self);
+    return PyBuffer_FillInfo(view, self,
+                             const_cast<char *>(impl->data.constData()),
+                             impl->data.size(), 1, flags);
+}
+PyObject *NewInputLines(PyObject *snapshot, Py_ssize_t start,
+                        Py_ssize_t count) {
+    PyObject *self = PyType_GenericNew(&InputLinesType, 0, 0);
+    if (!self)
+        return 0;
+    InputLines *impl = reinterpret_cast<InputLines *>(self);
+    Py_INCREF(snapshot);
+    impl->snapshot = snapshot;
+    impl->start = start;
+    impl->count = count;
+    return self;
+}
+void InputLinesDealloc(PyObject *self) {
+    Py_XDECREF(reinterpret_cast<InputLines *>(self)->snapshot);
+    Py_TYPE(self)->tp_free(self);
+}
+Py_ssize_t InputLinesLength(PyObject *self) {
+    return reinterpret_cast<InputLines *>(self)->count;
+}
+// Lines are decoded only when accessed, without the line ending
+PyObject *InputLinesItem(PyObject *self, Py_ssize_t index) {
+    InputLines *impl = reinterpret_cast<InputLines *>(self);
+    if (index < 0 || index >= impl->count) {
+        PyErr_SetString(PyExc_IndexError, "line index out of range");
+        return 0;
+    }
+    InputSnapshot *snapshot = reinterpret_cast<InputSnapshot *>(impl->snapshot);
+    std::size_t line = static_cast<std::size_t>(impl->start + index);
+    Py_ssize_t begin = snapshot->lineStarts[line];
+    Py_ssize_t end = line + 1 < snapshot->lineStarts.size() ?
+                     snapshot->lineStarts[line + 1] : snapshot->data.size();
+    const char *data = snapshot->data.constData();
+    if (end > begin && data[end - 1] == '\n')
+        end--;
+    if (end > begin && data[end - 1] == '\r')
+        end--;
+    return PyUnicode_DecodeUTF8(data + begin, end - begin, "replace");
+}
+PyObject *InputLinesSubscript(PyObject *self, PyObject *key) {
+    InputLines *impl = reinterpret_cast<InputLines *>(self);
+    if (PySlice_Check(key)) {
+        Py_ssize_t start, stop, step;
+        if (PySlice_Unpack(key, &start, &stop, &step) < 0)
+            return 0;
+        Py_ssize_t count = PySlice_AdjustIndices(impl->count, &start, &stop,
+                           step);
+        if (step == 1) {
+            // Contiguous slices share the snapshot, nothing is decoded
+            return NewInputLines(impl->snapshot, impl->start + start, count);
+        }
+        PyObject *list = PyList_New(count);
+        for (Py_ssize_t i = 0; list && i < count; i++) {
+            PyObject *item = InputLinesItem(self, start + i * step);
+            if (!item) {
+                Py_DECREF(list);
+                return 0;
+            }
+            PyList_SET_ITEM(list, i, item);
+        }
+        return list;
+    }
+    Py_ssize_t index = PyNumber_AsSsize_t(key, PyExc_IndexError);
+    if (index == -1 && PyErr_Occurred())
+        return 0;
+    if (index < 0)
+        index += impl->count;
+    return InputLinesItem(self, index);
+}
+PyObject *InputLinesIter(PyObject *self) {
+    return PySeqIter_New(self);
+}
+PyBufferProcs inputSnapshotBuffer = {InputSnapshotGetBuffer, 0};
+PySequenceMethods inputLinesSequence = {
+    InputLinesLength, /* sq_length */
+    0,                /* sq_concat */
+    0,                /* sq_repeat */
+    InputLinesItem,   /* sq_item */
+};
+PyMappingMethods inputLinesMapping = {
+    InputLinesLength,    /* mp_length */
+    InputLinesSubscript, /* mp_subscript */
+    0,                   /* mp_ass_subscript */
+};
+PyTypeObject InputSnapshotType = {
+    PyVarObject_HEAD_INIT(0, 0) "express_api.InputSnapshot", /* tp_name */
+    sizeof(InputSnapshot),                        /* tp_basicsize */
+    0,                                            /* tp_itemsize */
+    InputSnapshotDealloc,                         /* tp_dealloc */
+    0,                                            /* tp_print */
+    0,                                            /* tp_getattr */
+    0,                                            /* tp_setattr */
+    0,                                            /* tp_reserved */
+    0,                                            /* tp_repr */
+    0,                                            /* tp_as_number */
+    0,                                            /* tp_as_sequence */
+    0,                                            /* tp_as_mapping */
+    0,                                            /* tp_hash */
+    0,                                            /* tp_call */
+    0,                                            /* tp_str */
+    0,                                            /* tp_getattro */
+    0,                                            /* tp_setattro */
+    &inputSnapshotBuffer,                         /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,                           /* tp_flags */
+    "UTF-8 snapshot of the input box",            /* tp_doc */
+};
+PyTypeObject InputLinesType = {
+    PyVarObject_HEAD_INIT(0, 0) "express_api.InputLines", /* tp_name */
+    sizeof(InputLines),                           /* tp_basicsize */
+    0,                                            /* tp_itemsize */
+    InputLinesDealloc,                            /* tp_dealloc */
+    0,                                            /* tp_print */
+    0,                                            /* tp_getattr */
+    0,                                            /* tp_setattr */
+    0,                                            /* tp_reserved */
+    0,                                            /* tp_repr */
+    0,                                            /* tp_as_number */
+    &inputLinesSequence,                          /* tp_as_sequence */
+    &inputLinesMapping,                           /* tp_as_mapping */
+    0,                                            /* tp_hash */
+    0,                                            /* tp_call */
+    0,                                            /* tp_str */
+    0,                                            /* tp_getattro */
+    0,                                            /* tp_setattro */
+    0,                                            /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,                           /* tp_flags */
+    "Read-only list of input lines, decoded on access", /* tp_doc */
+    0,                                            /* tp_traverse */
+    0,                                            /* tp_clear */
+    0,                                            /* tp_richcompare */
+    0,                                            /* tp_weaklistoffset */
+    InputLinesIter,                               /* tp_iter */
+};
+//--------------------------------------------------------------------
 // Embedded APIs
 //--------------------------------------------------------------------
+// Hands the QString's UTF-16 data to python directly, no std::string copy
+PyObject *QStringToPy(const QString &text) {
+    int byteOrder = (QSysInfo::ByteOrder == QSysInfo::LittleEndian) ? -1 : 1;
+    return PyUnicode_DecodeUTF16(reinterpret_cast<const char *>(text.utf16()),
+                                 text.size() * 2, "surrogatepass", &byteOrder);
+}
+// Append UTF-8 of str(item) to out, returns false on python error
+bool AppendStr(PyObject *item, QByteArray &out) {
+    PyObject *text = PyObject_Str(item);
+    if (!text)
+        return false;
+    Py_ssize_t size;
+    const char *data = PyUnicode_AsUTF8AndSize(text, &size);
+    if (data)
+        out.append(data, static_cast<int>(size));
+    Py_DECREF(text);
+    return data != 0;
+}
 PyObject *ApiGetInput(PyObject *self, PyObject *args) {
     if (!PyArg_ParseTuple(args, ":numargs"))
         return NULL;
 
     QThread::msleep(10);
-    return Py_BuildValue("s", mainView->GetInput().toStdString().c_str());
+    return QStringToPy(mainView->GetInput());
 }
 PyObject *ApiSetInput(PyObject *self, PyObject *args) {
     char *data;
@@ -170,7 +569,7 @@ PyObject *ApiGetOutput(PyObject *self, PyObject *args) {
         return NULL;
 
     QThread::msleep(10);
-    return Py_BuildValue("s", mainView->GetOutput().toStdString().c_str());
+    return QStringToPy(mainView->GetOutput());
 }
 
 PyObject *ApiSetOutput(PyObject *self, PyObject *args) {
@@ -188,7 +587,7 @@ PyObject *ApiGetCode(PyObject *self, PyObject *args) {
         return NULL;
 
     QThread::msleep(10);
-    return Py_BuildValue("s", mainView->GetCode().toStdString().c_str());
+    return QStringToPy(mainView->GetCode());
 }
 
 PyObject *ApiSetCode(PyObject *self, PyObject *args) {
@@ -202,6 +601,38 @@ PyObject *ApiSetCode(PyObject *self, PyObject *args) {
     return Py_BuildValue("i", 0);
 }
 
+PyObject *ApiGetInputFile(PyObject *self, PyObject *args) {
+    if (!PyArg_ParseTuple(args, ":numargs"))
+        return NULL;
+
+    QThread::msleep(10);
+    return QStringToPy(mainView->GetInputFile());
+}
+PyObject *ApiGetInputBytes(PyObject *self, PyObject *args) {
+    if (!PyArg_ParseTuple(args, ":numargs"))
+        return NULL;
+
+    QThread::msleep(10);
+    PyObject *snapshot = NewInputSnapshot(mainView->GetInput());
+    if (!snapshot)
+        return NULL;
+    PyObject *view = PyMemoryView_FromObject(snapshot);
+    Py_DECREF(snapshot);
+    return view;
+}
+PyObject *ApiGetInputLines(PyObject *self, PyObject *args) {
+    if (!PyArg_ParseTuple(args, ":numargs"))
+        return NULL;
+
+    QThread::msleep(10);
+    PyObject *snapshot = NewInputSnapshot(mainView->GetInput());
+    if (!snapshot)
+        return NULL;
+    PyObject *lines = NewInputLines(snapshot, 0,
+                                    reinterpret_cast<InputSnapshot *>(snapshot)->lineStarts.size());
+    Py_DECREF(snapshot);
+    return lines;
+}
 PyObject *ApiSetSearchRegex(PyObject *self, PyObject *args) {
     char *data;
     if (!PyArg_ParseTuple(args, "s", &data))
@@ -224,6 +655,234 @@ PyObject *ApiWriteOutput(PyObject *self, PyObject *args) {
     return Py_BuildValue("i", 0);
 }
 
+PyObject *ApiWriteError(PyObject *self, PyObject *args) {
+    char *data;
+    if (!PyArg_ParseTuple(args, "s", &data))
+        return NULL;
+
+    emit worker->WriteError(QString(data));
+    QThread::msleep(10);
+
+    return Py_BuildValue("i", 0);
+}
+
+// Whole iterable goes to the output box in a single update
+PyObject *ApiWriteLines(PyObject *self, PyObject *args) {
+    PyObject *iterator = PyObject_GetIter(args);
+    if (!iterator)
+        return NULL;
+
+    QByteArray text;
+    PyObject *item;
+    while ((item = PyIter_Next(iterator))) {
+        int start = text.size();
+        bool ok = AppendStr(item, text);
+        Py_DECREF(item);
+        if (!ok)
+            break;
+        // Items ending in a newline are not given another, empty ones are
+        if (text.size() == start || !text.endsWith('\n'))
+            text.append('\n');
+    }
+    Py_DECREF(iterator);
+    if (PyErr_Occurred())
+        return NULL;
+
+    emit worker->WriteOutput(QString::fromUtf8(text));
+    QThread::msleep(10);
+
+    return Py_BuildValue("i", 0);
+}
+
+// Append one cell, numbers stay numbers until a text cell shows up
+bool AppendCell(PyObject *cell, TableColumn &column) {
+    if (column.numeric && (PyFloat_Check(cell) ||
+                           (PyLong_Check(cell) && !PyBool_Check(cell)))) {
+        double number = PyFloat_AsDouble(cell);
+        if (!PyErr_Occurred()) {
+            column.numbers.append(number);
+            return true;
+        }
+        // Too big for a double, keep all the digits as text
+        PyErr_Clear();
+    }
+    column.ToText();
+    QByteArray text;
+    if (!AppendStr(cell, text))
+        return false;
+    column.texts.append(QString::fromUtf8(text));
+    return true;
+}
+template <typename T>
+void AppendNumbers(const Py_buffer &view, TableColumn &column) {
+    const T *values = static_cast<const T *>(view.buf);
+    Py_ssize_t count = view.len / view.itemsize;
+    column.numbers.reserve(column.numbers.size() + static_cast<int>(count));
+    for (Py_ssize_t i = 0; i < count; i++) {
+        column.numbers.append(static_cast<double>(values[i]));
+    }
+}
+// Numeric buffers (array, numpy...) are read in place, returns false if
+// the object does not provide a 1-D native numeric buffer
+bool AppendBuffer(PyObject *cells, TableColumn &column) {
+    if (!PyObject_CheckBuffer(cells))
+        return false;
+    Py_buffer view;
+    if (PyObject_GetBuffer(cells, &view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) < 0) {
+        PyErr_Clear();
+        return false;
+    }
+    const char *format = view.format ? view.format : "B";
+    if (*format == '@')
+        format++;
+    bool ok = (view.ndim <= 1 && format[0] && !format[1]);
+    if (ok) {
+        switch (format[0]) {
+        case 'b': AppendNumbers<signed char>(view, column); break;
+        case 'B': AppendNumbers<unsigned char>(view, column); break;
+        case 'h': AppendNumbers<short>(view, column); break;
+        case 'H': AppendNumbers<unsigned short>(view, column); break;
+        case 'i': AppendNumbers<int>(view, column); break;
+        case 'I': AppendNumbers<unsigned int>(view, column); break;
+        case 'l': AppendNumbers<long>(view, column); break;
+        case 'L': AppendNumbers<unsigned long>(view, column); break;
+        case 'q': AppendNumbers<long long>(view, column); break;
+        case 'Q': AppendNumbers<unsigned long long>(view, column); break;
+        case 'n': AppendNumbers<Py_ssize_t>(view, column); break;
+        case 'N': AppendNumbers<size_t>(view, column); break;
+        case 'f': AppendNumbers<float>(view, column); break;
+        case 'd': AppendNumbers<double>(view, column); break;
+        default: ok = false;
+        }
+    }
+    PyBuffer_Release(&view);
+    return ok;
+}
+// One column, from a numeric buffer or any iterable of cells
+bool AppendColumn(PyObject *cells, TableColumn &column) {
+    if (AppendBuffer(cells, column))
+        return true;
+    PyObject *iterator = PyObject_GetIter(cells);
+    if (!iterator)
+        return false;
+    PyObject *cell;
+    while ((cell = PyIter_Next(iterator))) {
+        bool ok = AppendCell(cell, column);
+        Py_DECREF(cell);
+        if (!ok)
+            break;
+    }
+    Py_DECREF(iterator);
+    return !PyErr_Occurred();
+}
+// Optional column names, any iterable of objects
+bool SetHeaders(PyObject *headers, TableColumns &columns) {
+    if (!headers || headers == Py_None)
+        return true;
+    PyObject *iterator = PyObject_GetIter(headers);
+    if (!iterator)
+        return false;
+    PyObject *header;
+    for (int i = 0; (header = PyIter_Next(iterator)); i++) {
+        QByteArray text;
+        bool ok = AppendStr(header, text);
+        Py_DECREF(header);
+        if (!ok)
+            break;
+        if (i >= columns.size())
+            columns.resize(i + 1);
+        columns[i].name = QString::fromUtf8(text);
+    }
+    Py_DECREF(iterator);
+    return !PyErr_Occurred();
+}
+
+// Rows of cells go to the table dock, transposed into columns here
+PyObject *ApiAppendTable(PyObject *self, PyObject *args) {
+    PyObject *rows;
+    PyObject *headers = NULL;
+    if (!PyArg_ParseTuple(args, "O|O", &rows, &headers))
+        return NULL;
+    PyObject *rowIterator = PyObject_GetIter(rows);
+    if (!rowIterator)
+        return NULL;
+
+    TableColumns columns;
+    int rowCount = 0;
+    PyObject *row;
+    while (!PyErr_Occurred() && (row = PyIter_Next(rowIterator))) {
+        PyObject *cellIterator = PyObject_GetIter(row);
+        Py_DECREF(row);
+        if (!cellIterator)
+            break;
+        PyObject *cell;
+        for (int i = 0; (cell = PyIter_Next(cellIterator)); i++) {
+            if (i >= columns.size())
+                columns.resize(i + 1);
+            columns[i].PadTo(rowCount);
+            bool ok = AppendCell(cell, columns[i]);
+            Py_DECREF(cell);
+            if (!ok)
+                break;
+        }
+        Py_DECREF(cellIterator);
+        rowCount++;
+    }
+    Py_DECREF(rowIterator);
+    if (PyErr_Occurred() || !SetHeaders(headers, columns))
+        return NULL;
+
+    emit worker->AppendTable(columns);
+    QThread::msleep(10);
+
+    return Py_BuildValue("i", 0);
+}
+
+// Whole columns go to the table dock, a dict maps names to columns
+PyObject *ApiAppendColumns(PyObject *self, PyObject *args) {
+    TableColumns columns;
+    bool isDict = PyDict_Check(args);
+    PyObject *values = isDict ? PyDict_Values(args) : NULL;
+    PyObject *iterator = PyObject_GetIter(values ? values : args);
+    Py_XDECREF(values);
+    if (!iterator)
+        return NULL;
+    PyObject *cells;
+    while ((cells = PyIter_Next(iterator))) {
+        columns.append(TableColumn());
+        bool ok = AppendColumn(cells, columns.last());
+        Py_DECREF(cells);
+        if (!ok)
+            break;
+    }
+    Py_DECREF(iterator);
+    if (PyErr_Occurred() || (isDict && !SetHeaders(args, columns)))
+        return NULL;
+
+    emit worker->AppendTable(columns);
+    QThread::msleep(10);
+
+    return Py_BuildValue("i", 0);
+}
+
+PyObject *ApiClearTable(PyObject *self, PyObject *args) {
+    PyObject *headers = NULL;
+    if (!PyArg_ParseTuple(args, "|O", &headers))
+        return NULL;
+    TableColumns columns;
+    if (!SetHeaders(headers, columns))
+        return NULL;
+    QStringList names;
+    foreach (const TableColumn &column, columns) {
+        names.append(column.name);
+    }
+
+    emit worker->ClearTable(names);
+    QThread::msleep(10);
+
+    return Py_BuildValue("i", 0);
+}
+
 PyObject *ApiInterruptRequested(PyObject *self, PyObject *args) {
     if (gInterrupter) {
         return Py_BuildValue("i", gInterrupter());
@@ -233,6 +892,18 @@ PyObject *ApiInterruptRequested(PyObject *self, PyObject *args) {
 
 PyMethodDef apiMethods[] = {
     {"get_input", ApiGetInput, METH_VARARGS, "Get input textbox's content"},
+    {
+        "get_input_bytes", ApiGetInputBytes, METH_VARARGS,
+        "Get input textbox's content as a read-only UTF-8 memoryview"
+    },
+    {
+        "get_input_lines", ApiGetInputLines, METH_VARARGS,
+        "Get input textbox's lines, decoded when accessed"
+    },
+    {
+        "get_input_file", ApiGetInputFile, METH_VARARGS,
+        "Get attached input file's path, empty if input textbox is used"
+    },
     {"set_input", ApiSetInput, METH_VARARGS, "Set input textbox's content"},
 
     {"get_apppath", ApiGetAppPath, METH_VARARGS, "Get application path"},
@@ -251,6 +922,26 @@ PyMethodDef apiMethods[] = {
         "write_output", ApiWriteOutput, METH_VARARGS,
         "Append to output, It does not automatically add a newline"
     },
+    {
+        "write_error", ApiWriteError, METH_VARARGS,
+        "Append to output as error text, It does not automatically add a newline"
+    },
+    {
+        "write_lines", ApiWriteLines, METH_O,
+        "Append each item of an iterable to output as a line"
+    },
+    {
+        "append_table", ApiAppendTable, METH_VARARGS,
+        "Append rows (iterables of cells) to the table, headers are optional"
+    },
+    {
+        "append_columns", ApiAppendColumns, METH_O,
+        "Append columns (numeric buffers or iterables) to the table"
+    },
+    {
+        "clear_table", ApiClearTable, METH_VARARGS,
+        "Clear the table, optionally setting column headers"
+    },
     // end of method definitions
     {NULL, NULL, 0, NULL}
 };
@@ -260,6 +951,10 @@ PyModuleDef apiModule = {PyModuleDef_HEAD_INIT, "expressApi", NULL,
                          NULL,                  NULL,         NULL
                         };
 PyObject *PyInitApiConnection(void) {
+    if (PyType_Ready(&InputSnapshotType) < 0)
+        return 0;
+    if (PyType_Ready(&InputLinesType) < 0)
+        return 0;
     return PyModule_Create(&apiModule);
 }
 }
@@ -6,11 +6,12 @@
 #include "PythonAccess/pythonworker.h"
 namespace emb {
 
-typedef std::function<void(std::string)> StdOutWriteType;
+typedef std::function<void(const char *, Py_ssize_t)> StdOutWriteType;
 typedef std::function<int()> IsInterruptedType;
 
 PyObject *PyInitApiConnection(void);
 PyObject *ApiWriteOutput(PyObject *self, PyObject *args);
+PyObject *ApiWriteError(PyObject *self, PyObject *args);
 PyObject *ApiSetCode(PyObject *self, PyObject *args);
 PyObject *ApiGetCode(PyObject *self, PyObject *args);
 PyObject *ApiSetOutput(PyObject *self, PyObject *args);
@@ -18,13 +19,20 @@ PyObject *ApiGetOutput(PyObject *self, PyObject *args);
 PyObject *ApiGetAppPath(PyObject *self, PyObject *args);
 PyObject *ApiSetInput(PyObject *self, PyObject *args);
 PyObject *ApiGetInput(PyObject *self, PyObject *args);
+PyObject *ApiGetInputFile(PyObject *self, PyObject *args);
+PyObject *ApiGetInputBytes(PyObject *self, PyObject *args);
+PyObject *ApiGetInputLines(PyObject *self, PyObject *args);
+PyObject *ApiWriteLines(PyObject *self, PyObject *args);
+PyObject *ApiAppendTable(PyObject *self, PyObject *args);
+PyObject *ApiAppendColumns(PyObject *self, PyObject *args);
+PyObject *ApiClearTable(PyObject *self, PyObject *args);
 PyObject *ApiSetSearchRegex(PyObject *self, PyObject *args);
 PyObject *ApiInterruptRequested(PyObject *self, PyObject *args);
 void ResetStdOut();
 void setMainView(MainView *_mainView);
 void setWorker(PythonWorker *_worker);
 MainView *getMainView();
-void SetStdout(StdOutWriteType write);
+void SetStdout(StdOutWriteType write, StdOutWriteType writeError);
 void SetIsInterruptedCallback(IsInterruptedType cb);
 PyMODINIT_FUNC PyInitEmbConnect(void);
 PyObject *StdOutFlush(PyObject *self, PyObject *args);
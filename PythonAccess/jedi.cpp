@@ -1,58 +1,202 @@
-#include "cstdlib"
-#include "cmath"
-#include "Python.h"
-#include "jedi.h"
+#include "PythonAccess/jedi.h"
+#include <QJsonDocument>
+#include <QJsonObject>
 
-Jedi::Jedi(QObject* parent) : QObject(parent) {
+Jedi::Jedi(QObject* parent) : QObject(parent), m_process(nullptr),
+    m_ready(false), m_stopping(false), m_nextId(1), m_restarts(0) {
+    m_watchdog.setSingleShot(true);
+    m_watchdog.setInterval(JEDI_TIMEOUT_MS);
+    connect(&m_watchdog, &QTimer::timeout, this, &Jedi::TimedOut);
 }
 
-void Jedi::SetJediGetCode(QString jediCode) {
-    this->jediCode = jediCode;
+Jedi::~Jedi() {
+    m_stopping = true;
+    if (m_process) {
+        m_process->disconnect(this);
+        m_process->kill();
+        m_process->waitForFinished(1000);
+    }
 }
 
-QStringList Jedi::AutoComplete(const QString& code, long row, long col) {
+// script is the server source, it is passed with -c so nothing is written
+// to disk
+void Jedi::SetServer(const QString &python, const QString &script) {
+    m_python = python;
+    m_script = script;
+}
 
-    QStringList allCompletions;
-    PyObject *pyPythonCode, *pyGetCompletionsFunc, *pyGetCompletionsArgs, *pyTemp, *pyCompletions, *pyMain;
+// Does not wait for the server, requests sent before it is up are queued
+// in the pipe
+void Jedi::Start() {
+    if (m_process || m_python.isEmpty()) {
+        return;
+    }
+    m_ready = false;
+    m_process = new QProcess(this);
+    m_process->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    connect(m_process, &QProcess::readyReadStandardOutput, this,
+            &Jedi::ReadReplies);
+    connect(m_process,
+            static_cast<void (QProcess::*)(int, QProcess::ExitStatus)>(
+                &QProcess::finished),
+            this, &Jedi::ServerFinished);
+    connect(m_process, &QProcess::errorOccurred, this, &Jedi::ServerFailed);
+    m_process->start(m_python, QStringList() << "-u" << "-c" << m_script);
+}
 
-    // if already initialiazed, then return empty list
-    int is_init = Py_IsInitialized();
-    if(is_init) return allCompletions;
+bool Jedi::IsReady() const {
+    return m_ready;
+}
 
-    Py_Initialize();
-    PyGILState_STATE d_gstate;
-    d_gstate = PyGILState_Ensure();
-    // Build the name object by converting Qstring to Utf8.
-    // Note: Discarded toStdString because Qstring is UTF-16 encoded while std::string can have many encodings
-    const char* pythonCode = code.toUtf8().data();
-    pyPythonCode = PyUnicode_FromString(pythonCode);
-    pyMain = PyUnicode_FromString("__main__"); // default module
+int Jedi::Complete(const QString &code, int line, int column) {
+    return RequestAt("complete", code, line, column);
+}
 
-    pyGetCompletionsArgs = PyTuple_New(3);
+int Jedi::Signatures(const QString &code, int line, int column) {
+    return RequestAt("signatures", code, line, column);
+}
 
-    PyTuple_SetItem(pyGetCompletionsArgs, 0, pyPythonCode);
-    PyTuple_SetItem(pyGetCompletionsArgs, 1, PyLong_FromLong(row));
-    PyTuple_SetItem(pyGetCompletionsArgs, 2, PyLong_FromLong(col));
+int Jedi::Goto(const QString &code, int line, int column) {
+    return RequestAt("goto", code, line, column);
+}
 
-    // Run the preparation code
-    PyRun_SimpleString(this->jediCode.toStdString().c_str());
-    pyTemp = PyModule_GetDict(PyImport_GetModule(pyMain));
+int Jedi::Hover(const QString &code, int line, int column) {
+    return RequestAt("hover", code, line, column);
+}
 
+// Syntax errors and, when pyflakes is installed, its warnings
+int Jedi::Check(const QString &code) {
+    QVariantMap params;
+    params["source"] = code;
+    return Request("check", params);
+}
 
-    pyGetCompletionsFunc = PyDict_GetItemString(pyTemp, (char*)"get_completions");
-    pyCompletions = PyObject_CallObject(pyGetCompletionsFunc, pyGetCompletionsArgs);
-    int len = PyList_Size(pyCompletions);
-    for (int i = 0; i < len; i++) {
-        PyObject* completion = PyList_GetItem(pyCompletions, i);
-        PyObject* asciiComp = PyUnicode_AsASCIIString(completion);
-        char* completionChars = PyBytes_AsString(asciiComp);
-        allCompletions << completionChars;
+void Jedi::Cancel(int id) {
+    if (m_pending.remove(id) == 0) {
+        return;
+    }
+    QVariantMap params;
+    params["id"] = id;
+    QVariantMap message;
+    message["method"] = "cancel";
+    message["params"] = params;
+    Send(message);
+    if (m_pending.isEmpty()) {
+        m_watchdog.stop();
     }
+}
 
+int Jedi::RequestAt(const QString &method, const QString &code, int line,
+                    int column) {
+    QVariantMap params;
+    params["source"] = code;
+    params["line"] = line;
+    params["column"] = column;
+    return Request(method, params);
+}
 
-    Py_DECREF(pyPythonCode); // Delete PythonCode object
-    PyGILState_Release(d_gstate);
-    Py_Finalize();
+// Returns the id the reply will carry, -1 when the server is gone for good
+int Jedi::Request(const QString &method, const QVariantMap &params) {
+    if (!m_process) {
+        return -1;
+    }
+    int id = m_nextId++;
+    QVariantMap message;
+    message["id"] = id;
+    message["method"] = method;
+    message["params"] = params;
+    m_pending.insert(id, method);
+    Send(message);
+    if (!m_watchdog.isActive()) {
+        m_watchdog.start();
+    }
+    return id;
+}
 
-    return allCompletions;
+void Jedi::Send(const QVariantMap &message) {
+    if (!m_process) {
+        return;
+    }
+    QByteArray line = QJsonDocument(QJsonObject::fromVariantMap(message))
+                      .toJson(QJsonDocument::Compact);
+    line.append('\n');
+    m_process->write(line);
+}
+
+void Jedi::ReadReplies() {
+    while (m_process && m_process->canReadLine()) {
+        QJsonObject reply = QJsonDocument::fromJson(m_process->readLine())
+                            .object();
+        if (reply.isEmpty()) {
+            continue;
+        }
+        int id = reply.value("id").toInt(-1);
+        if (id == 0) {
+            // Hello, sent once the server is listening
+            m_ready = true;
+            continue;
+        }
+        if (m_pending.remove(id) == 0) {
+            // Cancelled, or from before a restart
+            continue;
+        }
+        m_restarts = 0;
+        if (m_pending.isEmpty()) {
+            m_watchdog.stop();
+        } else {
+            m_watchdog.start();
+        }
+        if (reply.contains("error")) {
+            emit Failed(id, reply.value("error").toString());
+        } else {
+            emit Replied(id, reply.value("result").toVariant());
+        }
+    }
+}
+
+void Jedi::ServerFinished(int /* exitCode */,
+                          QProcess::ExitStatus /* exitStatus */) {
+    Restart();
+}
+
+void Jedi::ServerFailed(QProcess::ProcessError error) {
+    // Other errors are followed by finished()
+    if (error == QProcess::FailedToStart) {
+        Restart();
+    }
+}
+
+void Jedi::TimedOut() {
+    if (m_process) {
+        // Finishing starts it again
+        m_process->kill();
+    }
+}
+
+// WHY:
+// A server that keeps dying (no jedi, broken python) is not started
+// forever, the delay keeps a crash loop from eating the CPU
+void Jedi::Restart() {
+    if (!m_process) {
+        return;
+    }
+    m_process->disconnect(this);
+    m_process->deleteLater();
+    m_process = nullptr;
+    m_ready = false;
+    m_watchdog.stop();
+    FailPending(tr("Jedi server stopped"));
+    if (m_stopping || m_restarts >= JEDI_MAX_RESTARTS) {
+        return;
+    }
+    m_restarts++;
+    QTimer::singleShot(JEDI_RESTART_DELAY_MS * m_restarts, this, &Jedi::Start);
+}
+
+void Jedi::FailPending(const QString &message) {
+    QList<int> ids = m_pending.keys();
+    m_pending.clear();
+    foreach (int id, ids) {
+        emit Failed(id, message);
+    }
 }
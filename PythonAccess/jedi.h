@@ -3,26 +3,67 @@
 
 #include <QObject>
 #include <QMap>
-#include <QList>
-#include <QIODevice>
-#include <QFile>
-#include <QApplication>
-#include <QListWidget>
-#include <QProgressBar>
-#include <QTextStream>
-#include <QPixmap>
-#include <QIcon>
-#include <QDebug>
+#include <QProcess>
+#include <QStringList>
+#include <QTimer>
+#include <QVariant>
 
+// A request without a reply for this long means the server hangs
+#define JEDI_TIMEOUT_MS 10000
+// Wait before starting a dead server again, grows with each failure
+#define JEDI_RESTART_DELAY_MS 500
+// Give up after this many restarts without a single reply
+#define JEDI_MAX_RESTARTS 5
 
+// Client of the jedi server (ep_jedi.py) running in a child process
+// Requests and replies are one compact JSON object per line over the
+// process pipes. Every request gets an id, replies come back through
+// Replied or Failed with that id, in any order. A cancelled request is
+// dropped by the server if it has not started yet and its reply is never
+// reported. A dead or hanging server is started again, requests it had are
+// reported as failed.
 class Jedi : public QObject {
     Q_OBJECT
   public:
     explicit Jedi(QObject* parent=nullptr);
-    void SetJediGetCode(QString jediCode);
-    QStringList AutoComplete(const QString& code, long row, long col);
+    ~Jedi();
+    void SetServer(const QString &python, const QString &script);
+    void Start();
+    bool IsReady() const;
+    // Positions are 0 based, code is the whole document
+    int Complete(const QString &code, int line, int column);
+    int Signatures(const QString &code, int line, int column);
+    int Goto(const QString &code, int line, int column);
+    int Hover(const QString &code, int line, int column);
+    int Check(const QString &code);
+    void Cancel(int id);
+
+  signals:
+    void Replied(int id, const QVariant &result);
+    void Failed(int id, const QString &message);
+
+  private slots:
+    void ReadReplies();
+    void ServerFinished(int exitCode, QProcess::ExitStatus exitStatus);
+    void ServerFailed(QProcess::ProcessError error);
+    void TimedOut();
+
   private:
-    QString jediCode;
+    QString m_python;
+    QString m_script;
+    QProcess *m_process;
+    bool m_ready; // server said hello
+    bool m_stopping;
+    int m_nextId;
+    int m_restarts;
+    QMap<int, QString> m_pending; // id -> method
+    QTimer m_watchdog;
+    int Request(const QString &method, const QVariantMap &params);
+    int RequestAt(const QString &method, const QString &code, int line,
+                  int column);
+    void Send(const QVariantMap &message);
+    void Restart();
+    void FailPending(const QString &message);
 };
 
 #endif // JEDI_H
@@ -0,0 +1,141 @@
+#include "PythonAccess/kernel.h"
+#include <QJsonDocument>
+#include <QJsonObject>
+
+Kernel::Kernel(QObject* parent) : QObject(parent), m_process(nullptr),
+    m_nextId(1) {
+}
+
+Kernel::~Kernel() {
+    if (m_process) {
+        m_process->disconnect(this);
+        m_process->kill();
+        m_process->waitForFinished(1000);
+    }
+}
+
+// script is the kernel source, it is passed with -c so nothing is written
+// to disk
+void Kernel::SetServer(const QString &python, const QString &script) {
+    m_python = python;
+    m_script = script;
+}
+
+void Kernel::Start() {
+    if (m_process || m_python.isEmpty()) {
+        return;
+    }
+    m_process = new QProcess(this);
+    m_process->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    connect(m_process, &QProcess::readyReadStandardOutput, this,
+            &Kernel::ReadMessages);
+    connect(m_process,
+            static_cast<void (QProcess::*)(int, QProcess::ExitStatus)>(
+                &QProcess::finished),
+            this, &Kernel::KernelFinished);
+    connect(m_process, &QProcess::errorOccurred, this, &Kernel::KernelFailed);
+    m_process->start(m_python, QStringList() << "-u" << "-c" << m_script);
+}
+
+// Returns the id output and Finished carry, cells queue up in the pipe
+// while one is running
+int Kernel::Run(const QString &code, int line, const QString &input,
+                const QString &inputFile) {
+    Start();
+    if (!m_process) {
+        return -1;
+    }
+    int id = m_nextId++;
+    QVariantMap params;
+    params["code"] = code;
+    params["line"] = line;
+    params["input"] = input;
+    params["input_file"] = inputFile;
+    QVariantMap message;
+    message["id"] = id;
+    message["method"] = "run";
+    message["params"] = params;
+    m_pending.append(id);
+    Send(message);
+    return id;
+}
+
+// Forgets every variable, after the cells already sent
+void Kernel::Reset() {
+    if (!m_process) {
+        return;
+    }
+    QVariantMap message;
+    message["id"] = m_nextId++;
+    message["method"] = "reset";
+    Send(message);
+}
+
+// WHY:
+// A cell can not be interrupted from the outside on every system, the
+// process is killed instead and its variables go with it
+void Kernel::Stop() {
+    if (m_process) {
+        m_process->kill();
+    }
+}
+
+bool Kernel::IsBusy() const {
+    return !m_pending.isEmpty();
+}
+
+void Kernel::Send(const QVariantMap &message) {
+    QByteArray line = QJsonDocument(QJsonObject::fromVariantMap(message))
+                      .toJson(QJsonDocument::Compact);
+    line.append('\n');
+    m_process->write(line);
+}
+
+void Kernel::ReadMessages() {
+    while (m_process && m_process->canReadLine()) {
+        QJsonObject message = QJsonDocument::fromJson(m_process->readLine())
+                              .object();
+        int id = message.value("id").toInt(-1);
+        if (!m_pending.contains(id)) {
+            // Hello, or a reset
+            continue;
+        }
+        if (message.contains("stream")) {
+            emit Output(id, message.value("text").toString(),
+                        message.value("stream").toString() == "stderr");
+        } else if (message.contains("result")) {
+            m_pending.removeOne(id);
+            emit Finished(id, message.value("result").toObject()
+                          .value("ok").toBool());
+        }
+    }
+}
+
+void Kernel::KernelFinished(int /* exitCode */,
+                            QProcess::ExitStatus /* exitStatus */) {
+    Stopped(tr("Kernel stopped, variables are lost\n"));
+}
+
+void Kernel::KernelFailed(QProcess::ProcessError error) {
+    // Other errors are followed by finished()
+    if (error == QProcess::FailedToStart) {
+        Stopped(tr("Kernel could not start %1\n").arg(m_python));
+    }
+}
+
+// Cells still queued are reported as failed, the next Run starts a new
+// process
+void Kernel::Stopped(const QString &message) {
+    if (!m_process) {
+        return;
+    }
+    m_process->disconnect(this);
+    m_process->deleteLater();
+    m_process = nullptr;
+    QList<int> ids = m_pending;
+    m_pending.clear();
+    foreach (int id, ids) {
+        emit Output(id, message, true);
+        emit Finished(id, false);
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include <QObject>
+#include <QList>
+#include <QProcess>
+#include <QString>
+#include <QVariant>
+
+// Client of the kernel (ep_kernel.py) running in a child process
+// Cells sent with Run are executed one after the other in a namespace the
+// process keeps, so a cell sees what earlier cells defined. Output of a
+// cell arrives with its id while it runs, Finished tells when it is done.
+// The process is started by the first Run and again after it stops, a new
+// process starts with an empty namespace.
+class Kernel : public QObject {
+    Q_OBJECT
+  public:
+    explicit Kernel(QObject* parent=nullptr);
+    ~Kernel();
+    void SetServer(const QString &python, const QString &script);
+    // line is where code starts in the editor, tracebacks count from there
+    // input is read from inputFile instead when one is given
+    int Run(const QString &code, int line, const QString &input,
+            const QString &inputFile);
+    void Reset();
+    void Stop();
+    bool IsBusy() const;
+
+  signals:
+    void Output(int id, const QString &text, bool error);
+    void Finished(int id, bool ok);
+
+  private slots:
+    void ReadMessages();
+    void KernelFinished(int exitCode, QProcess::ExitStatus exitStatus);
+    void KernelFailed(QProcess::ProcessError error);
+
+  private:
+    QString m_python;
+    QString m_script;
+    QProcess *m_process;
+    int m_nextId;
+    QList<int> m_pending; // cells sent and not finished, in order
+    void Start();
+    void Send(const QVariantMap &message);
+    void Stopped(const QString &message);
+};
+
+#endif // KERNEL_H
@@ -1,19 +1,47 @@
 #include "PythonAccess/emb.h"
 #include "pythonworker.h"
 
-PythonWorker::PythonWorker(QObject *parent) : QObject(parent) {
+PythonWorker::PythonWorker(QObject *parent)
+    : QObject(parent), m_mainState(nullptr) {
     this->killed.store(-2);
 }
 
-void PythonWorker::RunPython(const QString &startme, const QString &code) {
-    emit StartPythonRun();
+// WHY:
+// Interpreter lives as long as the worker thread, so state kept by the
+// runner script (such as the warm process pool) survives between runs
+void PythonWorker::InitPython() {
+    if (m_mainState) {
+        return;
+    }
     PyImport_AppendInittab("emb", emb::PyInitEmbConnect);
     PyImport_AppendInittab("express_api", emb::PyInitApiConnection);
     Py_Initialize();
-    PyImport_ImportModule("emb");
+    PyObject *embModule = PyImport_ImportModule("emb");
+    Py_XDECREF(embModule);
+    // Release the GIL, runs and jedi acquire it when they need it
+    m_mainState = PyEval_SaveThread();
+}
+
+void PythonWorker::RunPython(const QString &startme, const QString &code) {
+    emit StartPythonRun();
+    InitPython();
+
+    // WHY:
+    // sys.stdout.buffer.write can split a character between two writes, the
+    // converter states keep the started bytes until the rest arrives
+    QTextCodec *utf8 = QTextCodec::codecForName("UTF-8");
+    QTextCodec::ConverterState outputState;
+    QTextCodec::ConverterState errorState;
+
+    emb::StdOutWriteType write = [this, utf8, &outputState](const char *data,
+    Py_ssize_t size) {
+        emit this->WriteOutput(utf8->toUnicode(data, size, &outputState));
+        QThread::msleep(10);
+    };
 
-    emb::StdOutWriteType write = [this](std::string s) {
-        emit this->WriteOutput(QString::fromStdString(s));
+    emb::StdOutWriteType writeError = [this, utf8, &errorState](const char *data,
+    Py_ssize_t size) {
+        emit this->WriteError(utf8->toUnicode(data, size, &errorState));
         QThread::msleep(10);
     };
 
@@ -21,17 +49,32 @@ void PythonWorker::RunPython(const QString &startme, const QString &code) {
         return this->killed.load();
     };
 
-    emb::SetStdout(write);
-    emb::SetIsInterruptedCallback(isInterrupted);
     this->killed.store(0);
     m_gil = PyGILState_Ensure();
+    emb::SetStdout(write, writeError);
+    emb::SetIsInterruptedCallback(isInterrupted);
     PyRun_SimpleString(startme.toStdString().c_str());
-    PyGILState_Release(m_gil);
     emb::ResetStdOut();
-    Py_Finalize();
+    PyGILState_Release(m_gil);
+    // A character left unfinished by the run is shown as broken
+    if (outputState.remainingChars) {
+        emit WriteOutput(QString(QChar::ReplacementCharacter));
+    }
+    if (errorState.remainingChars) {
+        emit WriteError(QString(QChar::ReplacementCharacter));
+    }
     emit EndPythonRun();
 }
 
+PythonWorker::~PythonWorker() {
+    if (m_mainState) {
+        // Runs atexit handlers of the runner script, such as pool shutdown
+        PyEval_RestoreThread(m_mainState);
+        Py_Finalize();
+        m_mainState = nullptr;
+    }
+}
+
 // https://stackoverflow.com/questions/1420957/stopping-embedded-python
 int quit(void *) {
     PyErr_SetString(PyExc_KeyboardInterrupt, "...");
@@ -6,27 +6,35 @@
 #include <QObject>
 #include <QThread>
 #include <QAtomicInteger>
+#include <QTextCodec>
+#include "Features/tableoutput.h"
 
 
 class PythonWorker : public QObject {
     Q_OBJECT
   public:
     explicit PythonWorker(QObject *parent = 0);
+    ~PythonWorker();
     QAtomicInteger<int> killed;
 
   private:
     PyGILState_STATE m_gil;
+    PyThreadState *m_mainState;
 
   signals:
     void WriteOutput(QString result);
+    void WriteError(QString result);
     void SetInput(QString txt);
     void SetOutput(QString txt);
     void SetCode(QString txt);
     void SetSearchRegex(QString txt);
+    void AppendTable(TableColumns columns);
+    void ClearTable(QStringList headers);
     void StartPythonRun();
     void EndPythonRun();
 
   public slots:
+    void InitPython();
     void RunPython(const QString &startme, const QString &code);
     void StopPython();
 };
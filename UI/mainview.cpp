@@ -3,8 +3,11 @@
 #include "PythonAccess/pythonworker.h"
 #include "UI/mainview.h"
 #include "ui_mainview.h"
+#include "CodeEditor/fuzzymatcher.h"
 #include <QSettings>
-#include <QStringListModel>
+#include <QScrollBar>
+#include <QHeaderView>
+#include <QTreeWidgetItemIterator>
 #include <QDebug>
 
 MainView::MainView(QWidget *parent)
@@ -12,11 +15,17 @@ MainView::MainView(QWidget *parent)
     ui->setupUi(this);
     LoadSettings(); // 1) Setup UI first, so things look nice
     LoadResources(); // 2) Load the required files
+    SetupJedi(); // editors share the server
+    SetupKernel();
     SetupHighlighter(); // 3) No (2) is required for this step
     SetupTerminal();
+    SetupTableOutput(); // before python, worker feeds the table
+    SetupLargeFile();
     SetupPython();
 
     m_tute = new XTute(this);
+    SetupTestCases();
+    SetupRunQueue();
 }
 
 /**
@@ -29,9 +38,11 @@ void MainView::SetupPython() {
     m_workerThread = new QThread();
     m_worker->moveToThread(m_workerThread);
     connect(m_workerThread, &QThread::finished, m_worker, &QObject::deleteLater);
+    connect(m_workerThread, &QThread::started, m_worker, &PythonWorker::InitPython);
     connect(this, &MainView::operate, m_worker, &PythonWorker::RunPython);
     connect(this, &MainView::terminate, m_worker, &PythonWorker::StopPython);
     connect(m_worker, &PythonWorker::WriteOutput, this, &MainView::WriteOutput);
+    connect(m_worker, &PythonWorker::WriteError, this, &MainView::WriteError);
     connect(m_worker, &PythonWorker::SetCode, this, &MainView::SetCode);
     connect(m_worker, &PythonWorker::SetInput, this, &MainView::SetInput);
     connect(m_worker, &PythonWorker::SetOutput, this, &MainView::SetOutput);
@@ -40,30 +51,52 @@ void MainView::SetupPython() {
     connect(m_worker, &PythonWorker::EndPythonRun, this, &MainView::EndPythonRun);
     connect(m_worker, &PythonWorker::SetSearchRegex, this,
             &MainView::SetSearchRegex);
+    connect(m_worker, &PythonWorker::AppendTable, m_tableModel,
+            &TableOutputModel::AppendColumns);
+    connect(m_worker, &PythonWorker::AppendTable, this, &MainView::ShowTable);
+    connect(m_worker, &PythonWorker::ClearTable, m_tableModel,
+            &TableOutputModel::Clear);
     m_workerThread->start();
 }
-// Buttons to enable when you execute a python script
+
+// WHY:
+// Jedi runs in its own process, so completing does not wait for a running
+// script and a jedi crash only restarts the server. It is started now and
+// loads in the background.
+void MainView::SetupJedi() {
+    m_jedi = new Jedi(this);
+    m_jedi->SetServer(CHILD_PYTHON, m_jediServer);
+    m_jedi->Start();
+}
+
+// WHY:
+// Cells run in a long lived child process, so variables live on between
+// cells and a cell can run while the main script does. The process only
+// starts when the first cell is run.
+void MainView::SetupKernel() {
+    m_kernel = new Kernel(this);
+    m_kernel->SetServer(CHILD_PYTHON, m_kernelServer);
+    connect(m_kernel, &Kernel::Output, this, &MainView::KernelOutput);
+    connect(m_kernel, &Kernel::Finished, this, &MainView::KernelFinished);
+    connect(ui->txtCode, &CodeEditor::RunRequested, this, &MainView::RunCell);
+    ui->txtCode->SetCellsEnabled(true);
+}
+// Run buttons stay enabled, runs started meanwhile wait in the queue
 void MainView::StartPythonRun() {
     this->SaveContent(); // Backup the typed content and window positions
-    ui->btnRun->setEnabled(false);
-    ui->btnRunSnippet->setEnabled(false);
-    ui->btnRunSnippetFromCombo->setEnabled(false);
-    ui->dwTutorial->setEnabled(false);
     ui->btnStopPython->setEnabled(true);
 }
 // End python script
 void MainView::EndPythonRun() {
-    if (m_markTute) {
-        m_tute->Mark(m_markIndex, ui->txtOutput->toPlainText(), ui->lwTute, ui->pbTute);
-        m_markTute = false;
-        m_markIndex = -1;
+    int id = m_embeddedRun;
+    m_embeddedRun = -1;
+    RunJob job = m_runQueue->Job(id);
+    if (m_runQueue->Contains(id) && job.kind == RUN_TUTE && !job.cancelling) {
+        m_tute->Mark(job.tag, ChannelText(CHANNEL_STDOUT), ui->lwTute, ui->pbTute);
     }
-
-    ui->btnRun->setEnabled(true);
-    ui->btnRunSnippet->setEnabled(true);
-    ui->btnRunSnippetFromCombo->setEnabled(true);
-    ui->dwTutorial->setEnabled(true);
     ui->btnStopPython->setEnabled(false);
+    // May start the next run right away
+    m_runQueue->EmbeddedFinished(id, !m_embeddedFailed);
 }
 // Util function: Confirm message box
 bool MainView::Confirm(const QString &what) {
@@ -129,7 +162,34 @@ void MainView::SetupHighlighter() {
     ui->txtCode->setFocus();
     m_highlighterSnippetArea =
         new PythonSyntaxHighlighter(ui->txtSnippet->document());
+    m_searchCodeArea = new SearchOverlay(ui->txtCode);
+    connect(m_searchCodeArea, &SearchOverlay::MatchesChanged, this,
+            &MainView::SearchMatchesChanged);
+    SearchMatchesChanged(0, 0);
+    // After the highlighter, so block states are fresh when lines are read
+    m_symbolsCodeArea = new SymbolIndex(ui->txtCode->document());
+    ui->txtCode->SetSymbolIndex(m_symbolsCodeArea);
+    connect(m_symbolsCodeArea, &SymbolIndex::SymbolsChanged, this,
+            &MainView::RefreshOutline);
+    connect(m_symbolsCodeArea, &SymbolIndex::SymbolsMoved, this,
+            &MainView::MoveOutline);
+    m_symbolsSnippetArea = new SymbolIndex(ui->txtSnippet->document());
+    // Diagnostics last, its hover tips come before the docs
+    m_callTipsCodeArea = new CallTips(ui->txtCode, m_jedi, m_symbolsCodeArea);
+    m_diagnosticsCodeArea = new Diagnostics(ui->txtCode, m_jedi);
+    // Queued, formatting lines from inside a repaint request would recurse
+    connect(ui->txtCode, &CodeEditor::VisibleBlocksChanged,
+            m_highlighterCodeArea, &PythonSyntaxHighlighter::SetVisibleBlocks,
+            Qt::QueuedConnection);
+    connect(ui->txtSnippet, &CodeEditor::VisibleBlocksChanged,
+            m_highlighterSnippetArea, &PythonSyntaxHighlighter::SetVisibleBlocks,
+            Qt::QueuedConnection);
     SetCompleter(ui->txtCode);
+    // Names from both editors are offered in the code editor
+    connect(m_symbolsCodeArea, &SymbolIndex::WordsChanged, m_completionIndex,
+            &CompletionIndex::AddUses);
+    connect(m_symbolsSnippetArea, &SymbolIndex::WordsChanged, m_completionIndex,
+            &CompletionIndex::AddUses);
 }
 
 void MainView::SetupTerminal() {
@@ -158,6 +218,7 @@ void MainView::SetTerminal() {
 
 void MainView::SetCompleter(CodeEditor *editor) {
     completer = new QCompleter(this);
+    m_completionIndex = new CompletionIndex(this);
 
     QFile file(":/data/Features/autocomplete.txt");
     if (!file.open(QFile::ReadOnly))
@@ -173,29 +234,88 @@ void MainView::SetCompleter(CodeEditor *editor) {
     }
 
     QApplication::restoreOverrideCursor();
-    QStringListModel *model = new QStringListModel(words, completer);
+    m_completionIndex->AddBuiltins(words);
 
-    completer->setModel(model);
-    completer->setModelSorting(QCompleter::CaseSensitivelySortedModel);
+    // Already matched and ranked, the completer shows the list as it is
+    completer->setModel(m_completionIndex->Model());
+    completer->setModelSorting(QCompleter::UnsortedModel);
     completer->setCaseSensitivity(Qt::CaseInsensitive);
-    completer->setCompletionMode(QCompleter::PopupCompletion);
+    completer->setCompletionMode(QCompleter::UnfilteredPopupCompletion);
     completer->setWrapAround(false);
     completer->popup()->setStyleSheet("background-color: black; color: white");
 
     editor->setCompleter(completer);
+    editor->SetCompletionIndex(m_completionIndex);
 
     // Jedi Completer
+    // The editor gives it a model and fills it
     QCompleter* jediCompleter = new QCompleter();
-    QStringListModel *initialJedi = new QStringListModel(words, jediCompleter);
-
-    jediCompleter->setModel(initialJedi);
-    jediCompleter->setModelSorting(QCompleter::CaseSensitivelySortedModel);
+    jediCompleter->setModelSorting(QCompleter::UnsortedModel);
     jediCompleter->setCaseSensitivity(Qt::CaseInsensitive);
-    jediCompleter->setCompletionMode(QCompleter::PopupCompletion);
+    // Fuzzy matches would be filtered out by prefix
+    jediCompleter->setCompletionMode(QCompleter::UnfilteredPopupCompletion);
     jediCompleter->setWrapAround(false);
     jediCompleter->popup()->setStyleSheet("background-color: #9090FF; color: black");
 
-    editor->setJediCompleter(jediCompleter, this->m_getJedi);
+    editor->setJediCompleter(jediCompleter, m_jedi);
+}
+
+void MainView::RefreshOutline() {
+    ui->twOutline->clear();
+    QList<QTreeWidgetItem *> parents; // last item at each depth
+    foreach (const Symbol &symbol, m_symbolsCodeArea->Outline()) {
+        QTreeWidgetItem *item;
+        if (symbol.depth > 0 && symbol.depth <= parents.size()) {
+            item = new QTreeWidgetItem(parents.at(symbol.depth - 1));
+        } else {
+            item = new QTreeWidgetItem(ui->twOutline);
+        }
+        while (parents.size() > symbol.depth) {
+            parents.removeLast();
+        }
+        parents.append(item);
+        QString prefix;
+        if (symbol.kind == SYMBOL_CLASS) {
+            prefix = "class ";
+        } else if (symbol.kind == SYMBOL_FUNCTION) {
+            prefix = "def ";
+        }
+        item->setText(0, prefix + symbol.name);
+        item->setText(1, QString::number(symbol.line + 1));
+        item->setData(0, Qt::UserRole, symbol.line);
+    }
+    ui->twOutline->expandAll();
+}
+
+// WHY:
+// Items are made in outline order, walking the tree visits them in that
+// order too, so new line numbers are written in place and the tree keeps
+// its scroll position and folded items
+void MainView::MoveOutline() {
+    Symbols outline = m_symbolsCodeArea->Outline();
+    QTreeWidgetItemIterator it(ui->twOutline);
+    int index = 0;
+    for (; *it && index < outline.size(); ++it, ++index) {
+        int line = outline.at(index).line;
+        (*it)->setText(1, QString::number(line + 1));
+        (*it)->setData(0, Qt::UserRole, line);
+    }
+    if (*it || index != outline.size()) {
+        // Out of step with the tree
+        RefreshOutline();
+    }
+}
+
+void MainView::on_twOutline_itemActivated(QTreeWidgetItem *item,
+        int /* column */) {
+    QTextBlock block = ui->txtCode->document()->findBlockByNumber(
+                           item->data(0, Qt::UserRole).toInt());
+    if (!block.isValid()) {
+        return;
+    }
+    ui->txtCode->setTextCursor(QTextCursor(block));
+    ui->txtCode->centerCursor();
+    ui->txtCode->setFocus();
 }
 
 void MainView::LoadResources() {
@@ -210,7 +330,21 @@ void MainView::LoadResources() {
         QMessageBox::critical(this, tr(APP_NAME), tr("Loading startup script failed"));
         qApp->quit();
     }
-    m_getJedi = LoadFile(":/data/ep_jedi.py", success);
+    m_jediServer = LoadFile(":/data/ep_jedi.py", success);
+
+    if (!success) {
+        QMessageBox::critical(this, tr(APP_NAME), tr("Loading startup script failed"));
+        qApp->quit();
+    }
+
+    m_kernelServer = LoadFile(":/data/ep_kernel.py", success);
+
+    if (!success) {
+        QMessageBox::critical(this, tr(APP_NAME), tr("Loading startup script failed"));
+        qApp->quit();
+    }
+
+    m_caseBootstrap = LoadFile(":/data/ep_case.py", success);
 
     if (!success) {
         QMessageBox::critical(this, tr(APP_NAME), tr("Loading startup script failed"));
@@ -285,6 +419,17 @@ void MainView::BrowseAndLoadFile(CodeEditor *codeEditor, const bool isPython) {
     if (fileName.isEmpty()) {
         return;
     }
+    // WHY:
+    // readAll + setPlainText freezes the UI for minutes on huge files,
+    // input is attached instead, anything else opens in the large file view
+    if (QFileInfo(fileName).size() > LARGE_FILE_THRESHOLD) {
+        if (codeEditor == ui->txtInput) {
+            AttachInputFile(fileName);
+        } else {
+            OpenLargeFile(fileName);
+        }
+        return;
+    }
     bool success;
     QString text = LoadFile(fileName, success);
     if (success) {
@@ -317,6 +462,11 @@ void MainView::SaveFile(CodeEditor *codeEditor, const bool isPython) {
 QString MainView::GetInput() {
     return ui->txtInput->toPlainText();
 }
+// Empty when input comes from the input box
+QString MainView::GetInputFile() {
+    QMutexLocker locker(&m_inputFileLock);
+    return m_inputFile;
+}
 void MainView::SetInput(QString txt) {
     ui->txtInput->setPlainText(txt);
 }
@@ -324,7 +474,12 @@ QString MainView::GetOutput() {
     return ui->txtOutput->toPlainText();
 }
 void MainView::SetOutput(QString txt) {
-    ui->txtOutput->setPlainText(txt);
+    m_outputLog.clear();
+    if (!txt.isEmpty()) {
+        OutputChunk chunk = {CHANNEL_STDOUT, txt};
+        m_outputLog << chunk;
+    }
+    RenderOutput();
 }
 QString MainView::GetCode() {
     return ui->txtCode->toPlainText();
@@ -334,27 +489,156 @@ void MainView::SetCode(QString txt) {
 }
 
 void MainView::SetSearchRegex(QString txt) {
-    m_highlighterCodeArea->SetSearchRegEx(txt);
-    m_highlighterCodeArea->rehighlight();
+    m_searchCodeArea->SetPattern(txt);
+}
+
+void MainView::on_btnSearchNext_clicked() {
+    m_searchCodeArea->FindNext();
+}
+
+void MainView::on_btnSearchPrev_clicked() {
+    m_searchCodeArea->FindPrevious();
+}
+
+// Search controls only show up while set_search_regex has a pattern
+void MainView::SearchMatchesChanged(int current, int count) {
+    bool active = m_searchCodeArea->IsActive();
+    ui->lblSearchMatches->setVisible(active);
+    ui->btnSearchPrev->setVisible(active);
+    ui->btnSearchNext->setVisible(active);
+    if (current > 0) {
+        ui->lblSearchMatches->setText(tr("%1/%2 matches").arg(current).arg(count));
+    } else {
+        ui->lblSearchMatches->setText(tr("%1 matches").arg(count));
+    }
 }
 
 void MainView::WriteOutput(QString output) {
-    QString txt = ui->txtOutput->toPlainText();
-    txt.append(output);
-    ui->txtOutput->setPlainText(txt);
+    AppendOutput(CHANNEL_STDOUT, output);
+    RunOutput(m_embeddedRun, output, false);
+}
+
+// WHY:
+// The runner prints a traceback when the code fails and has no exit code
+// to give back, a run that wrote errors is shown as failed
+void MainView::WriteError(QString output) {
+    AppendOutput(CHANNEL_STDERR, output);
+    RunOutput(m_embeddedRun, output, true);
+    m_embeddedFailed = true;
+}
+
+// Output is logged per channel, so filtering keeps the relative order
+void MainView::AppendOutput(int channel, const QString &output) {
+    if (!m_outputLog.isEmpty() && m_outputLog.last().channel == channel) {
+        m_outputLog.last().text.append(output);
+    } else {
+        OutputChunk chunk = {channel, output};
+        m_outputLog << chunk;
+    }
+
+    if (!(m_outputFilter & channel)) {
+        return;
+    }
+
+    QScrollBar *bar = ui->txtOutput->verticalScrollBar();
+    bool atEnd = (bar->value() == bar->maximum());
+    InsertOutput(channel, output);
+    if (atEnd) {
+        bar->setValue(bar->maximum());
+    }
+}
+
+// Append to output pane, a '\r' overwrites the last line (progress bars)
+void MainView::InsertOutput(int channel, const QString &output) {
+    QTextCharFormat format;
+    if (channel == CHANNEL_STDERR) {
+        format.setForeground(QColor(255, 100, 100));
+    }
+
+    QTextCursor cursor(ui->txtOutput->document());
+    cursor.movePosition(QTextCursor::End);
+    cursor.beginEditBlock();
+    QStringList parts = output.split(QChar('\r'));
+    for (int i = 0; i < parts.size(); i++) {
+        if (i > 0) {
+            cursor.movePosition(QTextCursor::StartOfBlock, QTextCursor::KeepAnchor);
+            cursor.removeSelectedText();
+        }
+        cursor.insertText(parts.at(i), format);
+    }
+    cursor.endEditBlock();
+}
+
+// Rebuild output pane from the log, edits typed into the pane are lost
+void MainView::RenderOutput() {
+    ui->txtOutput->clear();
+    foreach (OutputChunk chunk, m_outputLog) {
+        if (m_outputFilter & chunk.channel) {
+            InsertOutput(chunk.channel, chunk.text);
+        }
+    }
 }
 
-void MainView::RunPythonCode(const QString &code) {
-    m_markTute = false;
-    m_markIndex = -1;
-    emit operate(m_startMe, code);
+QString MainView::ChannelText(int channel) {
+    QString text;
+    foreach (OutputChunk chunk, m_outputLog) {
+        if (channel & chunk.channel) {
+            text.append(chunk.text);
+        }
+    }
+    return text;
+}
+
+void MainView::on_cmbOutputChannel_currentIndexChanged(int index) {
+    static const int filters[] = {CHANNEL_ALL, CHANNEL_STDOUT, CHANNEL_STDERR};
+    m_outputFilter = filters[qBound(0, index, 2)];
+    RenderOutput();
 }
 
 void MainView::on_btnRun_clicked() {
-    if (ui->chkClearOut->isChecked()) {
-        ui->txtOutput->clear();
+    QueueRun(RUN_CODE, tr("Code"), ui->txtCode->toPlainText(), PRIORITY_HIGH);
+}
+
+void MainView::on_btnRunCell_clicked() {
+    ui->txtCode->RunCell(false);
+}
+
+// A running cell can only be stopped with its process, an idle kernel just
+// drops its variables
+void MainView::on_btnKernelRestart_clicked() {
+    if (m_kernel->IsBusy()) {
+        m_kernel->Stop();
+    } else {
+        m_kernel->Reset();
+        AppendOutput(CHANNEL_STDOUT, tr("Kernel variables cleared\n"));
+    }
+}
+
+// Lines are 0 based, shown 1 based like the line numbers
+void MainView::RunCell(const QString &code, int first, int last) {
+    int id = m_kernel->Run(code, first, GetInput(), GetInputFile());
+    if (id < 0) {
+        return;
+    }
+    m_cellHeaders.insert(id, tr("--- Cell, lines %1-%2 ---\n").arg(first + 1)
+                         .arg(last + 1));
+}
+
+// WHY:
+// Cells queue up in the kernel, a header is written when its cell starts
+// writing so output of a cell always follows its own header
+void MainView::KernelOutput(int id, const QString &text, bool error) {
+    if (m_cellHeaders.contains(id)) {
+        AppendOutput(CHANNEL_STDOUT, m_cellHeaders.take(id));
+    }
+    AppendOutput(error ? CHANNEL_STDERR : CHANNEL_STDOUT, text);
+}
+
+void MainView::KernelFinished(int id, bool /* ok */) {
+    if (m_cellHeaders.contains(id)) {
+        // Printed nothing
+        AppendOutput(CHANNEL_STDOUT, m_cellHeaders.take(id));
     }
-    RunPythonCode(ui->txtCode->toPlainText());
 }
 
 void MainView::ChangeFontSize(QFont font, int fontSize) {
@@ -390,7 +674,7 @@ void MainView::on_btnInputClear_clicked() {
 
 void MainView::on_btnOutputClear_clicked() {
     if (Confirm(tr("Are you sure you want to clear output ?"))) {
-        ui->txtOutput->clear();
+        SetOutput(QString());
     }
 }
 
@@ -402,6 +686,41 @@ void MainView::on_btnInputOpen_clicked() {
     BrowseAndLoadFile(ui->txtInput);
 }
 
+void MainView::on_btnInputAttach_clicked() {
+    if (!GetInputFile().isEmpty()) {
+        AttachInputFile(QString());
+        return;
+    }
+    QString fileName = QFileDialog::getOpenFileName(
+                           this, tr("Attach Input"), QString(), FILETYPES_OTHER);
+    if (!fileName.isEmpty()) {
+        AttachInputFile(fileName);
+    }
+}
+
+// WHY:
+// Attached files are never loaded into the input box, the child reads
+// the file itself, so inputs bigger than the editor can handle still work
+void MainView::AttachInputFile(const QString &fileName) {
+    {
+        QMutexLocker locker(&m_inputFileLock);
+        m_inputFile = fileName;
+    }
+    bool attached = !fileName.isEmpty();
+    ui->txtInput->setEnabled(!attached);
+    ui->btnInputAttach->setToolTip(attached ?
+                                   tr("Detach input file") :
+                                   tr("Attach a file as input without loading it"));
+    if (attached) {
+        QFileInfo info(fileName);
+        ui->dwInput->setWindowTitle(tr("Input (attached %1, %2 KB)")
+                                    .arg(info.fileName())
+                                    .arg(info.size() / 1024));
+    } else {
+        ui->dwInput->setWindowTitle(tr("Input"));
+    }
+}
+
 void MainView::on_btnCodeOpen_clicked() {
     if (!ui->txtCode->toPlainText().isEmpty() &&
             Confirm(tr("Would you like to save code ?"))) {
@@ -440,7 +759,8 @@ void MainView::on_btnRunSnippet_clicked() {
         return;
     }
 
-    RunPythonCode(ui->txtSnippet->toPlainText());
+    QueueRun(RUN_SNIPPET, tr("Snippet"), ui->txtSnippet->toPlainText(),
+             PRIORITY_NORMAL);
 }
 
 void MainView::on_btnLoadSnippet_clicked() {
@@ -510,10 +830,22 @@ void MainView::LoadSnippetsToCombo() {
     bool success;
     QList<QString> keys = m_snippets->GetKeys(success);
     if (success) {
-        ui->cmbSnippets->addItems(QStringList(keys));
+        QStringList names(keys);
+        QString search = ui->txtSnippetSearch->text();
+        if (!search.isEmpty()) {
+            // Best match first, so it is the selected one
+            FuzzyMatcher matcher;
+            matcher.SetCandidates(names);
+            names = matcher.Match(search, names.size());
+        }
+        ui->cmbSnippets->addItems(names);
     }
 }
 
+void MainView::on_txtSnippetSearch_textChanged(const QString & /* text */) {
+    LoadSnippetsToCombo();
+}
+
 void MainView::on_btnUpdateSnippet_clicked() {
     if (ui->txtSnippet->toPlainText().isEmpty()) {
         return;
@@ -563,7 +895,8 @@ void MainView::on_btnRunSnippetFromCombo_clicked() {
     QString code =
         m_snippets->GetSnippet(ui->cmbSnippets->currentText(), success);
     if (success) {
-        RunPythonCode(code);
+        QueueRun(RUN_SNIPPET, ui->cmbSnippets->currentText(), code,
+                 PRIORITY_NORMAL);
     }
 }
 
@@ -626,19 +959,12 @@ void MainView::on_btnTuteMark_clicked() {
     if (index < 0 || index >= ui->lwTute->count()) {
         return;
     }
-    // Reset input before marking
-    m_tute->SetInput(index, ui->txtInput);
-
-    ui->txtOutput->clear();
-    m_markTute = true;
-    m_markIndex = index;
-
-    emit operate(m_startMe, ui->txtCode->toPlainText());
+    QueueRun(RUN_TUTE, tr("Question %1").arg(index + 1),
+             ui->txtCode->toPlainText(), PRIORITY_HIGH, index);
 }
 
 void MainView::on_btnStopPython_clicked() {
-    m_worker->killed.store(1);
-    //emit this->terminate();
+    m_runQueue->Cancel(m_embeddedRun);
 }
 
 void MainView::on_btnTerminal_clicked() {
@@ -654,3 +980,454 @@ void MainView::on_btnTerminal_clicked() {
     QMessageBox::information(this, tr(APP_NAME), tr("Currently, terminal is not available for Windows"));
 #endif
 }
+
+// =========================================================================
+// TEST CASES
+// =========================================================================
+void MainView::SetupTestCases() {
+    m_testCases = new TestCases(this);
+    m_caseRunner = new TestRunner(this);
+    m_caseRunner->SetPython(CHILD_PYTHON, m_caseBootstrap);
+    connect(m_caseRunner, &TestRunner::CaseStarted, this, &MainView::CaseStarted);
+    connect(m_caseRunner, &TestRunner::CaseFinished, this,
+            &MainView::CaseFinished);
+    connect(m_caseRunner, &TestRunner::Finished, this, &MainView::CasesFinished);
+    ui->btnCaseStop->setEnabled(false);
+    LoadCasesToTable();
+}
+
+void MainView::LoadCasesToTable() {
+    QList<QString> keys = m_testCases->GetKeys();
+    ui->twCases->setRowCount(keys.size());
+    for (int row = 0; row < keys.size(); row++) {
+        ui->twCases->setItem(row, 0, new QTableWidgetItem(keys.at(row)));
+        for (int column = 1; column < ui->twCases->columnCount(); column++) {
+            ui->twCases->setItem(row, column, new QTableWidgetItem(tr("-")));
+        }
+    }
+    m_caseOutputs.clear();
+    ui->pbCases->setValue(0);
+}
+
+void MainView::on_btnCaseAdd_clicked() {
+    // WHY: Reloading the table while cases run would mix up their rows
+    if (m_caseRunner->IsRunning()) {
+        return;
+    }
+    bool ok = false;
+    QString text = QInputDialog::getText(this, tr(APP_NAME), tr("Case name:"),
+                                         QLineEdit::Normal, tr(""), &ok);
+    if (!ok || text.isEmpty()) {
+        return;
+    }
+    if (!TestCases::IsValidName(text)) {
+        QMessageBox::warning(this, tr(APP_NAME),
+                             tr("Case names may only use letters, digits, _ . and -"));
+        return;
+    }
+
+    if (!m_testCases->OkToInsert(text)) {
+        ok = Confirm(tr("This case already exists, do you want to overwrite ?"));
+    }
+
+    if (!ok) {
+        return;
+    }
+
+    m_testCases->AddCase(text, GetInput(), GetOutput(), ok);
+    if (!ok) {
+        QMessageBox::critical(this, tr(APP_NAME), tr("Case adding failed."));
+    }
+    LoadCasesToTable();
+}
+
+void MainView::on_btnCaseRemove_clicked() {
+    int row = ui->twCases->currentRow();
+    if (row < 0 || m_caseRunner->IsRunning()) {
+        return;
+    }
+    if (!Confirm(tr("Are you sure you want to delete the selected case ?"))) {
+        return;
+    }
+
+    bool success;
+    m_testCases->RemoveCase(ui->twCases->item(row, 0)->text(), success);
+    if (!success) {
+        QMessageBox::critical(this, tr(APP_NAME), tr("Case removal failed."));
+    }
+    LoadCasesToTable();
+}
+
+void MainView::on_btnCaseLoad_clicked() {
+    int row = ui->twCases->currentRow();
+    if (row < 0) {
+        return;
+    }
+
+    bool success;
+    TestCase testCase = m_testCases->GetCase(ui->twCases->item(row, 0)->text(),
+                        success);
+    if (success) {
+        SetInput(testCase.input);
+        // Show what the last run produced, if there was one
+        SetOutput(row < m_caseOutputs.size() ? m_caseOutputs.at(row) : QString());
+    }
+}
+
+void MainView::on_btnCaseRun_clicked() {
+    LoadCasesToTable();
+    QList<TestCase> cases = m_testCases->GetCases();
+    for (int i = 0; i < cases.size(); i++) {
+        m_caseOutputs << QString();
+        ui->twCases->item(i, 1)->setText(tr("Pending"));
+    }
+    m_casesDone = 0;
+    ui->pbCases->setValue(0);
+
+    bool success;
+    m_caseRunner->Run(GetCode(), cases, success);
+    if (success) {
+        ui->btnCaseRun->setEnabled(false);
+        ui->btnCaseStop->setEnabled(true);
+    }
+}
+
+void MainView::on_btnCaseStop_clicked() {
+    m_caseRunner->Stop();
+}
+
+void MainView::CaseStarted(int index) {
+    ui->twCases->item(index, 1)->setText(tr("Running"));
+}
+
+void MainView::CaseFinished(int index, int state, qint64 elapsedMs,
+                            qint64 peakKb, QString output) {
+    static const QStringList states = QStringList() << tr("Pending")
+                                      << tr("Running") << tr("Passed") << tr("Failed") << tr("Error")
+                                      << tr("Timeout") << tr("Stopped");
+    ui->twCases->item(index, 1)->setText(states.value(state));
+    ui->twCases->item(index, 1)->setForeground(
+        state == TEST_PASSED ? Qt::darkGreen : Qt::red);
+    ui->twCases->item(index, 2)->setText(QString::number(elapsedMs));
+    ui->twCases->item(index, 3)->setText(
+        peakKb < 0 ? tr("-") : QString::number(peakKb));
+    m_caseOutputs[index] = output;
+
+    // Every case finishes once per run, stopped ones included
+    m_casesDone++;
+    ui->pbCases->setValue((int)(m_casesDone * 100.0 / ui->twCases->rowCount()));
+}
+
+void MainView::CasesFinished(int passed, int total) {
+    ui->btnCaseRun->setEnabled(true);
+    ui->btnCaseStop->setEnabled(false);
+    ui->dwTestCases->setWindowTitle(tr("Test Cases (%1/%2 passed)")
+                                    .arg(passed).arg(total));
+}
+
+// =========================================================================
+// TABLE OUTPUT
+// =========================================================================
+void MainView::SetupTableOutput() {
+    m_tableModel = new TableOutputModel(this);
+    ui->tvTable->setModel(m_tableModel);
+    // WHY:
+    // Fixed row height lets the view compute scroll positions without
+    // asking the model, so a million rows scroll as fast as ten
+    QHeaderView *rows = ui->tvTable->verticalHeader();
+    rows->setSectionResizeMode(QHeaderView::Fixed);
+    rows->setDefaultSectionSize(ui->tvTable->fontMetrics().height() + 6);
+    ui->tvTable->horizontalHeader()->setSectionResizeMode(QHeaderView::Interactive);
+    ui->tvTable->horizontalHeader()->setSortIndicator(-1, Qt::AscendingOrder);
+    ui->tvTable->setSortingEnabled(true);
+    connect(m_tableModel, &QAbstractItemModel::rowsInserted, this,
+            &MainView::TableRowsChanged);
+    connect(m_tableModel, &QAbstractItemModel::modelReset, this, [this]() {
+        ui->tvTable->horizontalHeader()->setSortIndicator(-1, Qt::AscendingOrder);
+        TableRowsChanged();
+    });
+    connect(m_tableModel, &TableOutputModel::SortStarted, this, [this]() {
+        ui->lblTableRows->setText(tr("%1 rows, sorting...")
+                                  .arg(m_tableModel->rowCount()));
+    });
+    connect(m_tableModel, &TableOutputModel::SortFinished, this,
+            &MainView::TableRowsChanged);
+}
+
+void MainView::TableRowsChanged() {
+    ui->lblTableRows->setText(tr("%1 rows").arg(m_tableModel->rowCount()));
+}
+
+void MainView::ShowTable() {
+    if (ui->dwTable->isHidden()) {
+        ui->dwTable->show();
+    }
+}
+
+void MainView::on_btnTableClear_clicked() {
+    m_tableModel->Clear(QStringList());
+}
+
+// =========================================================================
+// LARGE FILES
+// =========================================================================
+void MainView::SetupLargeFile() {
+    connect(ui->lfvLargeFile, &LargeFileView::IndexProgress, this,
+            &MainView::LargeFileIndexed);
+    connect(ui->lfvLargeFile, &LargeFileView::IndexFinished, this,
+            &MainView::LargeFileIndexed);
+    connect(ui->lfvLargeFile, &LargeFileView::FindFinished, this,
+            &MainView::LargeFileFound);
+    ui->txtLargeFileLine->setValidator(
+        new QRegExpValidator(QRegExp("[0-9]{1,12}"), this));
+    ui->dwLargeFile->hide();
+}
+
+void MainView::OpenLargeFile(const QString &fileName) {
+    if (ui->lfvLargeFile->IsModified() &&
+            !Confirm(tr("Discard edits in %1 ?").arg(ui->lfvLargeFile->FileName()))) {
+        return;
+    }
+    bool success;
+    ui->lfvLargeFile->Open(fileName, success);
+    if (!success) {
+        QMessageBox::warning(this, tr(APP_NAME),
+                             tr("Cannot open file %1.").arg(fileName));
+        return;
+    }
+    ui->dwLargeFile->setWindowTitle(tr("Large File - %1")
+                                    .arg(QFileInfo(fileName).fileName()));
+    ui->dwLargeFile->show();
+    ui->dwLargeFile->raise();
+    LargeFileIndexed();
+}
+
+void MainView::LargeFileIndexed() {
+    LargeFileView *view = ui->lfvLargeFile;
+    QString info = tr("%1 lines, %2 MB").arg(view->LineCount())
+                   .arg(view->FileSize() / (1024 * 1024));
+    if (view->IsIndexing()) {
+        info.append(tr(", indexing..."));
+    }
+    ui->lblLargeFileInfo->setText(info);
+}
+
+void MainView::LargeFileFound(qint64 line) {
+    if (line < 0) {
+        ui->lblLargeFileInfo->setText(tr("Not found"));
+        return;
+    }
+    LargeFileIndexed();
+}
+
+void MainView::on_btnLargeFileSave_clicked() {
+    if (!ui->lfvLargeFile->IsModified()) {
+        return;
+    }
+    bool success;
+    ui->lfvLargeFile->Save(success);
+    if (!success) {
+        QMessageBox::critical(this, tr(APP_NAME), tr("Saving file failed."));
+    }
+}
+
+void MainView::on_btnLargeFileClose_clicked() {
+    if (ui->lfvLargeFile->IsModified() &&
+            !Confirm(tr("Discard edits in %1 ?").arg(ui->lfvLargeFile->FileName()))) {
+        return;
+    }
+    ui->lfvLargeFile->Close();
+    ui->dwLargeFile->hide();
+}
+
+void MainView::on_btnLargeFileFindNext_clicked() {
+    ui->lfvLargeFile->Find(ui->txtLargeFileFind->text(), true);
+}
+
+void MainView::on_btnLargeFileFindPrev_clicked() {
+    ui->lfvLargeFile->Find(ui->txtLargeFileFind->text(), false);
+}
+
+void MainView::on_txtLargeFileFind_returnPressed() {
+    on_btnLargeFileFindNext_clicked();
+}
+
+void MainView::on_txtLargeFileLine_returnPressed() {
+    ui->lfvLargeFile->GotoLine(ui->txtLargeFileLine->text().toLongLong() - 1);
+    ui->lfvLargeFile->setFocus();
+}
+
+// =========================================================================
+// RUN QUEUE
+// =========================================================================
+// WHY:
+// Runs wait in a queue instead of disabling the run buttons. The embedded
+// interpreter still runs one at a time, background runs use processes of
+// their own and do not hold anything else up.
+void MainView::SetupRunQueue() {
+    m_runQueue = new RunQueue(this);
+    m_runQueue->SetPython(CHILD_PYTHON, m_caseBootstrap);
+    connect(m_runQueue, &RunQueue::StartEmbedded, this,
+            &MainView::StartEmbeddedRun);
+    connect(m_runQueue, &RunQueue::StopEmbedded, this,
+            &MainView::StopEmbeddedRun);
+    connect(m_runQueue, &RunQueue::Output, this, &MainView::RunOutput);
+    connect(m_runQueue, &RunQueue::StateChanged, this,
+            &MainView::RunStateChanged);
+    connect(m_runQueue, &RunQueue::Forgotten, this, &MainView::RunForgotten);
+}
+
+// Runs in the embedded interpreter
+int MainView::QueueRun(int kind, const QString &name, const QString &code,
+                       int priority, int tag) {
+    RunJob job;
+    job.kind = kind;
+    job.target = TARGET_EMBEDDED;
+    job.priority = priority;
+    job.tag = tag;
+    job.name = name;
+    job.code = code;
+    return m_runQueue->Add(job);
+}
+
+// Input box and attached file are read now, the code may change before
+// the run starts
+void MainView::on_btnRunBackground_clicked() {
+    RunJob job;
+    job.kind = RUN_BACKGROUND;
+    job.target = TARGET_PROCESS;
+    job.priority = PRIORITY_LOW;
+    job.tag = -1;
+    job.name = tr("Background");
+    job.code = ui->txtCode->toPlainText();
+    job.input = GetInput();
+    job.inputFile = GetInputFile();
+    int id = m_runQueue->Add(job);
+    ui->dwRuns->show();
+    if (m_runTabs.contains(id)) {
+        ui->twRuns->setCurrentWidget(m_runTabs.value(id));
+    }
+}
+
+// Output and input boxes are prepared when the run starts, not when it is
+// queued, so a run waiting behind another one does not clear its output
+void MainView::StartEmbeddedRun(int id) {
+    RunJob job = m_runQueue->Job(id);
+    m_embeddedRun = id;
+    m_embeddedFailed = false;
+    if (job.kind == RUN_TUTE) {
+        // Reset input before marking
+        m_tute->SetInput(job.tag, ui->txtInput);
+        SetOutput(QString());
+    } else if (job.kind == RUN_CODE && ui->chkClearOut->isChecked()) {
+        SetOutput(QString());
+        m_tableModel->Clear(QStringList());
+    }
+    emit operate(m_startMe, job.code);
+}
+
+void MainView::StopEmbeddedRun(int /* id */) {
+    m_worker->killed.store(1);
+}
+
+void MainView::RunOutput(int id, const QString &text, bool error) {
+    QPlainTextEdit *tab = m_runTabs.value(id);
+    if (!tab) {
+        return;
+    }
+    QTextCharFormat format;
+    if (error) {
+        format.setForeground(QColor(255, 100, 100));
+    }
+    QScrollBar *bar = tab->verticalScrollBar();
+    bool atEnd = (bar->value() == bar->maximum());
+    QTextCursor cursor(tab->document());
+    cursor.movePosition(QTextCursor::End);
+    cursor.insertText(text, format);
+    if (atEnd) {
+        bar->setValue(bar->maximum());
+    }
+}
+
+// Each run gets a tab when queued, its title shows the state
+void MainView::RunStateChanged(int id, int state) {
+    if (m_runQueue->Contains(id)) {
+        RunJob job = m_runQueue->Job(id);
+        QPlainTextEdit *tab = m_runTabs.value(id);
+        if (!tab) {
+            tab = new QPlainTextEdit(ui->twRuns);
+            tab->setReadOnly(true);
+            tab->setMaximumBlockCount(RUN_TAB_MAX_LINES);
+            tab->setFont(ui->txtOutput->font());
+            tab->setProperty("run", id);
+            m_runTabs.insert(id, tab);
+            ui->twRuns->addTab(tab, QString());
+        }
+        QString status;
+        switch (state) {
+        case RUN_QUEUED:
+            status = tr("queued");
+            break;
+        case RUN_RUNNING:
+            status = tr("running");
+            break;
+        case RUN_DONE:
+            status = tr("done");
+            break;
+        case RUN_FAILED:
+            status = tr("failed");
+            break;
+        default:
+            status = tr("cancelled");
+            break;
+        }
+        int index = ui->twRuns->indexOf(tab);
+        ui->twRuns->setTabText(index, tr("%1 #%2 (%3)").arg(job.name).arg(id)
+                               .arg(status));
+        QString details = job.target == TARGET_PROCESS ?
+                          tr("Background process") : tr("Embedded interpreter");
+        if (state > RUN_RUNNING) {
+            details += tr(", %1 ms").arg(job.elapsedMs);
+        }
+        if (job.peakKb >= 0) {
+            details += tr(", peak memory %1 KB").arg(job.peakKb);
+        }
+        ui->twRuns->setTabToolTip(index, details);
+    }
+    ui->lblRuns->setText(tr("%1 running, %2 queued")
+                         .arg(m_runQueue->Count(RUN_RUNNING))
+                         .arg(m_runQueue->Count(RUN_QUEUED)));
+}
+
+void MainView::RunForgotten(int id) {
+    delete m_runTabs.take(id); // removes the tab too
+}
+
+int MainView::CurrentRun() {
+    QWidget *tab = ui->twRuns->currentWidget();
+    return tab ? tab->property("run").toInt() : -1;
+}
+
+void MainView::on_btnRunCancel_clicked() {
+    m_runQueue->Cancel(CurrentRun());
+}
+
+void MainView::on_btnRunsClear_clicked() {
+    foreach (int id, m_runTabs.keys()) {
+        m_runQueue->Forget(id);
+    }
+}
+
+// Closing a waiting or running run cancels it, a finished one is removed
+void MainView::on_twRuns_tabCloseRequested(int index) {
+    QWidget *tab = ui->twRuns->widget(index);
+    if (!tab) {
+        return;
+    }
+    int id = tab->property("run").toInt();
+    if (m_runQueue->Job(id).state <= RUN_RUNNING) {
+        m_runQueue->Cancel(id);
+    } else {
+        m_runQueue->Forget(id);
+    }
+}
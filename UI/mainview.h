@@ -10,6 +10,8 @@
 #include <QInputDialog>
 #include <QThread>
 #include <QApplication>
+#include <QMutex>
+#include <QTreeWidget>
 #ifndef Q_OS_WIN
 #include <qtermwidget5/qtermwidget.h>
 #endif
@@ -17,8 +19,19 @@
 // internal
 #include "CodeEditor/pythonsyntaxhighlighter.h"
 #include "CodeEditor/codeeditor.h"
+#include "CodeEditor/largefileview.h"
+#include "CodeEditor/searchoverlay.h"
+#include "CodeEditor/diagnostics.h"
+#include "CodeEditor/calltips.h"
+#include "CodeEditor/symbolindex.h"
+#include "CodeEditor/completionindex.h"
 #include "Features/snippets.h"
 #include "Features/xtute.h"
+#include "Features/testcases.h"
+#include "Features/testrunner.h"
+#include "Features/tableoutput.h"
+#include "Features/runqueue.h"
+#include "PythonAccess/kernel.h"
 
 #define SAVE_STATE_VERSION 2
 #define KEY_DOCK_LOCATIONS "DOCK_LOCATIONS"
@@ -34,9 +47,32 @@
 #define KEY_SHOW_TUTE "SHOW_TUTE"
 #define KEY_SHOW_NOTE "KEY_SHOW_NOTE"
 
+// Lines kept in the output tab of each run
+#define RUN_TAB_MAX_LINES 10000
+
 #define STARTUP_SCRIPT_FILE                                                    \
   QApplication::applicationDirPath() + "/_express_startup_.py"
 
+// Python used for child processes started from the UI
+#ifdef Q_OS_WIN
+#define CHILD_PYTHON "python"
+#else
+#define CHILD_PYTHON "python3.8"
+#endif
+
+// Output pane channels, used as bit flags for filtering
+enum OutputChannel {
+    CHANNEL_STDOUT = 1,
+    CHANNEL_STDERR = 2,
+    CHANNEL_ALL = CHANNEL_STDOUT | CHANNEL_STDERR
+};
+
+// Output received during a run, in arrival order
+struct OutputChunk {
+    int channel;
+    QString text;
+};
+
 namespace Ui {
 class MainView;
 }
@@ -51,6 +87,7 @@ class MainView : public QMainWindow {
     explicit MainView(QWidget *parent = 0);
     ~MainView();
     QString GetInput();
+    QString GetInputFile();
     QString GetOutput();
     QString GetCode();
     void SetSnippets(Snippets *snip);
@@ -64,6 +101,7 @@ class MainView : public QMainWindow {
     void on_btnOutputClear_clicked();
     void on_btnOutputOpen_clicked();
     void on_btnInputOpen_clicked();
+    void on_btnInputAttach_clicked();
     void on_btnCodeOpen_clicked();
     void on_btnOutputSave_clicked();
     void on_btnInputSave_clicked();
@@ -84,6 +122,8 @@ class MainView : public QMainWindow {
     void SetCode(QString txt);
     void SetSearchRegex(QString txt);
     void WriteOutput(QString output);
+    void WriteError(QString output);
+    void on_cmbOutputChannel_currentIndexChanged(int index);
     void StartPythonRun();
     void EndPythonRun();
     void on_btnNotesOpen_clicked();
@@ -94,6 +134,47 @@ class MainView : public QMainWindow {
     void on_btnTuteMark_clicked();
     void on_btnTerminal_clicked();
     void on_btnStopPython_clicked();
+    void on_btnCaseAdd_clicked();
+    void on_btnCaseRemove_clicked();
+    void on_btnCaseLoad_clicked();
+    void on_btnCaseRun_clicked();
+    void on_btnCaseStop_clicked();
+    void CaseStarted(int index);
+    void CaseFinished(int index, int state, qint64 elapsedMs, qint64 peakKb,
+                      QString output);
+    void CasesFinished(int passed, int total);
+    void on_btnTableClear_clicked();
+    void TableRowsChanged();
+    void ShowTable();
+    void on_btnLargeFileSave_clicked();
+    void on_btnLargeFileClose_clicked();
+    void on_btnLargeFileFindNext_clicked();
+    void on_btnLargeFileFindPrev_clicked();
+    void on_txtLargeFileFind_returnPressed();
+    void on_txtLargeFileLine_returnPressed();
+    void LargeFileIndexed();
+    void LargeFileFound(qint64 line);
+    void on_btnSearchNext_clicked();
+    void on_btnSearchPrev_clicked();
+    void SearchMatchesChanged(int current, int count);
+    void RefreshOutline();
+    void MoveOutline();
+    void on_twOutline_itemActivated(QTreeWidgetItem *item, int column);
+    void on_txtSnippetSearch_textChanged(const QString &text);
+    void on_btnRunCell_clicked();
+    void on_btnKernelRestart_clicked();
+    void RunCell(const QString &code, int first, int last);
+    void KernelOutput(int id, const QString &text, bool error);
+    void KernelFinished(int id, bool ok);
+    void StartEmbeddedRun(int id);
+    void StopEmbeddedRun(int id);
+    void RunOutput(int id, const QString &text, bool error);
+    void RunStateChanged(int id, int state);
+    void RunForgotten(int id);
+    void on_btnRunBackground_clicked();
+    void on_btnRunCancel_clicked();
+    void on_btnRunsClear_clicked();
+    void on_twRuns_tabCloseRequested(int index);
 
   private:
     const QString FILETYPES_PYTHON = tr("Python Code (*.py);;All files (*.*)");
@@ -105,17 +186,39 @@ class MainView : public QMainWindow {
     Ui::MainView *ui;
     PythonSyntaxHighlighter *m_highlighterCodeArea;
     PythonSyntaxHighlighter *m_highlighterSnippetArea;
+    SearchOverlay *m_searchCodeArea;
+    Diagnostics *m_diagnosticsCodeArea;
+    CallTips *m_callTipsCodeArea;
+    SymbolIndex *m_symbolsCodeArea;
+    SymbolIndex *m_symbolsSnippetArea;
+    CompletionIndex *m_completionIndex;
     QString m_startMe;
-    QString m_getJedi;
+    QString m_jediServer;
+    Jedi *m_jedi;
+    QString m_kernelServer;
+    Kernel *m_kernel;
+    QHash<int, QString> m_cellHeaders; // shown when the cell starts writing
     QString m_about;
+    QString m_caseBootstrap;
     Snippets *m_snippets;
     XTute *m_tute;
+    TestCases *m_testCases;
+    TestRunner *m_caseRunner;
+    QStringList m_caseOutputs;
+    int m_casesDone = 0; // finished in the current run, for the progress bar
+    TableOutputModel *m_tableModel;
     QCompleter *completer;
 #ifndef Q_OS_WIN
     QTermWidget* terminal;
 #endif
-    bool m_markTute = false;
-    int m_markIndex = -1;
+    QString m_inputFile; // attached input, read by the child directly
+    QMutex m_inputFileLock;
+    QList<OutputChunk> m_outputLog;
+    int m_outputFilter = CHANNEL_ALL;
+    RunQueue *m_runQueue;
+    QHash<int, QPlainTextEdit *> m_runTabs; // run id -> its output
+    int m_embeddedRun = -1; // run the worker is busy with
+    bool m_embeddedFailed = false;
     void ChangeFontSize(QFont font, int size);
     void SetupHighlighter();
     void SetupTerminal();
@@ -126,11 +229,26 @@ class MainView : public QMainWindow {
                      const bool showMessage = true);
     void LoadResources();
     void LoadSnippetsToCombo();
-    void RunPythonCode(const QString &code);
+    void SetupRunQueue();
+    int QueueRun(int kind, const QString &name, const QString &code,
+                 int priority, int tag = -1);
+    int CurrentRun();
     void LoadSettings();
     void SetupPython();
+    void SetupJedi();
+    void SetupKernel();
     bool Confirm(const QString &what);
     void SetCompleter(CodeEditor *editor);
+    void AppendOutput(int channel, const QString &output);
+    void InsertOutput(int channel, const QString &output);
+    void RenderOutput();
+    QString ChannelText(int channel);
+    void SetupTestCases();
+    void LoadCasesToTable();
+    void SetupTableOutput();
+    void AttachInputFile(const QString &fileName);
+    void SetupLargeFile();
+    void OpenLargeFile(const QString &fileName);
 
   signals:
     void operate(const QString &, const QString &);
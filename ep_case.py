@@ -0,0 +1,33 @@
+"""
+expressPython Test Case Bootstrap
+- Runs a code file as __main__ and reports peak memory on exit
+"""
+
+import atexit
+import runpy
+import sys
+
+PEAK_MEMORY_MARKER = "\x1eEP_PEAK_KB="
+
+
+def report_peak_memory():
+    """
+    Write peak resident memory (KB) to stderr, test runner strips it
+    """
+    try:
+        import resource
+    except ImportError:
+        # WHY: Not available on windows, runner shows '-' instead
+        return
+    peak = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+    if sys.platform == "darwin":
+        # WHY: macOS reports bytes instead of kilobytes
+        peak //= 1024
+    sys.stderr.write("\n" + PEAK_MEMORY_MARKER + str(peak) + "\n")
+    sys.stderr.flush()
+
+
+atexit.register(report_peak_memory)
+CODE_PATH = sys.argv[1]
+sys.argv = ["expressPython"]
+runpy.run_path(CODE_PATH, run_name="__main__")
@@ -1,54 +1,342 @@
 """
-Experimental Jedi Completions fetcher
+expressPython Jedi Server
+- Runs in its own process, answers one JSON request per line on stdin
+- Request: {"id": 1, "method": "complete", "params": {...}}
+- Reply:   {"id": 1, "result": ...} or {"id": 1, "error": "..."}
+- {"method": "cancel", "params": {"id": 1}} drops a request not yet answered
+- Besides jedi's methods, "check" reports syntax errors and pyflakes warnings
 """
-import os
-import shlex
-import sys
-import io
+import ast
+import json
 import re
-import site
-import time
-import subprocess
+import sys
+import threading
+import warnings
+from collections import OrderedDict
+from queue import Queue
 
+try:
+    import jedi
+except ImportError:
+    jedi = None
 
-def get_completions(source, row, col, script_path=""):
-    return []
+try:
+    from pyflakes import checker as pyflakes_checker
+except ImportError:
+    pyflakes_checker = None
 
-def real(source, row, col, script_path=""):
-    completions = []
-    try:
-        script = jedi.Script(source, row, col+1, script_path)
-        completion_objects = script.complete()
-        completions = [x.name for x in completion_objects]
-    except Exception as err:
-        pass
-    finally:
-        return completions
 # WHY:
-# Only supports windows for now, we have full control cause we bundle everything!
-if os.name == "nt":
+# Replies go to the real stdout only, anything jedi or a plugin prints
+# goes to stderr so it can not break a reply line
+PROTOCOL_OUT = sys.stdout
+sys.stdout = sys.stderr
 
-    # WHY:
-    # This is because we are embedding python and jedi tries to open expressPython.exe
-    # Thinking it is python.exe
-    try:
-        import jedi
-    except ImportError:
-        pass
-    else:
-        d = os.path.dirname
-        python_location = os.path.join(d(d(d(d(jedi.__file__)))), "python.exe")
-        if os.path.exists(python_location):
-            sys.executable = python_location
-            get_completions = real
-
-if os.name == "posix":
+MAX_DOC_LENGTH = 4000
+# Checked top level blocks kept, by their source
+CHECK_CACHE_SIZE = 4000
+CONTINUES_BLOCK = re.compile(r"(else|elif|except|finally)\b")
+
+requests = Queue()
+cancelled = set()
+cancelled_lock = threading.Lock()
+
+
+def reply(message):
+    PROTOCOL_OUT.write(json.dumps(message, separators=(",", ":")) + "\n")
+    PROTOCOL_OUT.flush()
+
+
+def read_requests():
+    """
+    Reads stdin on its own thread, so cancels arrive while jedi works
+    """
+    for line in sys.stdin:
+        try:
+            message = json.loads(line)
+        except ValueError:
+            continue
+        if message.get("method") == "cancel":
+            with cancelled_lock:
+                cancelled.add(message.get("params", {}).get("id"))
+        else:
+            requests.put(message)
+    requests.put(None)
+
+
+def make_script(params):
+    return jedi.Script(params.get("source", ""), path=params.get("path") or None)
+
+
+def position(params):
+    # WHY: Editor lines are 0 based, jedi lines are 1 based
+    return params.get("line", 0) + 1, params.get("column", 0)
+
+
+def is_global(name):
+    """
+    Defined at the top of a module other than the edited one, the same
+    name then means the same thing everywhere
+    """
     try:
-        import jedi
-    except ImportError:
-        pass
-    else:
-        d = os.path.dirname
-        python_location = os.path.join(d(d(d(d(jedi.__file__)))), "python3.8")
-        if os.path.exists(python_location):
-            get_completions = real
+        parent = name.parent()
+        return name.module_name != "__main__" and parent is not None \
+            and parent.type == "module"
+    except Exception:
+        return False
+
+
+def complete(params):
+    line, column = position(params)
+    return [x.name for x in make_script(params).complete(line, column, fuzzy=True)]
+
+
+def signatures(params):
+    line, column = position(params)
+    result = []
+    for signature in make_script(params).get_signatures(line, column):
+        result.append({
+            "name": signature.name,
+            "full_name": signature.full_name or "",
+            "global": is_global(signature),
+            "text": signature.to_string(),
+            "params": [p.to_string() for p in signature.params],
+            "index": signature.index if signature.index is not None else -1,
+            "doc": signature.docstring(raw=True)[:MAX_DOC_LENGTH],
+        })
+    return result
+
+
+def goto(params):
+    line, column = position(params)
+    result = []
+    for name in make_script(params).goto(line, column, follow_imports=True):
+        result.append({
+            "name": name.name,
+            "path": str(name.module_path) if name.module_path else "",
+            "line": name.line - 1 if name.line else -1,
+            "column": name.column if name.column is not None else -1,
+        })
+    return result
+
+
+def hover(params):
+    line, column = position(params)
+    for name in make_script(params).help(line, column):
+        doc = name.docstring()
+        if doc:
+            return {"name": name.name, "type": name.type,
+                    "full_name": name.full_name or "",
+                    "global": is_global(name),
+                    "doc": doc[:MAX_DOC_LENGTH]}
+    return None
+
+
+def scan_line(line, depth, quote):
+    """
+    Bracket depth and open triple quote after line, comments are skipped
+    """
+    i = 0
+    while i < len(line):
+        c = line[i]
+        if quote:
+            if c == "\\":
+                i += 2
+            elif line.startswith(quote, i):
+                i += len(quote)
+                quote = None
+            else:
+                i += 1
+            continue
+        if c == "#":
+            break
+        if c in "\"'":
+            quote = c * 3 if line.startswith(c * 3, i) else c
+            i += len(quote)
+            continue
+        if c in "([{":
+            depth += 1
+        elif c in ")]}":
+            depth = max(0, depth - 1)
+        i += 1
+    if quote and len(quote) == 1:
+        # Unterminated, the line is a syntax error anyway
+        quote = None
+    return depth, quote
+
+
+def split_blocks(source):
+    """
+    Top level statements as (first line, source), a new one starts at
+    column 0 outside brackets and strings, decorators stay with what
+    they decorate and else / except stay with their statement
+    """
+    blocks = []
+    lines = [line + "\n" for line in source.split("\n")]
+    start = 0
+    depth, quote, continued, decorated = 0, None, False, False
+    for number, line in enumerate(lines):
+        top_level = (depth == 0 and quote is None and not continued
+                     and line[:1] not in ("", " ", "\t", "\n", "#"))
+        if top_level:
+            if number > start and not decorated and not CONTINUES_BLOCK.match(line):
+                blocks.append((start, "".join(lines[start:number])))
+                start = number
+            decorated = line.startswith("@")
+        depth, quote = scan_line(line, depth, quote)
+        continued = quote is None and line.rstrip().endswith("\\")
+    blocks.append((start, "".join(lines[start:])))
+    return blocks
+
+
+def names_of(tree):
+    """
+    Names a block binds and uses, bound is generous (locals too) so other
+    blocks are never told a name is undefined when it is not
+    """
+    bound, used = set(), set()
+    for node in ast.walk(tree):
+        if isinstance(node, ast.Name):
+            (bound if isinstance(node.ctx, ast.Store) else used).add(node.id)
+        elif isinstance(node, (ast.FunctionDef, ast.AsyncFunctionDef, ast.ClassDef)):
+            bound.add(node.name)
+        elif isinstance(node, ast.alias):
+            bound.add((node.asname or node.name).split(".")[0])
+    return bound, used
+
+
+def char_column(line, column):
+    """
+    ast columns count UTF-8 bytes, the editor counts characters
+    """
+    return len(line.encode("utf-8")[:column].decode("utf-8", errors="ignore"))
+
+
+def check_block(source):
+    """
+    Messages of one top level block, lines relative to the block
+    Each message is (severity, line, column, end, text, kind, name).
+    """
+    cached = check_cache.get(source)
+    if cached is not None:
+        check_cache.move_to_end(source)
+        return cached
+    messages = []
+    tree = None
+    compiled = False
+    with warnings.catch_warnings(record=True) as caught:
+        warnings.simplefilter("always")
+        try:
+            tree = compile(source, "<code>", "exec", ast.PyCF_ONLY_AST)
+            compile(tree, "<code>", "exec")
+            compiled = True
+        except SyntaxError as err:
+            # WHY: __future__ imports are only wrong in the whole file
+            if "__future__" not in str(err.msg):
+                column = (err.offset or 1) - 1
+                end = (getattr(err, "end_offset", None) or 0) - 1
+                if getattr(err, "end_lineno", err.lineno) != err.lineno:
+                    end = -1
+                messages.append(("error", (err.lineno or 1) - 1, column,
+                                 end if end > column else -1, err.msg, "", ""))
+        except ValueError as err:
+            messages.append(("error", 0, 0, -1, str(err), "", ""))
+    for warning in caught:
+        messages.append(("warning", max(warning.lineno - 1, 0), 0, -1,
+                         str(warning.message), "", ""))
+    bound, used = set(), set()
+    if tree is not None:
+        bound, used = names_of(tree)
+    if compiled and pyflakes_checker is not None:
+        # WHY: pyflakes repeats what the compiler said, in other words
+        flagged = set(message[1] for message in messages)
+        lines = source.split("\n")
+        for message in pyflakes_checker.Checker(tree, "<code>").messages:
+            line = message.lineno - 1
+            if line not in flagged:
+                name = str(message.message_args[0]) if message.message_args else ""
+                column = char_column(lines[line], message.col) \
+                    if line < len(lines) else message.col
+                messages.append(("warning", line, column, -1,
+                                 message.message % message.message_args,
+                                 type(message).__name__, name))
+    result = (messages, bound, used)
+    check_cache[source] = result
+    while len(check_cache) > CHECK_CACHE_SIZE:
+        check_cache.popitem(last=False)
+    return result
+
+
+def import_names(text):
+    # "x.y as z" binds z, "os.path" binds os, "x.y" from a from-import binds y
+    if " as " in text:
+        return {text.rsplit(" as ", 1)[1]}
+    return {text.split(".")[0], text.split(".")[-1]}
+
+
+def check(params):
+    """
+    Only blocks changed since the last check are compiled again, names
+    defined or used in other blocks are settled here
+    """
+    blocks = [(first, check_block(source))
+              for first, source in split_blocks(params.get("source", ""))]
+    bound, used = set(), set()
+    for _, (_, block_bound, block_used) in blocks:
+        bound |= block_bound
+        used |= block_used
+    result = []
+    for first, (messages, _, _) in blocks:
+        for severity, line, column, end, text, kind, name in messages:
+            if kind == "UndefinedName" and name in bound:
+                continue
+            if kind == "UnusedImport" and import_names(name) & used:
+                continue
+            result.append({"line": first + line, "column": column, "end": end,
+                           "severity": severity, "message": text})
+    return result
+
+
+check_cache = OrderedDict()
+
+METHODS = {
+    "complete": complete,
+    "signatures": signatures,
+    "goto": goto,
+    "hover": hover,
+    "check": check,
+}
+
+
+def serve():
+    reader = threading.Thread(target=read_requests, daemon=True)
+    reader.start()
+    reply({"id": 0, "result": {"jedi": jedi is not None}})
+    while True:
+        message = requests.get()
+        if message is None:
+            break
+        request_id = message.get("id")
+        with cancelled_lock:
+            if request_id in cancelled:
+                cancelled.discard(request_id)
+                continue
+        handler = METHODS.get(message.get("method"))
+        if handler is None:
+            reply({"id": request_id, "error": "unknown method"})
+            continue
+        if jedi is None and message.get("method") != "check":
+            reply({"id": request_id, "error": "jedi is not installed"})
+            continue
+        try:
+            result = handler(message.get("params", {}))
+        except Exception as err:
+            reply({"id": request_id, "error": str(err)})
+            continue
+        with cancelled_lock:
+            if request_id in cancelled:
+                cancelled.discard(request_id)
+                continue
+        reply({"id": request_id, "result": result})
+
+
+serve()
@@ -0,0 +1,165 @@
+"""
+expressPython Kernel
+- Runs in its own process and keeps one namespace for every cell it runs
+- Request: {"id": 1, "method": "run", "params": {"code": "...", "line": 0,
+                                                  "input": "...", "input_file": ""}}
+- Output:  {"id": 1, "stream": "stdout", "text": "..."} while the cell runs
+- Reply:   {"id": 1, "result": {"ok": true}} once the cell is done
+- {"method": "reset"} forgets every variable
+"""
+import ast
+import json
+import sys
+import textwrap
+import threading
+import time
+import traceback
+from io import StringIO
+
+# WHY:
+# Messages go to the real stdout only, what a cell prints is wrapped in a
+# message so it can not break one
+PROTOCOL_OUT = sys.stdout
+write_lock = threading.Lock()
+# Output is collected for this long before it is sent
+FLUSH_INTERVAL = 0.05
+# and sent at once when this much is waiting
+FLUSH_SIZE = 1 << 16
+
+
+def send(message):
+    line = json.dumps(message, separators=(",", ":")) + "\n"
+    with write_lock:
+        PROTOCOL_OUT.write(line)
+        PROTOCOL_OUT.flush()
+
+
+class Stream:
+    """
+    File like object sending what is written as output of the current cell
+    Writes are batched, a loop printing lines sends a few large messages
+    instead of one per print. What the other stream holds is sent first,
+    so errors stay in place between prints.
+    """
+
+    def __init__(self, name):
+        self.name = name
+        self.request_id = None
+        self.parts = []
+        self.size = 0
+        self.lock = threading.Lock()
+        self.other = None
+
+    def write(self, text):
+        text = str(text)
+        if self.other.size:
+            self.other.flush()
+        with self.lock:
+            self.parts.append(text)
+            self.size += len(text)
+            full = self.size >= FLUSH_SIZE
+        if full:
+            self.flush()
+        return len(text)
+
+    def writelines(self, lines):
+        for line in lines:
+            self.write(line)
+
+    def flush(self):
+        with self.lock:
+            text = "".join(self.parts)
+            self.parts, self.size = [], 0
+            if text:
+                send({"id": self.request_id, "stream": self.name, "text": text})
+
+    def isatty(self):
+        return False
+
+
+def new_namespace():
+    return {"__name__": "__main__", "__builtins__": __builtins__}
+
+
+namespace = new_namespace()
+stdout = Stream("stdout")
+stderr = Stream("stderr")
+stdout.other, stderr.other = stderr, stdout
+
+
+def flush_often():
+    while True:
+        time.sleep(FLUSH_INTERVAL)
+        stdout.flush()
+        stderr.flush()
+
+
+def run(params):
+    """
+    Runs a cell, an expression on its last line is shown like the REPL does
+    """
+    # WHY: Editor lines are 0 based, tracebacks should name the editor's line
+    first = params.get("line", 0)
+    try:
+        # Selected lines can come from inside a block
+        tree = ast.parse(textwrap.dedent(params.get("code", "")), "<cell>", "exec")
+    except SyntaxError as err:
+        err.lineno = (err.lineno or 1) + first
+        raise
+    ast.increment_lineno(tree, first)
+    last = None
+    if tree.body and isinstance(tree.body[-1], ast.Expr):
+        last = ast.Interactive([tree.body.pop()])
+    exec(compile(tree, "<cell>", "exec"), namespace)
+    if last is not None:
+        exec(compile(last, "<cell>", "single"), namespace)
+
+
+def serve():
+    global namespace
+    sys.stdout, sys.stderr = stdout, stderr
+    threading.Thread(target=flush_often, daemon=True).start()
+    send({"id": 0, "result": {"python": sys.version.split()[0]}})
+    for line in sys.__stdin__:
+        try:
+            message = json.loads(line)
+        except ValueError:
+            continue
+        request_id = message.get("id")
+        method = message.get("method")
+        if method == "reset":
+            namespace = new_namespace()
+            send({"id": request_id, "result": {"ok": True}})
+            continue
+        if method != "run":
+            send({"id": request_id, "error": "unknown method"})
+            continue
+        params = message.get("params", {})
+        stdout.request_id = stderr.request_id = request_id
+        ok = True
+        try:
+            if params.get("input_file"):
+                sys.stdin = open(params["input_file"], encoding="utf-8")
+            else:
+                sys.stdin = StringIO(params.get("input", ""))
+            run(params)
+        except SystemExit:
+            pass
+        except BaseException:
+            ok = False
+            kind, value, trace = sys.exc_info()
+            # Frames of the kernel itself are not shown
+            if isinstance(value, SyntaxError):
+                trace = None
+            while trace is not None and trace.tb_frame.f_globals is globals():
+                trace = trace.tb_next
+            traceback.print_exception(kind, value, trace, file=stderr)
+        if sys.stdin is not sys.__stdin__:
+            sys.stdin.close()
+            sys.stdin = sys.__stdin__
+        stdout.flush()
+        stderr.flush()
+        send({"id": request_id, "result": {"ok": ok}})
+
+
+serve()
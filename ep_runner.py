@@ -14,16 +14,20 @@ import io
 import re
 import site
 import time
+import mmap
+import codecs
+import atexit
 import subprocess
-from threading import Thread
+from threading import Thread, Lock
 from queue import Queue
 import queue
 from datetime import datetime
 
 from express_api import get_input, set_input
+from express_api import get_input_bytes, get_input_file
 from express_api import get_output, set_output
 from express_api import get_code, set_code
-from express_api import write_output, get_apppath
+from express_api import write_output, write_error, get_apppath
 from express_api import set_search_regex, interrupt_requested
 
 KILL_INTERRUPT = 1
@@ -32,15 +36,123 @@ DEFAULT_TIMEOUT = 1000
 DEFAULT_ENCODING = "utf-8"
 NASTY_CHARS = '()%!^"<>&|'
 DEBUG_PRINT = False
+POLL_INTERVAL = 0.05
+READ_CHUNK_SIZE = 64 * 1024
+
+# Warm pool: interpreters started ahead of time with these modules imported
+# EP_WARM_IMPORTS environment variable (comma separated) overrides the list
+USE_WARM_POOL = True
+WARM_POOL_SIZE = 2
+WARM_IMPORTS = os.environ.get(
+    "EP_WARM_IMPORTS",
+    "os,sys,io,re,math,string,collections,itertools,functools,heapq,bisect",
+).split(",")
+
+# Inputs bigger than this are shared with the child through memory, not the pipe
+SHARED_INPUT_SIZE = 1024 * 1024
+# Input sent through the pipe is written in blocks of this size
+WRITE_BLOCK_SIZE = 1024 * 1024
+
+# WHY:
+# Runs inside every child, code and input never touch the disk.
+# Header line is "<code bytes> <input kind> <input bytes> <input location>",
+# followed by the code (and the input itself when kind is "pipe").
+# Location is last, so an attached file's path may contain spaces.
+#   pipe - input follows the code on stdin, read as the code asks for it
+#   path - input is read from a path (attached file, or memfd of the runner via /proc)
+#   shm  - input is in a named shared memory region (windows)
+# EOF before a header means the warm pool is gone.
+CHILD_BOOTSTRAP = r"""
+import io, sys
+for _name in sys.argv[1].split(","):
+    if _name:
+        try:
+            __import__(_name.strip())
+        except ImportError:
+            pass
+_pipe = sys.stdin.buffer
+_header = _pipe.readline()
+if not _header:
+    sys.exit(0)
+_code_len, _kind, _input_len, _where = _header.decode("utf-8").rstrip("\n").split(" ", 3)
+_code = _pipe.read(int(_code_len)).decode("utf-8")
+if _kind == "pipe":
+    _data = _pipe
+elif _kind == "path":
+    _data = open(_where, "rb")
+else:
+    import mmap
+
+    class _Region(io.RawIOBase):
+        def __init__(self, region):
+            self.region = region
+            self.pos = 0
+
+        def readable(self):
+            return True
+
+        def readinto(self, buffer):
+            size = min(len(buffer), len(self.region) - self.pos)
+            buffer[:size] = self.region[self.pos:self.pos + size]
+            self.pos += size
+            return size
+
+    _data = io.BufferedReader(
+        _Region(mmap.mmap(-1, int(_input_len), tagname=_where)), 1 << 16)
+sys.stdin = io.TextIOWrapper(_data, encoding="utf-8")
+sys.argv = ["expressPython"]
+del _name, _pipe, _header, _code_len, _kind, _where, _input_len, _data
+try:
+    exec(compile(_code, "<expressPython>", "exec"), {"__name__": "__main__"})
+except SystemExit:
+    raise
+except BaseException:
+    import traceback
+    # WHY: hide the bootstrap frame, only user code is interesting
+    _type, _value, _trace = sys.exc_info()
+    traceback.print_exception(_type, _value, _trace.tb_next)
+    sys.exit(1)
+"""
 
 CODE = get_code()
 CODE_LINES = CODE.splitlines()
-TXT = get_input()
+# WHY:
+# Input is never turned into a str here. It is a UTF-8 snapshot of the
+# input box, or an attached file that is not loaded at all
+INPUT_FILE = get_input_file()
+if INPUT_FILE and not os.path.isfile(INPUT_FILE):
+    write_error("Attached input file not found: %s\n" % INPUT_FILE)
+    INPUT_FILE = ""
+INPUT = memoryview(b"") if INPUT_FILE else get_input_bytes()
+
+
+class BufferReader(io.RawIOBase):
+    """
+    Read-only stream over a memoryview, reads copy only what is asked for
+    """
+
+    def __init__(self, view):
+        self.view = view
+        self.pos = 0
+
+    def readable(self):
+        return True
 
-___FAKE_STDIN = io.StringIO(TXT)
+    def readinto(self, buffer):
+        size = min(len(buffer), len(self.view) - self.pos)
+        buffer[:size] = self.view[self.pos:self.pos + size]
+        self.pos += size
+        return size
+
+    def fileno(self):
+        return 1222
+
+
+___FAKE_STDIN = io.TextIOWrapper(
+    io.BufferedReader(BufferReader(INPUT)), encoding=DEFAULT_ENCODING
+)
 ___REAL_STDIN = sys.stdin
 sys.stdin = ___FAKE_STDIN
-sys.stdin.fileno = lambda: 1222
 sys.argv = ["expressPython"]
 
 
@@ -112,17 +224,20 @@ def shell_execute(shell_cmd):
     subprocess.run(shell_cmd, shell=True)
 
 # WHY: "-u" ensure that python's output is unbuffered so we can get it as soon as it appears in our editor
-def python_cmd(filename):
+# Code is passed through CHILD_BOOTSTRAP on stdin, so `#!` interpreters must be python 3
+def python_cmd(imports=()):
     if CODE.startswith("#!"):
         first_line = CODE_LINES[0]
-        python = first_line[2:].strip()
-        return list(shlex.split(python)) + [escape_shell(filename)]
-    elif os.name == "nt":
-        return ["python", "-u", escape_win(filename)]
-    elif os.name == "posix":
-        return ["python3.8", "-u", filename]
+        python = list(shlex.split(first_line[2:].strip()))
     else:
-        return ["python3.8", "-u", escape_nix(filename)]
+        python = [default_python()]
+    return python + ["-u", "-c", CHILD_BOOTSTRAP, ",".join(imports)]
+
+
+def default_python():
+    if os.name == "nt":
+        return "python"
+    return "python3.8"
 
 
 def escape_nix(s):
@@ -180,33 +295,18 @@ class CodeExecutor:
     """
 
     def __init__(self):
-        self.cur_date = f"{datetime.now():%Y%m%d%H%M%S%z}"
-        self.code_path = os.path.abspath(
-            os.path.join(
-                os.path.dirname(get_apppath()), "code.ep." + self.cur_date + ".py"
-            )
-        )
-        self.data_path = os.path.abspath(
-            os.path.join(
-                os.path.dirname(get_apppath()), "data.ep." + self.cur_date + ".dt"
-            )
-        )
         self.python = None
         self.interrupt = False
         self.done = False
+        self.shared_input = None
 
-    @staticmethod
-    @property
-    def name():
-        return "normal"
+    name = "normal"
 
     def run(self, *args):
         """
         Run code executor
         """
-        self.write_files()
-
-        command = python_cmd(self.code_path)
+        command = python_cmd()
         debug_print(command)
 
         self.python = subprocess.Popen(
@@ -214,79 +314,107 @@ class CodeExecutor:
             shell=False,
             stdin=subprocess.PIPE,
             stdout=subprocess.PIPE,
-            stderr=subprocess.STDOUT,
+            stderr=subprocess.PIPE,
             startupinfo=HIDDEN_PROCESS_START,
         )
 
         self.start_workers()
 
-    def write_files(self):
-        with open(self.data_path, "w+") as data:
-            data.write(TXT)
-            data.flush()
-        with open(self.code_path, "w+") as code:
-            code.write(get_code())
-            code.flush()
-
     def start_workers(self):
         store = Queue()
         writer_thread = Thread(
             target=self.writer, args=[self.python.stdin], daemon=True
         )
         writer_thread.start()
-        time.sleep(0.01)
-        reader_thread = Thread(
-            target=self.reader, args=[self.python.stdout, store], daemon=True
-        )
-        reader_thread.start()
+        readers = [(self.python.stdout, write_output), (self.python.stderr, write_error)]
+        for pipe, channel in readers:
+            Thread(target=self.reader, args=[pipe, channel, store], daemon=True).start()
         # WHY:
-        # Make the read work faster in a different thread
-        while True:
-            if self.interrupt:
-                break
+        # Make the read work faster in a different thread,
+        # everything that piled up while we were busy is sent in as few calls as possible
+        # Chunks are ordered by read time so stdout/stderr keep their relative order
+        running = len(readers)
+        while running and not self.interrupt:
             try:
-                line = store.get(block=False, timeout=1)
-                if line is None:
-                    break
-                write_output(line.decode(DEFAULT_ENCODING))
+                chunks = [store.get(timeout=POLL_INTERVAL)]
             except queue.Empty:
-                pass
+                continue
+            while True:
+                try:
+                    chunks.append(store.get(block=False))
+                except queue.Empty:
+                    break
+            running -= chunks.count(None)
+            chunks = sorted((c for c in chunks if c is not None), key=lambda c: c[0])
+            for channel, text in merge_chunks(chunks):
+                channel(text)
         self.done = True
 
-    def reader(self, pipe, store):
+    def reader(self, pipe, channel, store):
         """
-        Thread method. reads stdin/stdout
+        Thread method. reads stdout or stderr in chunks
+        Multi-byte characters split between reads are carried to the next read
+        `\r\n` becomes `\n`, a lone `\r` is kept so output pane can overwrite the line
         :param pipe: PIPE
-        :param store: Queue
+        :param channel: write_output or write_error
+        :param store: Queue, gets (read time, channel, text) and None at the end
         """
         debug_print("READER...")
+        decoder = codecs.getincrementaldecoder(DEFAULT_ENCODING)(errors="replace")
+        pending_cr = ""
         try:
             with pipe:
-                for line in iter(pipe.readline, b""):
-                    if self.interrupt:
+                while not self.interrupt:
+                    data = pipe.read1(READ_CHUNK_SIZE)
+                    text = pending_cr + decoder.decode(data, final=not data)
+                    pending_cr = ""
+                    if data and text.endswith("\r"):
+                        # WHY: might be the first half of a \r\n
+                        pending_cr = "\r"
+                        text = text[:-1]
+                    text = text.replace("\r\n", "\n")
+                    if text:
+                        store.put((time.monotonic(), channel, text))
+                    if not data:
                         return
-                    store.put(line)
         finally:
             store.put(None)
 
     def writer(self, pipe):
         """
-        Thread method. writes to stdin
+        Thread method. sends code and input to CHILD_BOOTSTRAP
         :param pipe:
         :return:
         """
         debug_print("WRITER")
+        code = CODE.encode(DEFAULT_ENCODING)
         try:
             with pipe:
-                for line in TXT.splitlines():
+                kind, where, size = "pipe", "-", len(INPUT)
+                if INPUT_FILE:
+                    kind, where, size = "path", INPUT_FILE, os.path.getsize(INPUT_FILE)
+                elif size >= SHARED_INPUT_SIZE:
+                    self.shared_input = SharedInput(INPUT)
+                    kind, where = self.shared_input.kind, self.shared_input.where
+                header = "%d %s %d %s\n" % (len(code), kind, size, where)
+                pipe.write(header.encode(DEFAULT_ENCODING))
+                pipe.write(code)
+                # WHY:
+                # A full pipe blocks the write until the child reads (backpressure),
+                # writing in blocks lets a kill stop the feed early
+                for start in range(0, size if kind == "pipe" else 0, WRITE_BLOCK_SIZE):
                     if self.interrupt:
-                        return
-                    pipe.write(line.encode(DEFAULT_ENCODING))
-                    pipe.write(os.linesep.encode(DEFAULT_ENCODING))
-        finally:
-            pass
+                        break
+                    pipe.write(INPUT[start:start + WRITE_BLOCK_SIZE])
+        except OSError:
+            # WHY: Child died or was killed before reading everything
+            if DEBUG_PRINT:
+                raise
 
     def kill(self):
+        if self.python is None or self.python.poll() is not None:
+            self.interrupt = True
+            return
         pid = self.python.pid
         debug_print("Killing", pid, "...")
         self.python.terminate()
@@ -295,13 +423,162 @@ class CodeExecutor:
         self.interrupt = True
 
     def clean(self):
-        if os.path.exists(self.code_path):
-            os.remove(self.code_path)
-        if os.path.exists(self.data_path):
-            os.remove(self.data_path)
+        if self.shared_input is not None:
+            self.shared_input.close()
+            self.shared_input = None
+
 
+def merge_chunks(chunks):
+    """
+    Join neighbouring chunks of the same channel
+    :param chunks: list of (read time, channel, text)
+    :return: list of (channel, text)
+    """
+    merged = []
+    for _, channel, text in chunks:
+        if merged and merged[-1][0] is channel:
+            merged[-1][1].append(text)
+        else:
+            merged.append((channel, [text]))
+    return [(channel, "".join(parts)) for channel, parts in merged]
 
-EXECUTORS = {CodeExecutor.name: CodeExecutor}
+
+class SharedInput:
+    """
+    Input placed in memory that the child reads directly, no files on disk
+    Linux uses a memfd (child opens it through /proc), windows a named mapping
+    Other systems fall back to sending input through the pipe
+    """
+
+    def __init__(self, data):
+        self.kind, self.where = "pipe", "-"
+        self.fd = None
+        self.region = None
+        if os.name == "nt":
+            self.where = "ep_input_%d_%d" % (os.getpid(), id(self))
+            self.region = mmap.mmap(-1, len(data), tagname=self.where)
+            self.region.write(data)
+            self.kind = "shm"
+        elif hasattr(os, "memfd_create") and os.path.isdir("/proc/self/fd"):
+            self.fd = os.memfd_create("ep_input")
+            view = memoryview(data)
+            while view:
+                view = view[os.write(self.fd, view):]
+            self.where = "/proc/%d/fd/%d" % (os.getpid(), self.fd)
+            self.kind = "path"
+
+    def close(self):
+        if self.region is not None:
+            self.region.close()
+            self.region = None
+        if self.fd is not None:
+            os.close(self.fd)
+            self.fd = None
+
+
+class WarmPool:
+    """
+    Keeps a few idle python processes that already imported WARM_IMPORTS
+
+    A child is consumed by exactly one run and replaced in the background,
+    reusing it would leak module state of one run into the next one.
+    """
+
+    def __init__(self, size, imports):
+        self.size = size
+        self.imports = list(imports)
+        self.idle = Queue()
+        self.lock = Lock()
+        self.closed = False
+        for _ in range(size):
+            self.spawn_async()
+
+    def spawn(self):
+        try:
+            process = subprocess.Popen(
+                [default_python(), "-u", "-c", CHILD_BOOTSTRAP, ",".join(self.imports)],
+                shell=False,
+                stdin=subprocess.PIPE,
+                stdout=subprocess.PIPE,
+                stderr=subprocess.PIPE,
+                startupinfo=HIDDEN_PROCESS_START,
+            )
+        except OSError:
+            if DEBUG_PRINT:
+                raise
+            return
+        with self.lock:
+            if self.closed:
+                process.kill()
+                return
+            self.idle.put(process)
+
+    def spawn_async(self):
+        Thread(target=self.spawn, daemon=True).start()
+
+    def take(self):
+        """
+        Get a ready process, or None if pool is empty (caller starts one)
+        """
+        while True:
+            try:
+                process = self.idle.get(block=False)
+            except queue.Empty:
+                return None
+            self.spawn_async()
+            if process.poll() is None:
+                return process
+
+    def close(self):
+        with self.lock:
+            self.closed = True
+        while True:
+            try:
+                process = self.idle.get(block=False)
+            except queue.Empty:
+                break
+            try:
+                process.kill()
+            except OSError:
+                pass
+
+
+class WarmExecutor(CodeExecutor):
+    """
+    Runs code in a pre-started interpreter from the warm pool,
+    falls back to normal executor on `#!` code or an empty pool
+    """
+
+    name = "warm"
+
+    def run(self, *args):
+        process = None
+        if not CODE.startswith("#!"):
+            process = get_warm_pool().take()
+        if process is None:
+            debug_print("Warm pool empty, starting cold")
+            return super().run(*args)
+
+        self.python = process
+        self.start_workers()
+
+
+def get_warm_pool():
+    """
+    Pool is kept in __main__, interpreter survives between runs
+    """
+    global WARM_POOL
+    pool = globals().get("WARM_POOL")
+    if pool is not None and pool.imports != WARM_IMPORTS:
+        pool.close()
+        pool = None
+    if pool is None:
+        pool = WARM_POOL = WarmPool(WARM_POOL_SIZE, WARM_IMPORTS)
+        atexit.register(pool.close)
+    return pool
+
+
+EXECUTORS = {CodeExecutor.name: CodeExecutor, WarmExecutor.name: WarmExecutor}
 
 # ==========================================================================================
 #                                       RUN
@@ -309,7 +586,7 @@ EXECUTORS = {CodeExecutor.name: CodeExecutor}
 
 
 debug_print("Starting ...")
-executor = CodeExecutor()
+executor = EXECUTORS["warm" if USE_WARM_POOL else "normal"]()
 interrupted = UNKNOWN_INTERRUPT
 
 
@@ -321,7 +598,7 @@ try:
     executor_t = Thread(target=runner, args=[executor], daemon=True)
     executor_t.start()
     while not executor.done:
-        time.sleep(1)
+        time.sleep(POLL_INTERVAL)
         interrupted = interrupt_requested()
         if interrupted == KILL_INTERRUPT:
             debug_print("expressPython:Terminating ...")